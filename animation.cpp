@@ -0,0 +1,487 @@
+#include "animation.h"
+#include "job_system.h"
+#include "system.h"
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ANIMATION_NEON
+typedef float32x4_t AnimVec;
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ANIMATION_SSE2
+typedef __m128 AnimVec;
+#else
+struct AnimVec {
+	r32 v[4];
+};
+#endif
+
+static const r32 animationChannelTolerances[ANIMATION_CHANNEL_COUNT] = {
+	animationRotationTolerance,
+	animationTranslationTolerance,
+	animationScaleTolerance
+};
+
+static inline AnimVec LoadVec(const r32* p) {
+#if defined(ANIMATION_NEON)
+	return vld1q_f32(p);
+#elif defined(ANIMATION_SSE2)
+	return _mm_loadu_ps(p);
+#else
+	AnimVec result;
+	memcpy(result.v, p, sizeof(r32) * 4);
+	return result;
+#endif
+}
+
+static inline void StoreVec(r32* p, AnimVec v) {
+#if defined(ANIMATION_NEON)
+	vst1q_f32(p, v);
+#elif defined(ANIMATION_SSE2)
+	_mm_storeu_ps(p, v);
+#else
+	memcpy(p, v.v, sizeof(r32) * 4);
+#endif
+}
+
+static inline AnimVec SplatVec(r32 value) {
+#if defined(ANIMATION_NEON)
+	return vdupq_n_f32(value);
+#elif defined(ANIMATION_SSE2)
+	return _mm_set1_ps(value);
+#else
+	return AnimVec{ { value, value, value, value } };
+#endif
+}
+
+// a + b * c
+static inline AnimVec MulAddVec(AnimVec a, AnimVec b, AnimVec c) {
+#if defined(ANIMATION_NEON)
+	return vmlaq_f32(a, b, c);
+#elif defined(ANIMATION_SSE2)
+	return _mm_add_ps(a, _mm_mul_ps(b, c));
+#else
+	AnimVec result;
+	for (u32 i = 0; i < 4; i++) {
+		result.v[i] = a.v[i] + b.v[i] * c.v[i];
+	}
+	return result;
+#endif
+}
+
+static inline AnimVec MulVec(AnimVec a, AnimVec b) {
+#if defined(ANIMATION_NEON)
+	return vmulq_f32(a, b);
+#elif defined(ANIMATION_SSE2)
+	return _mm_mul_ps(a, b);
+#else
+	AnimVec result;
+	for (u32 i = 0; i < 4; i++) {
+		result.v[i] = a.v[i] * b.v[i];
+	}
+	return result;
+#endif
+}
+
+static inline AnimVec SubVec(AnimVec a, AnimVec b) {
+#if defined(ANIMATION_NEON)
+	return vsubq_f32(a, b);
+#elif defined(ANIMATION_SSE2)
+	return _mm_sub_ps(a, b);
+#else
+	AnimVec result;
+	for (u32 i = 0; i < 4; i++) {
+		result.v[i] = a.v[i] - b.v[i];
+	}
+	return result;
+#endif
+}
+
+// 4 unorm16 values to floats in [min, min + extent]
+static inline AnimVec DecodeKey(const u16* key, AnimVec min, AnimVec scale) {
+#if defined(ANIMATION_NEON)
+	const AnimVec value = vcvtq_f32_u32(vmovl_u16(vld1_u16(key)));
+#elif defined(ANIMATION_SSE2)
+	const __m128i packed = _mm_loadl_epi64((const __m128i*)key);
+	const AnimVec value = _mm_cvtepi32_ps(_mm_unpacklo_epi16(packed, _mm_setzero_si128()));
+#else
+	const AnimVec value = AnimVec{ { (r32)key[0], (r32)key[1], (r32)key[2], (r32)key[3] } };
+#endif
+	return MulAddVec(min, value, scale);
+}
+
+// out = a * b, column major
+static void MultiplyMatrices(const r32* a, const r32* b, r32* out) {
+	const AnimVec a0 = LoadVec(a);
+	const AnimVec a1 = LoadVec(a + 4);
+	const AnimVec a2 = LoadVec(a + 8);
+	const AnimVec a3 = LoadVec(a + 12);
+
+	r32 result[16];
+	for (u32 col = 0; col < 4; col++) {
+		const r32* bColumn = b + col * 4;
+		AnimVec c = MulVec(a0, SplatVec(bColumn[0]));
+		c = MulAddVec(c, a1, SplatVec(bColumn[1]));
+		c = MulAddVec(c, a2, SplatVec(bColumn[2]));
+		c = MulAddVec(c, a3, SplatVec(bColumn[3]));
+		StoreVec(result + col * 4, c);
+	}
+	memcpy(out, result, sizeof(result));
+}
+
+static void ComposeJointMatrix(const JointTransform& transform, r32* out) {
+	const r32* q = transform.channels[ANIMATION_CHANNEL_ROTATION];
+	const r32* t = transform.channels[ANIMATION_CHANNEL_TRANSLATION];
+	const r32* s = transform.channels[ANIMATION_CHANNEL_SCALE];
+	const r32 x = q[0], y = q[1], z = q[2], w = q[3];
+
+	out[0] = (1.0f - 2.0f * (y * y + z * z)) * s[0];
+	out[1] = 2.0f * (x * y + w * z) * s[0];
+	out[2] = 2.0f * (x * z - w * y) * s[0];
+	out[3] = 0.0f;
+	out[4] = 2.0f * (x * y - w * z) * s[1];
+	out[5] = (1.0f - 2.0f * (x * x + z * z)) * s[1];
+	out[6] = 2.0f * (y * z + w * x) * s[1];
+	out[7] = 0.0f;
+	out[8] = 2.0f * (x * z + w * y) * s[2];
+	out[9] = 2.0f * (y * z - w * x) * s[2];
+	out[10] = (1.0f - 2.0f * (x * x + y * y)) * s[2];
+	out[11] = 0.0f;
+	out[12] = t[0];
+	out[13] = t[1];
+	out[14] = t[2];
+	out[15] = 1.0f;
+}
+
+static void NormalizeQuaternion(r32* q) {
+	const r32 length = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	const r32 scale = length > 0.0f ? 1.0f / length : 0.0f;
+	for (u32 i = 0; i < 4; i++) {
+		q[i] *= scale;
+	}
+}
+
+void MakeIdentityJointTransform(JointTransform& outTransform) {
+	memset(&outTransform, 0, sizeof(JointTransform));
+	outTransform.channels[ANIMATION_CHANNEL_ROTATION][3] = 1.0f;
+	for (u32 i = 0; i < 3; i++) {
+		outTransform.channels[ANIMATION_CHANNEL_SCALE][i] = 1.0f;
+	}
+}
+
+void DecomposeJointMatrix(const r32* m, JointTransform& outTransform) {
+	MakeIdentityJointTransform(outTransform);
+
+	r32 rotation[9];
+	for (u32 col = 0; col < 3; col++) {
+		const r32* axis = m + col * 4;
+		r32 scale = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		outTransform.channels[ANIMATION_CHANNEL_SCALE][col] = scale;
+		outTransform.channels[ANIMATION_CHANNEL_TRANSLATION][col] = m[12 + col];
+
+		scale = scale > 0.0f ? 1.0f / scale : 0.0f;
+		for (u32 row = 0; row < 3; row++) {
+			rotation[col * 3 + row] = axis[row] * scale;
+		}
+	}
+
+	// Negative determinant means a mirrored basis, put the flip in the x scale
+	const r32 det = rotation[0] * (rotation[4] * rotation[8] - rotation[7] * rotation[5]) -
+		rotation[3] * (rotation[1] * rotation[8] - rotation[7] * rotation[2]) +
+		rotation[6] * (rotation[1] * rotation[5] - rotation[4] * rotation[2]);
+	if (det < 0.0f) {
+		outTransform.channels[ANIMATION_CHANNEL_SCALE][0] *= -1.0f;
+		for (u32 row = 0; row < 3; row++) {
+			rotation[row] *= -1.0f;
+		}
+	}
+
+	// r(row, col) = rotation[col * 3 + row]
+	r32* q = outTransform.channels[ANIMATION_CHANNEL_ROTATION];
+	const r32 trace = rotation[0] + rotation[4] + rotation[8];
+	if (trace > 0.0f) {
+		const r32 s = sqrtf(trace + 1.0f) * 2.0f;
+		q[3] = 0.25f * s;
+		q[0] = (rotation[5] - rotation[7]) / s;
+		q[1] = (rotation[6] - rotation[2]) / s;
+		q[2] = (rotation[1] - rotation[3]) / s;
+	}
+	else if (rotation[0] > rotation[4] && rotation[0] > rotation[8]) {
+		const r32 s = sqrtf(1.0f + rotation[0] - rotation[4] - rotation[8]) * 2.0f;
+		q[3] = (rotation[5] - rotation[7]) / s;
+		q[0] = 0.25f * s;
+		q[1] = (rotation[3] + rotation[1]) / s;
+		q[2] = (rotation[6] + rotation[2]) / s;
+	}
+	else if (rotation[4] > rotation[8]) {
+		const r32 s = sqrtf(1.0f + rotation[4] - rotation[0] - rotation[8]) * 2.0f;
+		q[3] = (rotation[6] - rotation[2]) / s;
+		q[0] = (rotation[3] + rotation[1]) / s;
+		q[1] = 0.25f * s;
+		q[2] = (rotation[7] + rotation[5]) / s;
+	}
+	else {
+		const r32 s = sqrtf(1.0f + rotation[8] - rotation[0] - rotation[4]) * 2.0f;
+		q[3] = (rotation[1] - rotation[3]) / s;
+		q[0] = (rotation[6] + rotation[2]) / s;
+		q[1] = (rotation[7] + rotation[5]) / s;
+		q[2] = 0.25f * s;
+	}
+	NormalizeQuaternion(q);
+}
+
+static bool IsWithinTolerance(const r32* a, const r32* b, r32 tolerance) {
+	for (u32 i = 0; i < 4; i++) {
+		if (fabsf(a[i] - b[i]) > tolerance) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Greedily extends each segment as far as linear interpolation stays within the tolerance, returns the kept frame count
+static u32 ReduceKeys(const r32* values, u32 frameCount, r32 tolerance, u32* outFrames) {
+	u32 keyCount = 0;
+	u32 start = 0;
+	outFrames[keyCount++] = 0;
+
+	while (start < frameCount - 1) {
+		u32 end = start + 1;
+		while (end + 1 < frameCount) {
+			const u32 candidate = end + 1;
+			bool fits = true;
+			for (u32 f = start + 1; f < candidate && fits; f++) {
+				const r32 t = (r32)(f - start) / (candidate - start);
+				r32 interpolated[4];
+				for (u32 i = 0; i < 4; i++) {
+					interpolated[i] = values[start * 4 + i] + (values[candidate * 4 + i] - values[start * 4 + i]) * t;
+				}
+				fits = IsWithinTolerance(interpolated, values + f * 4, tolerance);
+			}
+			if (!fits) {
+				break;
+			}
+			end = candidate;
+		}
+
+		outFrames[keyCount++] = end;
+		start = end;
+	}
+
+	return keyCount;
+}
+
+bool CompressAnimationClip(const JointTransform* frames, u32 frameCount, r32 frameRate, const Skeleton& skeleton, AnimationClip& outClip) {
+	outClip = {};
+	if (frameCount == 0 || frameCount > 0xffff || skeleton.jointCount == 0 || skeleton.jointCount > maxSkeletonJointCount) {
+		DEBUG_LOG("Can't compress a clip of %d frames for %d joints", frameCount, skeleton.jointCount);
+		return false;
+	}
+
+	const u32 jointCount = skeleton.jointCount;
+	const u32 maxTrackCount = jointCount * ANIMATION_CHANNEL_COUNT;
+	outClip.duration = (frameCount - 1) / frameRate;
+	outClip.tracks = (AnimationTrack*)calloc(maxTrackCount, sizeof(AnimationTrack));
+	outClip.keyTimes = (u16*)malloc(sizeof(u16) * (u64)frameCount * maxTrackCount);
+	outClip.keyValues = (u16*)malloc(sizeof(u16) * 4 * (u64)frameCount * maxTrackCount);
+
+	r32* values = (r32*)malloc(sizeof(r32) * 4 * frameCount);
+	u32* keyFrames = (u32*)malloc(sizeof(u32) * frameCount);
+
+	for (u32 joint = 0; joint < jointCount; joint++) {
+		for (u32 channel = 0; channel < ANIMATION_CHANNEL_COUNT; channel++) {
+			const r32 tolerance = animationChannelTolerances[channel];
+			for (u32 f = 0; f < frameCount; f++) {
+				memcpy(values + f * 4, frames[(u64)f * jointCount + joint].channels[channel], sizeof(r32) * 4);
+				if (channel != ANIMATION_CHANNEL_ROTATION) {
+					values[f * 4 + 3] = 0.0f;
+				}
+				// q and -q are the same rotation, keep neighbours in the same hemisphere so they interpolate the short way
+				else if (f > 0) {
+					const r32* previous = values + (f - 1) * 4;
+					r32* current = values + f * 4;
+					if (previous[0] * current[0] + previous[1] * current[1] + previous[2] * current[2] + previous[3] * current[3] < 0.0f) {
+						for (u32 i = 0; i < 4; i++) {
+							current[i] = -current[i];
+						}
+					}
+				}
+			}
+
+			bool constant = true;
+			for (u32 f = 1; f < frameCount && constant; f++) {
+				constant = IsWithinTolerance(values, values + f * 4, tolerance);
+			}
+
+			// Constant tracks that match the bind pose don't need to be stored at all
+			if (constant) {
+				const r32* bind = skeleton.bindPose[joint].channels[channel];
+				r32 negated[4] = { -bind[0], -bind[1], -bind[2], -bind[3] };
+				if (IsWithinTolerance(values, bind, tolerance) || (channel == ANIMATION_CHANNEL_ROTATION && IsWithinTolerance(values, negated, tolerance))) {
+					continue;
+				}
+			}
+
+			const u32 keyCount = constant ? 1 : ReduceKeys(values, frameCount, tolerance, keyFrames);
+			if (constant) {
+				keyFrames[0] = 0;
+			}
+
+			AnimationTrack& track = outClip.tracks[outClip.trackCount++];
+			track.firstKey = outClip.keyCount;
+			track.keyCount = keyCount;
+			track.joint = joint;
+			track.channel = (AnimationChannel)channel;
+
+			r32 max[4];
+			for (u32 i = 0; i < 4; i++) {
+				track.min[i] = max[i] = values[keyFrames[0] * 4 + i];
+			}
+			for (u32 k = 1; k < keyCount; k++) {
+				for (u32 i = 0; i < 4; i++) {
+					const r32 value = values[keyFrames[k] * 4 + i];
+					track.min[i] = value < track.min[i] ? value : track.min[i];
+					max[i] = value > max[i] ? value : max[i];
+				}
+			}
+			for (u32 i = 0; i < 4; i++) {
+				track.extent[i] = max[i] - track.min[i];
+			}
+
+			for (u32 k = 0; k < keyCount; k++) {
+				const u32 key = outClip.keyCount++;
+				outClip.keyTimes[key] = frameCount > 1 ? (u16)roundf((r32)keyFrames[k] / (frameCount - 1) * 65535.0f) : 0;
+				for (u32 i = 0; i < 4; i++) {
+					const r32 normalized = track.extent[i] > 0.0f ? (values[keyFrames[k] * 4 + i] - track.min[i]) / track.extent[i] : 0.0f;
+					outClip.keyValues[key * 4 + i] = (u16)roundf(normalized * 65535.0f);
+				}
+			}
+		}
+	}
+
+	free(keyFrames);
+	free(values);
+
+	outClip.tracks = (AnimationTrack*)realloc(outClip.tracks, sizeof(AnimationTrack) * (outClip.trackCount > 0 ? outClip.trackCount : 1));
+	outClip.keyTimes = (u16*)realloc(outClip.keyTimes, sizeof(u16) * (outClip.keyCount > 0 ? outClip.keyCount : 1));
+	outClip.keyValues = (u16*)realloc(outClip.keyValues, sizeof(u16) * 4 * (outClip.keyCount > 0 ? outClip.keyCount : 1));
+
+	DEBUG_LOG("Compressed %d frames of %d joints into %d tracks with %d keys (%llu bytes)", frameCount, jointCount, outClip.trackCount, outClip.keyCount,
+		(unsigned long long)(sizeof(AnimationTrack) * outClip.trackCount + sizeof(u16) * 5 * outClip.keyCount));
+	return true;
+}
+
+void FreeAnimationClip(AnimationClip& clip) {
+	free(clip.tracks);
+	free(clip.keyTimes);
+	free(clip.keyValues);
+	clip = {};
+}
+
+void FreeSkeleton(Skeleton& skeleton) {
+	free(skeleton.parents);
+	free(skeleton.order);
+	free(skeleton.bindPose);
+	free(skeleton.inverseBindMatrices);
+	skeleton = {};
+}
+
+// Last key at or before the time, tracks are short enough that the cache misses don't matter more than the search
+static u32 FindKey(const u16* times, u32 keyCount, r32 time) {
+	u32 low = 0;
+	u32 high = keyCount - 1;
+	while (low < high) {
+		const u32 mid = (low + high + 1) / 2;
+		if (times[mid] <= time) {
+			low = mid;
+		}
+		else {
+			high = mid - 1;
+		}
+	}
+	return low;
+}
+
+void SampleAnimationClip(const AnimationClip& clip, const Skeleton& skeleton, r32 time, bool loop, JointTransform* outLocal) {
+	memcpy(outLocal, skeleton.bindPose, sizeof(JointTransform) * skeleton.jointCount);
+
+	if (clip.duration > 0.0f) {
+		time = loop ? fmodf(time, clip.duration) : time;
+		time = time < 0.0f ? (loop ? time + clip.duration : 0.0f) : time;
+		time = time > clip.duration ? clip.duration : time;
+	}
+	else {
+		time = 0.0f;
+	}
+	const r32 clipTime = clip.duration > 0.0f ? time / clip.duration * 65535.0f : 0.0f;
+	const AnimVec valueScale = SplatVec(1.0f / 65535.0f);
+
+	for (u32 i = 0; i < clip.trackCount; i++) {
+		const AnimationTrack& track = clip.tracks[i];
+		const AnimVec min = LoadVec(track.min);
+		const AnimVec scale = MulVec(LoadVec(track.extent), valueScale);
+		r32* out = outLocal[track.joint].channels[track.channel];
+
+		const u16* times = clip.keyTimes + track.firstKey;
+		const u16* values = clip.keyValues + (u64)track.firstKey * 4;
+		const u32 key = FindKey(times, track.keyCount, clipTime);
+		if (key + 1 >= track.keyCount) {
+			StoreVec(out, DecodeKey(values + key * 4, min, scale));
+		}
+		else {
+			const AnimVec a = DecodeKey(values + key * 4, min, scale);
+			const AnimVec b = DecodeKey(values + (key + 1) * 4, min, scale);
+			const r32 t = (clipTime - times[key]) / (r32)(times[key + 1] - times[key]);
+			StoreVec(out, MulAddVec(a, SubVec(b, a), SplatVec(t)));
+		}
+
+		if (track.channel == ANIMATION_CHANNEL_ROTATION) {
+			NormalizeQuaternion(out);
+		}
+	}
+}
+
+void ComputeJointPalette(const Skeleton& skeleton, const JointTransform* local, r32* outPalette) {
+	r32 model[maxSkeletonJointCount * 16];
+	for (u32 i = 0; i < skeleton.jointCount; i++) {
+		const u16 joint = skeleton.order[i];
+		const s16 parent = skeleton.parents[joint];
+
+		r32 localMatrix[16];
+		ComposeJointMatrix(local[joint], localMatrix);
+		MultiplyMatrices(parent < 0 ? skeleton.rootTransform : model + parent * 16, localMatrix, model + joint * 16);
+		MultiplyMatrices(model + joint * 16, skeleton.inverseBindMatrices + joint * 16, outPalette + joint * 16);
+	}
+}
+
+static void SampleAnimationJob(void* userData) {
+	const AnimationSampleJob& job = *(const AnimationSampleJob*)userData;
+
+	if (job.clip == nullptr) {
+		ComputeJointPalette(*job.skeleton, job.skeleton->bindPose, job.outPalette);
+		return;
+	}
+
+	JointTransform local[maxSkeletonJointCount];
+	SampleAnimationClip(*job.clip, *job.skeleton, job.time, job.loop, local);
+	ComputeJointPalette(*job.skeleton, local, job.outPalette);
+}
+
+void SampleAnimations(const AnimationSampleJob* jobs, u32 count, JobSystem* jobSystem) {
+	if (jobSystem == nullptr) {
+		for (u32 i = 0; i < count; i++) {
+			SampleAnimationJob((void*)&jobs[i]);
+		}
+		return;
+	}
+
+	// The calling thread helps out while waiting
+	JobCounter counter;
+	for (u32 i = 0; i < count; i++) {
+		jobSystem->Schedule(SampleAnimationJob, (void*)&jobs[i], &counter);
+	}
+	jobSystem->Wait(counter);
+}
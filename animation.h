@@ -0,0 +1,79 @@
+#pragma once
+#include "typedef.h"
+
+class JobSystem;
+
+// Skeletal animation clips in a compact quantized format, sampled into joint palettes for Renderer::DrawSkinnedMeshInstanced
+// Matrices are column major r32[16] (same layout as glm::mat4), quaternions are x, y, z, w
+// Uses NEON or SSE2 when available, otherwise plain scalar loops
+
+constexpr u32 maxSkeletonJointCount = 256;
+constexpr r32 animationImportFrameRate = 30.0f; // Source animations are resampled at this rate before compression
+// Keys that can be interpolated from their neighbours within these are dropped
+constexpr r32 animationRotationTolerance = 0.0005f; // Quaternion component
+constexpr r32 animationTranslationTolerance = 0.0001f; // Skeleton units
+constexpr r32 animationScaleTolerance = 0.0001f;
+
+enum AnimationChannel {
+	ANIMATION_CHANNEL_ROTATION,
+	ANIMATION_CHANNEL_TRANSLATION,
+	ANIMATION_CHANNEL_SCALE,
+	ANIMATION_CHANNEL_COUNT
+};
+
+// Every channel is 4 wide so they all sample the same way, w of translation and scale is unused
+struct JointTransform {
+	r32 channels[ANIMATION_CHANNEL_COUNT][4];
+};
+
+struct Skeleton {
+	u32 jointCount;
+	s16* parents; // -1 for roots
+	u16* order; // Joint indices with parents before their children
+	JointTransform* bindPose; // Local transforms of joints the clip doesn't animate
+	r32* inverseBindMatrices; // 16 per joint
+	r32 rootTransform[16]; // Applied to the roots, places the skeleton in the model
+};
+
+struct AnimationTrack {
+	u32 firstKey;
+	u16 keyCount; // 1 = constant
+	u16 joint;
+	AnimationChannel channel;
+	r32 min[4];
+	r32 extent[4]; // Values are stored as unorm16 in [min, min + extent]
+};
+
+struct AnimationClip {
+	r32 duration; // Seconds
+	u32 trackCount;
+	AnimationTrack* tracks;
+	u32 keyCount;
+	u16* keyTimes; // unorm16 fraction of the duration
+	u16* keyValues; // 4 per key
+};
+
+struct AnimationSampleJob {
+	const Skeleton* skeleton;
+	const AnimationClip* clip; // Null for the bind pose
+	r32 time;
+	bool loop; // Otherwise the time is clamped to the clip
+	r32* outPalette; // skeleton->jointCount matrices, can point straight into Renderer::AllocateJoints
+};
+
+void MakeIdentityJointTransform(JointTransform& outTransform);
+// Matrix must not have shear
+void DecomposeJointMatrix(const r32* matrix, JointTransform& outTransform);
+
+// frames has frameCount * skeleton.jointCount local transforms, frame by frame
+bool CompressAnimationClip(const JointTransform* frames, u32 frameCount, r32 frameRate, const Skeleton& skeleton, AnimationClip& outClip);
+void FreeAnimationClip(AnimationClip& clip);
+void FreeSkeleton(Skeleton& skeleton);
+
+// Local transforms at the given time, joints without tracks keep the bind pose
+void SampleAnimationClip(const AnimationClip& clip, const Skeleton& skeleton, r32 time, bool loop, JointTransform* outLocal);
+// Model space joint transforms times the inverse bind matrices
+void ComputeJointPalette(const Skeleton& skeleton, const JointTransform* local, r32* outPalette);
+
+// One job per skeleton, waits for all of them. jobSystem can be null
+void SampleAnimations(const AnimationSampleJob* jobs, u32 count, JobSystem* jobSystem);
@@ -0,0 +1,483 @@
+#include "asset_loader.h"
+#include "gltf.h"
+#include "astc.h"
+#include "ktx.h"
+#include "cooked.h"
+#include "math.h"
+#include <cstring>
+#include <cstdio>
+
+static bool HasExtension(const char* fname, const char* extension) {
+	const u32 nameLength = strlen(fname);
+	const u32 extensionLength = strlen(extension);
+	return nameLength > extensionLength && strcmp(fname + nameLength - extensionLength, extension) == 0;
+}
+
+bool OpenTextureFile(const char* fname, FileView& outFile, Rendering::TextureCreateInfo& outInfo, AAssetManager* assetManager) {
+	if (!OpenFileView(fname, outFile, assetManager)) {
+		return false;
+	}
+
+	outInfo.type = Rendering::TEXTURE_2D;
+	outInfo.generateMips = false;
+	outInfo.mipCount = 1;
+	outInfo.space = Rendering::COLORSPACE_SRGB;
+	outInfo.filter = Rendering::TEXFILTER_LINEAR;
+
+	bool result;
+	if (HasExtension(fname, ".ktx2")) {
+		// Format, color space, layers and mips all come from the file
+		result = GetKTX2Info(outFile.data, outFile.size, outInfo);
+	}
+	else if (HasExtension(fname, ".ntex")) {
+		result = GetCookedTextureInfo(outFile.data, outFile.size, outInfo);
+	}
+	else {
+		result = GetAstcInfo(outFile.data, outInfo.width, outInfo.height, outInfo.compression) && GetAstcPayload(outFile.data, &outInfo.pixels);
+	}
+
+	if (!result) {
+		DEBUG_LOG("Failed to load texture %s", fname);
+		CloseFileView(outFile);
+		return false;
+	}
+
+	return true;
+}
+
+AssetLoader::AssetLoader(Rendering::Renderer& renderer, JobSystem& jobSystem, AAssetManager* assetManager) : renderer(renderer), jobSystem(jobSystem), assetManager(assetManager) {
+	assets = (Asset*)calloc(maxAssetCount, sizeof(Asset));
+	assetCount = 0;
+	completedFirst = 0;
+	completedCount = 0;
+}
+
+AssetLoader::~AssetLoader() {
+	// Jobs write into the assets, so they need to finish first
+	jobSystem.Wait(pendingJobs);
+
+	for (u32 i = 0; i < assetCount; i++) {
+		if (assets[i].state == ASSET_LOADING) {
+			CancelHandles(assets[i]);
+		}
+		if (assets[i].state == ASSET_LOADING || (assets[i].state == ASSET_READY && assets[i].type == ASSET_SKELETON)) {
+			ReleaseAssetData(assets[i]);
+		}
+	}
+
+	free(assets);
+}
+
+AssetLoader::Asset* AssetLoader::AddAsset(AssetType type, u64 placeholder) {
+	if (assetCount >= maxAssetCount) {
+		DEBUG_ERROR("Too many assets");
+	}
+
+	Asset& asset = assets[assetCount];
+	asset = {};
+	asset.loader = this;
+	asset.id = assetCount++;
+	asset.type = type;
+	asset.state = ASSET_LOADING;
+	asset.placeholder = placeholder;
+	return &asset;
+}
+
+AssetId AssetLoader::LoadMesh(const char* cookedFname, const char* path, const char* fname, const char* meshName, Rendering::MeshHandle placeholder) {
+	Asset* asset = AddAsset(ASSET_MESH, placeholder);
+	snprintf(asset->cookedFname, maxAssetPathLength, "%s", cookedFname);
+	snprintf(asset->path, maxAssetPathLength, "%s", path);
+	snprintf(asset->fname, maxAssetPathLength, "%s", fname);
+	snprintf(asset->name, maxAssetNameLength, "%s", meshName);
+
+	jobSystem.Schedule(LoadJob, asset, &pendingJobs);
+	return asset->id;
+}
+
+AssetId AssetLoader::LoadControllerModel(XR::XRInstance* xrInstance, XR::HandIndex hand) {
+	Asset* asset = AddAsset(ASSET_CONTROLLER_MODEL, 0);
+	asset->xrInstance = xrInstance;
+	asset->hand = hand;
+	snprintf(asset->name, maxAssetNameLength, "%s", hand == XR::VR_HAND_LEFT ? "LeftController" : "RightController");
+
+	jobSystem.Schedule(LoadJob, asset, &pendingJobs);
+	return asset->id;
+}
+
+AssetId AssetLoader::LoadTexture(const char* name, const char* cookedFname, const char* fname, bool stream, Rendering::TextureHandle placeholder) {
+	Asset* asset = AddAsset(ASSET_TEXTURE, placeholder);
+	snprintf(asset->name, maxAssetNameLength, "%s", name);
+	snprintf(asset->cookedFname, maxAssetPathLength, "%s", cookedFname);
+	snprintf(asset->fname, maxAssetPathLength, "%s", fname);
+	asset->stream = stream;
+	asset->textureId = RegisterResourceName(asset->name);
+
+	jobSystem.Schedule(LoadJob, asset, &pendingJobs);
+	return asset->id;
+}
+
+AssetId AssetLoader::LoadSkeleton(const char* path, const char* fname, const char* skinName, const char* animationName) {
+	Asset* asset = AddAsset(ASSET_SKELETON, 0);
+	snprintf(asset->path, maxAssetPathLength, "%s", path);
+	snprintf(asset->fname, maxAssetPathLength, "%s", fname);
+	snprintf(asset->name, maxAssetNameLength, "%s", skinName);
+	snprintf(asset->animationName, maxAssetNameLength, "%s", animationName != nullptr ? animationName : "");
+
+	jobSystem.Schedule(LoadJob, asset, &pendingJobs);
+	return asset->id;
+}
+
+void AssetLoader::BindTexture(AssetId texture, Rendering::MaterialHandle material, u32 index) {
+	Asset& asset = assets[texture];
+	if (asset.state == ASSET_READY) {
+		renderer.UpdateMaterialTexture(material, index, asset.handles[0]);
+		return;
+	}
+
+	if (asset.bindingCount >= Rendering::maxSamplerCount) {
+		DEBUG_ERROR("Too many bindings for texture %s", asset.name);
+	}
+	asset.bindings[asset.bindingCount++] = { material, index };
+}
+
+void AssetLoader::LoadJob(void* userData) {
+	Asset& asset = *(Asset*)userData;
+	AssetLoader* loader = asset.loader;
+
+	switch (asset.type) {
+		case ASSET_MESH:
+			loader->LoadMeshData(asset);
+			break;
+		case ASSET_CONTROLLER_MODEL:
+			loader->LoadControllerData(asset);
+			break;
+		case ASSET_TEXTURE:
+			loader->LoadTextureData(asset);
+			break;
+		case ASSET_SKELETON:
+			loader->LoadSkeletonData(asset);
+			break;
+	}
+	loader->ReserveHandles(asset);
+
+	std::lock_guard<std::mutex> lock(loader->completedMutex);
+	loader->completed[(loader->completedFirst + loader->completedCount++) % maxAssetCount] = asset.id;
+}
+
+void AssetLoader::LoadMeshData(Asset& asset) {
+	if (OpenFileView(asset.cookedFname, asset.file, assetManager)) {
+		if (GetCookedMeshInfo(asset.file.data, asset.file.size, asset.meshInfos[0])) {
+			asset.cooked = true;
+			asset.meshCount = 1;
+			asset.meshIds[0] = RegisterResourceName(asset.name);
+			return;
+		}
+		CloseFileView(asset.file);
+	}
+
+	GLTFData gltf{};
+	cgltf_mesh mesh;
+	if (!LoadGLTF(asset.path, asset.fname, gltf, assetManager) ||
+		!FindGLTFMeshByName(gltf.data, asset.name, mesh) ||
+		!GetGLTFMeshInfo(gltf.data, mesh, asset.meshInfos[0], &jobSystem)) {
+		DEBUG_LOG("Failed to load mesh %s from %s", asset.name, asset.fname);
+		FreeGLTFData(gltf);
+		asset.failed = true;
+		return;
+	}
+
+	asset.meshCount = 1;
+	asset.meshIds[0] = RegisterResourceName(asset.name);
+	FreeGLTFData(gltf);
+}
+
+void AssetLoader::LoadControllerData(Asset& asset) {
+	u8* buffer = nullptr;
+	u32 bufferSize;
+	GLTFData gltf{};
+	if (!asset.xrInstance->GetControllerGeometry(asset.hand, &buffer, bufferSize) ||
+		!LoadGLTF(buffer, bufferSize, gltf, assetManager)) {
+		DEBUG_LOG("Failed to load %s model", asset.name);
+		free(buffer);
+		asset.failed = true;
+		return;
+	}
+
+	const cgltf_data* data = gltf.data;
+	// Failed meshes are skipped, so glTF mesh indices don't match the asset's
+	u32 meshSlots[maxAssetMeshCount];
+	const u32 gltfMeshCount = MIN((u32)data->meshes_count, maxAssetMeshCount);
+	for (u32 i = 0; i < gltfMeshCount; i++) {
+		const cgltf_mesh& mesh = data->meshes[i];
+		DEBUG_LOG("Found %s mesh %s", asset.name, mesh.name);
+
+		const u32 meshIndex = asset.meshCount;
+		meshSlots[i] = maxAssetMeshCount;
+		if (GetGLTFMeshInfo(data, mesh, asset.meshInfos[meshIndex], &jobSystem)) {
+			asset.meshIds[meshIndex] = RegisterResourceName(mesh.name != nullptr ? mesh.name : "");
+			meshSlots[i] = meshIndex;
+			asset.meshCount++;
+		}
+	}
+
+	std::vector<GLTFMeshInstance> instances;
+	if (!GetGLTFMeshInstances(data, instances)) {
+		// No node hierarchy, draw every mesh at the model origin
+		for (u32 i = 0; i < gltfMeshCount; i++) {
+			instances.push_back({ i, glm::mat4(1.0f) });
+		}
+	}
+	for (const GLTFMeshInstance& instance : instances) {
+		if (instance.meshIndex >= gltfMeshCount || meshSlots[instance.meshIndex] == maxAssetMeshCount) {
+			continue;
+		}
+		if (asset.instanceCount >= maxAssetInstanceCount) {
+			DEBUG_LOG("%s has too many mesh instances", asset.name);
+			break;
+		}
+
+		asset.instanceMeshes[asset.instanceCount] = meshSlots[instance.meshIndex];
+		asset.instanceTransforms[asset.instanceCount] = instance.transform;
+		asset.instanceCount++;
+	}
+
+	// The GLB binary chunk points into the buffer, so it can only go after the mesh data is copied out
+	FreeGLTFData(gltf);
+	free(buffer);
+}
+
+void AssetLoader::LoadTextureData(Asset& asset) {
+	if (!OpenTextureFile(asset.cookedFname, asset.file, asset.textureInfo, assetManager) &&
+		!OpenTextureFile(asset.fname, asset.file, asset.textureInfo, assetManager)) {
+		DEBUG_LOG("Failed to load texture %s", asset.fname);
+		asset.failed = true;
+		return;
+	}
+	asset.textureInfo.stream = asset.stream;
+
+	// Supercompressed levels would otherwise get decoded on the render thread while uploading
+	if (asset.textureInfo.readLevel == ReadKTX2Level) {
+		u64 decodedSize;
+		asset.decodedPixels = AllocKTX2Levels(asset.file.data, decodedSize);
+		asset.textureInfo.pixels = asset.decodedPixels;
+		asset.textureInfo.readLevel = nullptr;
+		asset.textureInfo.readLevelUserData = nullptr;
+		CloseFileView(asset.file);
+	}
+}
+
+void AssetLoader::LoadSkeletonData(Asset& asset) {
+	GLTFData gltf{};
+	if (!LoadGLTF(asset.path, asset.fname, gltf, assetManager)) {
+		DEBUG_LOG("Failed to load skin %s from %s", asset.name, asset.fname);
+		asset.failed = true;
+		return;
+	}
+
+	const cgltf_data* data = gltf.data;
+	const cgltf_skin* skin = nullptr;
+	for (u32 i = 0; i < data->skins_count; i++) {
+		if (data->skins[i].name != nullptr && strcmp(data->skins[i].name, asset.name) == 0) {
+			skin = &data->skins[i];
+			break;
+		}
+	}
+	const cgltf_animation* animation = nullptr;
+	for (u32 i = 0; i < data->animations_count && asset.animationName[0] != '\0'; i++) {
+		if (data->animations[i].name != nullptr && strcmp(data->animations[i].name, asset.animationName) == 0) {
+			animation = &data->animations[i];
+			break;
+		}
+	}
+
+	if (skin == nullptr || !GetGLTFSkeleton(*skin, asset.skeleton)) {
+		DEBUG_LOG("Failed to load skin %s from %s", asset.name, asset.fname);
+		asset.failed = true;
+	}
+	else if (asset.animationName[0] != '\0') {
+		asset.hasClip = animation != nullptr && GetGLTFAnimationClip(*animation, *skin, asset.skeleton, asset.clip);
+		if (!asset.hasClip) {
+			DEBUG_LOG("Failed to load animation %s from %s, using the bind pose", asset.animationName, asset.fname);
+		}
+	}
+
+	FreeGLTFData(gltf);
+}
+
+// Pool slots are taken here instead of on the render thread, Commit only fills them in
+void AssetLoader::ReserveHandles(Asset& asset) {
+	if (asset.failed) {
+		return;
+	}
+
+	if (asset.type == ASSET_TEXTURE) {
+		asset.handles[0] = renderer.ReserveTexture();
+	}
+	else if (asset.type != ASSET_SKELETON) {
+		for (u32 i = 0; i < asset.meshCount; i++) {
+			asset.handles[i] = renderer.ReserveMesh();
+		}
+	}
+}
+
+void AssetLoader::CancelHandles(Asset& asset) {
+	if (asset.failed) {
+		return;
+	}
+
+	if (asset.type == ASSET_TEXTURE) {
+		renderer.CancelTexture(asset.handles[0]);
+	}
+	else if (asset.type != ASSET_SKELETON) {
+		for (u32 i = 0; i < asset.meshCount; i++) {
+			renderer.CancelMesh(asset.handles[i]);
+		}
+	}
+}
+
+void AssetLoader::Update(u32 maxCommits) {
+	AssetId ready[maxAssetCount];
+	u32 readyCount = 0;
+	{
+		std::lock_guard<std::mutex> lock(completedMutex);
+		readyCount = MIN(completedCount, MIN(maxCommits, maxAssetCount));
+		for (u32 i = 0; i < readyCount; i++) {
+			ready[i] = completed[(completedFirst + i) % maxAssetCount];
+		}
+		completedFirst = (completedFirst + readyCount) % maxAssetCount;
+		completedCount -= readyCount;
+	}
+
+	for (u32 i = 0; i < readyCount; i++) {
+		Commit(assets[ready[i]]);
+	}
+}
+
+void AssetLoader::Commit(Asset& asset) {
+	if (asset.unloadRequested) {
+		asset.state = ASSET_UNLOADED;
+		CancelHandles(asset);
+		ReleaseAssetData(asset);
+		return;
+	}
+
+	if (asset.failed) {
+		DEBUG_LOG("Asset %s failed to load, keeping placeholder", asset.name);
+		asset.state = ASSET_FAILED;
+		ReleaseAssetData(asset);
+		return;
+	}
+
+	if (asset.type == ASSET_SKELETON) {
+		// Nothing on the GPU, the palettes are sampled on the CPU every frame
+		asset.state = ASSET_READY;
+		return;
+	}
+
+	if (asset.type == ASSET_TEXTURE) {
+		asset.handles[0] = renderer.CreateTexture(asset.textureId, asset.textureInfo, asset.handles[0]);
+		for (u32 i = 0; i < asset.bindingCount; i++) {
+			renderer.UpdateMaterialTexture(asset.bindings[i].material, asset.bindings[i].index, asset.handles[0]);
+		}
+	}
+	else {
+		for (u32 i = 0; i < asset.meshCount; i++) {
+			// Loaded models don't need full precision, save the vertex fetch bandwidth. Cooked ones come quantized already
+			if (!asset.cooked) {
+				asset.meshInfos[i].vertexFormat = Rendering::VERTEX_FORMAT_QUANTIZED;
+			}
+			// Shared content gives the reservation back and returns the existing mesh
+			asset.handles[i] = renderer.CreateMesh(asset.meshIds[i], asset.meshInfos[i], asset.handles[i]);
+		}
+	}
+
+	ReleaseAssetData(asset);
+	asset.state = ASSET_READY;
+}
+
+void AssetLoader::ReleaseAssetData(Asset& asset) {
+	if (!asset.cooked) {
+		for (u32 i = 0; i < asset.meshCount; i++) {
+			FreeGLTFMeshInfo(asset.meshInfos[i]);
+		}
+	}
+	CloseFileView(asset.file);
+	free(asset.decodedPixels);
+	asset.decodedPixels = nullptr;
+	if (asset.type == ASSET_SKELETON) {
+		FreeSkeleton(asset.skeleton);
+		FreeAnimationClip(asset.clip);
+		asset.hasClip = false;
+	}
+}
+
+void AssetLoader::Unload(AssetId id) {
+	Asset& asset = assets[id];
+	if (asset.state == ASSET_LOADING) {
+		asset.unloadRequested = true;
+		return;
+	}
+	if (asset.state != ASSET_READY) {
+		return;
+	}
+
+	if (asset.type == ASSET_SKELETON) {
+		ReleaseAssetData(asset);
+	}
+	else if (asset.type == ASSET_TEXTURE) {
+		renderer.ReleaseTexture(asset.handles[0]);
+	}
+	else {
+		for (u32 i = 0; i < asset.meshCount; i++) {
+			renderer.ReleaseMesh(asset.handles[i]);
+		}
+	}
+	asset.state = ASSET_UNLOADED;
+}
+
+bool AssetLoader::IsReady(AssetId id) const {
+	return assets[id].state == ASSET_READY;
+}
+
+u32 AssetLoader::GetMeshCount(AssetId id) const {
+	const Asset& asset = assets[id];
+	if (asset.state == ASSET_READY) {
+		return asset.meshCount;
+	}
+
+	return asset.type == ASSET_CONTROLLER_MODEL ? 0 : 1;
+}
+
+Rendering::MeshHandle AssetLoader::GetMesh(AssetId id, u32 index) const {
+	const Asset& asset = assets[id];
+	return asset.state == ASSET_READY ? asset.handles[index] : asset.placeholder;
+}
+
+u32 AssetLoader::GetInstanceCount(AssetId id) const {
+	const Asset& asset = assets[id];
+	return asset.state == ASSET_READY ? asset.instanceCount : 0;
+}
+
+Rendering::MeshHandle AssetLoader::GetInstanceMesh(AssetId id, u32 index) const {
+	const Asset& asset = assets[id];
+	return asset.handles[asset.instanceMeshes[index]];
+}
+
+const glm::mat4& AssetLoader::GetInstanceTransform(AssetId id, u32 index) const {
+	return assets[id].instanceTransforms[index];
+}
+
+Rendering::TextureHandle AssetLoader::GetTexture(AssetId id) const {
+	const Asset& asset = assets[id];
+	return asset.state == ASSET_READY ? asset.handles[0] : asset.placeholder;
+}
+
+const Skeleton* AssetLoader::GetSkeleton(AssetId id) const {
+	const Asset& asset = assets[id];
+	return asset.state == ASSET_READY ? &asset.skeleton : nullptr;
+}
+
+const AnimationClip* AssetLoader::GetAnimationClip(AssetId id) const {
+	const Asset& asset = assets[id];
+	return asset.state == ASSET_READY && asset.hasClip ? &asset.clip : nullptr;
+}
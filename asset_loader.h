@@ -0,0 +1,144 @@
+#pragma once
+#include "renderer.h"
+#include "animation.h"
+#include "job_system.h"
+#include "system.h"
+#include "xr.h"
+#include <mutex>
+
+constexpr u32 maxAssetCount = 256;
+constexpr u32 maxAssetMeshCount = 16; // Per model
+constexpr u32 maxAssetInstanceCount = 32; // Per model
+constexpr u32 maxAssetCommitsPerFrame = 2; // Staging copies happen on the render thread, so spread them out
+constexpr u32 maxAssetNameLength = 64;
+constexpr u32 maxAssetPathLength = 256;
+
+typedef u32 AssetId;
+
+// Reads the texture header (KTX2, cooked or ASTC by file extension). The info points into the file, which has to stay open until the texture is created
+bool OpenTextureFile(const char* fname, FileView& outFile, Rendering::TextureCreateInfo& outInfo, AAssetManager* assetManager);
+
+// Loads assets on job system workers. File I/O, parsing and conversion happen in the background,
+// GPU resources are created on the render thread in Update. Until then, getters return the placeholder
+class AssetLoader {
+public:
+	AssetLoader(Rendering::Renderer& renderer, JobSystem& jobSystem, AAssetManager* assetManager);
+	~AssetLoader();
+
+	// Uses the cooked file if it exists, otherwise the named mesh from the glTF file
+	AssetId LoadMesh(const char* cookedFname, const char* path, const char* fname, const char* meshName, Rendering::MeshHandle placeholder);
+	// All meshes of the runtime provided controller model, placed by the node hierarchy. Has no placeholder, instance count is 0 until it's loaded
+	AssetId LoadControllerModel(XR::XRInstance* xrInstance, XR::HandIndex hand);
+	// Uses the cooked file if it exists, otherwise the KTX2 or ASTC file
+	AssetId LoadTexture(const char* name, const char* cookedFname, const char* fname, bool stream, Rendering::TextureHandle placeholder);
+	// Skin of the glTF file with one of its animations, animationName can be null for just the bind pose
+	AssetId LoadSkeleton(const char* path, const char* fname, const char* skinName, const char* animationName);
+	// Assigns the texture to a material sampler as soon as it's loaded
+	void BindTexture(AssetId texture, Rendering::MaterialHandle material, u32 index);
+
+	// Drops the loader's references to the asset's resources, getters return the placeholder again
+	// The renderer keeps them cached until its budget needs the memory. Loads still in flight are discarded
+	void Unload(AssetId id);
+
+	// Creates GPU resources for finished loads, call on the render thread once per frame
+	void Update(u32 maxCommits = maxAssetCommitsPerFrame);
+
+	bool IsReady(AssetId id) const;
+	u32 GetMeshCount(AssetId id) const;
+	Rendering::MeshHandle GetMesh(AssetId id, u32 index = 0) const;
+	// Mesh instances of the model's scene, transforms are relative to the model root
+	u32 GetInstanceCount(AssetId id) const;
+	Rendering::MeshHandle GetInstanceMesh(AssetId id, u32 index) const;
+	const glm::mat4& GetInstanceTransform(AssetId id, u32 index) const;
+	Rendering::TextureHandle GetTexture(AssetId id) const;
+	// Null until loaded
+	const Skeleton* GetSkeleton(AssetId id) const;
+	// Null until loaded or if no animation was requested
+	const AnimationClip* GetAnimationClip(AssetId id) const;
+
+private:
+	enum AssetType {
+		ASSET_MESH,
+		ASSET_CONTROLLER_MODEL,
+		ASSET_TEXTURE,
+		ASSET_SKELETON
+	};
+
+	enum AssetState {
+		ASSET_LOADING,
+		ASSET_READY,
+		ASSET_FAILED,
+		ASSET_UNLOADED
+	};
+
+	struct TextureBinding {
+		Rendering::MaterialHandle material;
+		u32 index;
+	};
+
+	struct Asset {
+		AssetLoader* loader;
+		AssetId id;
+		AssetType type;
+		AssetState state; // Only touched on the render thread
+		bool unloadRequested; // While loading
+
+		// Request
+		char name[maxAssetNameLength];
+		char fname[maxAssetPathLength];
+		char cookedFname[maxAssetPathLength];
+		char path[maxAssetPathLength];
+		char animationName[maxAssetNameLength]; // Empty for none
+		bool stream;
+		ResourceId textureId;
+		XR::XRInstance* xrInstance;
+		XR::HandIndex hand;
+		u64 placeholder;
+
+		// Filled in by the worker
+		bool failed;
+		FileView file;
+		bool cooked; // Mesh data points into the file instead of being allocated
+		u32 meshCount;
+		Rendering::MeshCreateInfo meshInfos[maxAssetMeshCount];
+		ResourceId meshIds[maxAssetMeshCount]; // Hashed here so committing doesn't touch strings
+		u32 instanceCount;
+		u32 instanceMeshes[maxAssetInstanceCount]; // Index into meshInfos and handles
+		glm::mat4 instanceTransforms[maxAssetInstanceCount];
+		Rendering::TextureCreateInfo textureInfo;
+		u8* decodedPixels;
+		Skeleton skeleton; // Kept until unloaded
+		AnimationClip clip;
+		bool hasClip;
+
+		// Reserved by the worker once the data is loaded, then filled in on commit
+		u64 handles[maxAssetMeshCount];
+		u32 bindingCount;
+		TextureBinding bindings[Rendering::maxSamplerCount];
+	};
+
+	Asset* AddAsset(AssetType type, u64 placeholder);
+	static void LoadJob(void* userData);
+	void LoadMeshData(Asset& asset);
+	void LoadControllerData(Asset& asset);
+	void LoadTextureData(Asset& asset);
+	void LoadSkeletonData(Asset& asset);
+	void ReserveHandles(Asset& asset);
+	void CancelHandles(Asset& asset);
+	void Commit(Asset& asset);
+	void ReleaseAssetData(Asset& asset);
+
+	Rendering::Renderer& renderer;
+	JobSystem& jobSystem;
+	AAssetManager* assetManager;
+
+	Asset* assets;
+	u32 assetCount;
+	JobCounter pendingJobs;
+
+	// Ring of finished loads in completion order. Every asset completes once, so it can't overflow
+	std::mutex completedMutex;
+	AssetId completed[maxAssetCount];
+	u32 completedFirst;
+	u32 completedCount;
+};
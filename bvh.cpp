@@ -0,0 +1,397 @@
+#include "bvh.h"
+#include "system.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+// Half the surface area, the constant factor doesn't matter for comparing costs
+static r32 GetHalfArea(const glm::vec3& min, const glm::vec3& max) {
+	const glm::vec3 extent = max - min;
+	return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+static bool IsBoxOutsidePlane(const glm::vec3& min, const glm::vec3& max, const glm::vec4& plane) {
+	// Corner furthest along the plane normal
+	const glm::vec3 corner = glm::vec3(plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z);
+	return glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f;
+}
+
+static bool IsBoxInFrustums(const glm::vec3& min, const glm::vec3& max, const glm::vec4* planes, u32 frustumCount, u32 planesPerFrustum) {
+	for (u32 f = 0; f < frustumCount; f++) {
+		bool inside = true;
+		for (u32 p = 0; p < planesPerFrustum && inside; p++) {
+			inside = !IsBoxOutsidePlane(min, max, planes[f * planesPerFrustum + p]);
+		}
+		if (inside) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool IsSphereInFrustums(const glm::vec4& sphere, const glm::vec4* planes, u32 frustumCount, u32 planesPerFrustum) {
+	for (u32 f = 0; f < frustumCount; f++) {
+		bool inside = true;
+		for (u32 p = 0; p < planesPerFrustum && inside; p++) {
+			const glm::vec4& plane = planes[f * planesPerFrustum + p];
+			inside = glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w >= -sphere.w;
+		}
+		if (inside) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Distance along the ray to where it enters the box, or a negative value if it misses
+static r32 IntersectRayBox(const glm::vec3& origin, const glm::vec3& inverseDirection, r32 maxDistance, const glm::vec3& min, const glm::vec3& max) {
+	const glm::vec3 t0 = (min - origin) * inverseDirection;
+	const glm::vec3 t1 = (max - origin) * inverseDirection;
+	const glm::vec3 tNear = glm::min(t0, t1);
+	const glm::vec3 tFar = glm::max(t0, t1);
+	const r32 enter = MAX(MAX(tNear.x, tNear.y), MAX(tNear.z, 0.0f));
+	const r32 exit = MIN(MIN(tFar.x, tFar.y), MIN(tFar.z, maxDistance));
+	return enter <= exit ? enter : -1.0f;
+}
+
+static r64 GetMicroseconds() {
+	return std::chrono::duration<r64, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+BVH::BVH() {
+	spheres = nullptr;
+	nodes = nullptr;
+	nodeCount = 0;
+	primitives = nullptr;
+	primitiveCount = 0;
+	capacity = 0;
+	lastQueryStats = {};
+}
+
+BVH::~BVH() {
+	free(nodes);
+	free(primitives);
+}
+
+void BVH::Clear() {
+	nodeCount = 0;
+	primitiveCount = 0;
+}
+
+u32 BVH::GetPrimitiveCount() const {
+	return primitiveCount;
+}
+
+void BVH::UpdateNodeBounds(Node& node) const {
+	node.min = glm::vec3(INFINITY);
+	node.max = glm::vec3(-INFINITY);
+	for (u32 i = node.first; i < node.first + node.count; i++) {
+		const glm::vec4& sphere = spheres[primitives[i]];
+		node.min = glm::min(node.min, glm::vec3(sphere) - sphere.w);
+		node.max = glm::max(node.max, glm::vec3(sphere) + sphere.w);
+	}
+}
+
+void BVH::Build(const glm::vec4* sphereData, const u32* primitiveIndices, u32 count) {
+	spheres = sphereData;
+	primitiveCount = count;
+	nodeCount = 0;
+	if (count == 0) {
+		return;
+	}
+
+	if (count > capacity) {
+		capacity = count;
+		free(nodes);
+		free(primitives);
+		nodes = (Node*)malloc(sizeof(Node) * (2 * capacity - 1));
+		primitives = (u32*)malloc(sizeof(u32) * capacity);
+	}
+	memcpy(primitives, primitiveIndices, sizeof(u32) * count);
+
+	Node& root = nodes[nodeCount++];
+	root.first = 0;
+	root.count = count;
+	UpdateNodeBounds(root);
+	Subdivide(0, 0);
+}
+
+// Sphere centers are the centroids. Splits at the bin boundary with the lowest SAH cost, or stays a leaf if splitting doesn't pay off
+void BVH::Subdivide(u32 nodeIndex, u32 depth) {
+	Node& node = nodes[nodeIndex];
+	if (node.count <= bvhMaxLeafSize || depth + 2 >= bvhMaxDepth) {
+		return;
+	}
+
+	glm::vec3 centroidMin = glm::vec3(INFINITY);
+	glm::vec3 centroidMax = glm::vec3(-INFINITY);
+	for (u32 i = node.first; i < node.first + node.count; i++) {
+		const glm::vec3 center = glm::vec3(spheres[primitives[i]]);
+		centroidMin = glm::min(centroidMin, center);
+		centroidMax = glm::max(centroidMax, center);
+	}
+
+	struct Bin {
+		glm::vec3 min;
+		glm::vec3 max;
+		u32 count;
+	};
+
+	r32 bestCost = INFINITY;
+	u32 bestAxis = 0;
+	u32 bestSplit = 0;
+	for (u32 axis = 0; axis < 3; axis++) {
+		const r32 extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f) {
+			continue;
+		}
+
+		Bin bins[bvhBinCount];
+		for (u32 b = 0; b < bvhBinCount; b++) {
+			bins[b] = { glm::vec3(INFINITY), glm::vec3(-INFINITY), 0 };
+		}
+		const r32 scale = bvhBinCount / extent;
+		for (u32 i = node.first; i < node.first + node.count; i++) {
+			const glm::vec4& sphere = spheres[primitives[i]];
+			const u32 b = MIN((u32)((sphere[axis] - centroidMin[axis]) * scale), bvhBinCount - 1);
+			bins[b].min = glm::min(bins[b].min, glm::vec3(sphere) - sphere.w);
+			bins[b].max = glm::max(bins[b].max, glm::vec3(sphere) + sphere.w);
+			bins[b].count++;
+		}
+
+		// Sweep from both sides to get the cost of every split in two passes
+		r32 leftAreas[bvhBinCount - 1];
+		u32 leftCounts[bvhBinCount - 1];
+		glm::vec3 min = glm::vec3(INFINITY);
+		glm::vec3 max = glm::vec3(-INFINITY);
+		u32 sum = 0;
+		for (u32 b = 0; b < bvhBinCount - 1; b++) {
+			sum += bins[b].count;
+			min = glm::min(min, bins[b].min);
+			max = glm::max(max, bins[b].max);
+			leftCounts[b] = sum;
+			leftAreas[b] = sum > 0 ? GetHalfArea(min, max) : 0.0f;
+		}
+		min = glm::vec3(INFINITY);
+		max = glm::vec3(-INFINITY);
+		sum = 0;
+		for (u32 b = bvhBinCount - 1; b > 0; b--) {
+			sum += bins[b].count;
+			min = glm::min(min, bins[b].min);
+			max = glm::max(max, bins[b].max);
+			const r32 rightArea = sum > 0 ? GetHalfArea(min, max) : 0.0f;
+			const r32 cost = leftCounts[b - 1] * leftAreas[b - 1] + sum * rightArea;
+			if (cost < bestCost && leftCounts[b - 1] > 0 && sum > 0) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	const r32 leafCost = node.count * GetHalfArea(node.min, node.max);
+	if (bestCost >= leafCost) {
+		return;
+	}
+
+	// Partition in place, primitives left of the split go first
+	const r32 scale = bvhBinCount / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+	u32 i = node.first;
+	u32 j = node.first + node.count - 1;
+	while (i <= j) {
+		const u32 b = MIN((u32)((spheres[primitives[i]][bestAxis] - centroidMin[bestAxis]) * scale), bvhBinCount - 1);
+		if (b < bestSplit) {
+			i++;
+		}
+		else {
+			const u32 swap = primitives[i];
+			primitives[i] = primitives[j];
+			primitives[j] = swap;
+			j--;
+		}
+	}
+
+	const u32 leftCount = i - node.first;
+	const u32 leftIndex = nodeCount;
+	nodeCount += 2;
+	nodes[leftIndex].first = node.first;
+	nodes[leftIndex].count = leftCount;
+	nodes[leftIndex + 1].first = i;
+	nodes[leftIndex + 1].count = node.count - leftCount;
+	node.first = leftIndex;
+	node.count = 0;
+
+	UpdateNodeBounds(nodes[leftIndex]);
+	UpdateNodeBounds(nodes[leftIndex + 1]);
+	Subdivide(leftIndex, depth + 1);
+	Subdivide(leftIndex + 1, depth + 1);
+}
+
+// Children always come after their parent, so one backwards pass sees them first
+void BVH::Refit() {
+	for (s32 i = (s32)nodeCount - 1; i >= 0; i--) {
+		Node& node = nodes[i];
+		if (node.count > 0) {
+			UpdateNodeBounds(node);
+		}
+		else {
+			const Node& left = nodes[node.first];
+			const Node& right = nodes[node.first + 1];
+			node.min = glm::min(left.min, right.min);
+			node.max = glm::max(left.max, right.max);
+		}
+	}
+}
+
+u32 BVH::QueryFrustums(const glm::vec4* planes, u32 frustumCount, u32 planesPerFrustum, u32* outPrimitives, u32 maxResults, const u8* mask) const {
+	const r64 startTime = GetMicroseconds();
+	lastQueryStats = {};
+
+	u32 resultCount = 0;
+	u32 stack[bvhMaxDepth];
+	u32 stackSize = 0;
+	if (nodeCount > 0) {
+		stack[stackSize++] = 0;
+	}
+	while (stackSize > 0 && resultCount < maxResults) {
+		const Node& node = nodes[stack[--stackSize]];
+		lastQueryStats.nodesVisited++;
+		if (!IsBoxInFrustums(node.min, node.max, planes, frustumCount, planesPerFrustum)) {
+			continue;
+		}
+
+		if (node.count == 0) {
+			stack[stackSize++] = node.first + 1;
+			stack[stackSize++] = node.first;
+			continue;
+		}
+
+		for (u32 i = node.first; i < node.first + node.count && resultCount < maxResults; i++) {
+			if (mask != nullptr && mask[primitives[i]] == 0) {
+				continue;
+			}
+			lastQueryStats.primitivesTested++;
+			if (IsSphereInFrustums(spheres[primitives[i]], planes, frustumCount, planesPerFrustum)) {
+				outPrimitives[resultCount++] = primitives[i];
+			}
+		}
+	}
+
+	lastQueryStats.results = resultCount;
+	lastQueryStats.microseconds = (r32)(GetMicroseconds() - startTime);
+	return resultCount;
+}
+
+bool BVH::Raycast(const glm::vec3& origin, const glm::vec3& direction, r32 maxDistance, BVHRayHit& outHit, const u8* mask) const {
+	const r64 startTime = GetMicroseconds();
+	lastQueryStats = {};
+
+	// Division by zero gives infinities, which the slab test handles
+	const glm::vec3 inverseDirection = 1.0f / direction;
+	r32 closest = maxDistance;
+	bool hit = false;
+
+	u32 stack[bvhMaxDepth];
+	u32 stackSize = 0;
+	if (nodeCount > 0 && IntersectRayBox(origin, inverseDirection, closest, nodes[0].min, nodes[0].max) >= 0.0f) {
+		stack[stackSize++] = 0;
+	}
+	while (stackSize > 0) {
+		const Node& node = nodes[stack[--stackSize]];
+		lastQueryStats.nodesVisited++;
+
+		if (node.count == 0) {
+			// Nearer child goes on top, so hits there can prune the other one
+			const u32 left = node.first;
+			const u32 right = node.first + 1;
+			const r32 leftDistance = IntersectRayBox(origin, inverseDirection, closest, nodes[left].min, nodes[left].max);
+			const r32 rightDistance = IntersectRayBox(origin, inverseDirection, closest, nodes[right].min, nodes[right].max);
+			if (leftDistance >= 0.0f && rightDistance >= 0.0f) {
+				stack[stackSize++] = leftDistance < rightDistance ? right : left;
+				stack[stackSize++] = leftDistance < rightDistance ? left : right;
+			}
+			else if (leftDistance >= 0.0f) {
+				stack[stackSize++] = left;
+			}
+			else if (rightDistance >= 0.0f) {
+				stack[stackSize++] = right;
+			}
+			continue;
+		}
+
+		for (u32 i = node.first; i < node.first + node.count; i++) {
+			if (mask != nullptr && mask[primitives[i]] == 0) {
+				continue;
+			}
+			lastQueryStats.primitivesTested++;
+			const glm::vec4& sphere = spheres[primitives[i]];
+			const glm::vec3 toCenter = glm::vec3(sphere) - origin;
+			const r32 along = glm::dot(toCenter, direction);
+			const r32 distanceSquared = glm::dot(toCenter, toCenter) - along * along;
+			if (distanceSquared > sphere.w * sphere.w) {
+				continue;
+			}
+
+			// From inside a sphere, the hit is where the ray leaves it
+			const r32 halfChord = sqrtf(sphere.w * sphere.w - distanceSquared);
+			const r32 distance = along - halfChord >= 0.0f ? along - halfChord : along + halfChord;
+			if (distance >= 0.0f && distance < closest) {
+				closest = distance;
+				outHit = { primitives[i], distance };
+				hit = true;
+			}
+		}
+	}
+
+	lastQueryStats.results = hit ? 1 : 0;
+	lastQueryStats.microseconds = (r32)(GetMicroseconds() - startTime);
+	return hit;
+}
+
+u32 BVH::QuerySphere(const glm::vec3& center, r32 radius, u32* outPrimitives, u32 maxResults, const u8* mask) const {
+	const r64 startTime = GetMicroseconds();
+	lastQueryStats = {};
+
+	u32 resultCount = 0;
+	u32 stack[bvhMaxDepth];
+	u32 stackSize = 0;
+	if (nodeCount > 0) {
+		stack[stackSize++] = 0;
+	}
+	while (stackSize > 0 && resultCount < maxResults) {
+		const Node& node = nodes[stack[--stackSize]];
+		lastQueryStats.nodesVisited++;
+		const glm::vec3 closestPoint = glm::clamp(center, node.min, node.max);
+		const glm::vec3 offset = closestPoint - center;
+		if (glm::dot(offset, offset) > radius * radius) {
+			continue;
+		}
+
+		if (node.count == 0) {
+			stack[stackSize++] = node.first + 1;
+			stack[stackSize++] = node.first;
+			continue;
+		}
+
+		for (u32 i = node.first; i < node.first + node.count && resultCount < maxResults; i++) {
+			if (mask != nullptr && mask[primitives[i]] == 0) {
+				continue;
+			}
+			lastQueryStats.primitivesTested++;
+			const glm::vec4& sphere = spheres[primitives[i]];
+			const glm::vec3 toCenter = glm::vec3(sphere) - center;
+			const r32 reach = sphere.w + radius;
+			if (glm::dot(toCenter, toCenter) <= reach * reach) {
+				outPrimitives[resultCount++] = primitives[i];
+			}
+		}
+	}
+
+	lastQueryStats.results = resultCount;
+	lastQueryStats.microseconds = (r32)(GetMicroseconds() - startTime);
+	return resultCount;
+}
+
+const BVHQueryStats& BVH::GetLastQueryStats() const {
+	return lastQueryStats;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "typedef.h"
+#include "math.h"
+
+constexpr u32 bvhMaxLeafSize = 4; // Primitives per leaf
+constexpr u32 bvhBinCount = 12; // Split candidates per axis in the SAH build
+constexpr u32 bvhMaxDepth = 64; // Traversal stack size
+
+// Counters of the most recent query, for profiling
+struct BVHQueryStats {
+	u32 nodesVisited;
+	u32 primitivesTested;
+	u32 results;
+	r32 microseconds;
+};
+
+struct BVHRayHit {
+	u32 primitive;
+	r32 distance;
+};
+
+// Bounding volume hierarchy over bounding spheres, stored as xyz = center, w = radius
+// Primitives are identified by their index in the sphere array. Built top down with a binned SAH,
+// moving primitives are handled by refitting the node bounds without changing the tree
+class BVH {
+public:
+	BVH();
+	~BVH();
+
+	// primitives lists the sphere indices to include. Spheres have to stay valid for Refit and the queries
+	void Build(const glm::vec4* spheres, const u32* primitives, u32 primitiveCount);
+	// Recomputes node bounds bottom up after the spheres moved. Quality drops if they move far, rebuild then
+	void Refit();
+	void Clear();
+	u32 GetPrimitiveCount() const;
+
+	// Queries skip primitives whose entry in mask is 0, if a mask is given
+	// Primitives whose bounds intersect any of the frustums, each made of planesPerFrustum planes pointing in
+	// Returns the number written to outPrimitives, at most maxResults
+	u32 QueryFrustums(const glm::vec4* planes, u32 frustumCount, u32 planesPerFrustum, u32* outPrimitives, u32 maxResults, const u8* mask = nullptr) const;
+	// Closest sphere hit along the ray, direction must be normalized
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, r32 maxDistance, BVHRayHit& outHit, const u8* mask = nullptr) const;
+	// Primitives whose spheres overlap the sphere
+	u32 QuerySphere(const glm::vec3& center, r32 radius, u32* outPrimitives, u32 maxResults, const u8* mask = nullptr) const;
+
+	const BVHQueryStats& GetLastQueryStats() const;
+
+private:
+	struct Node {
+		glm::vec3 min;
+		u32 first; // Left child for inner nodes, the right one is next to it. First primitive for leaves
+		glm::vec3 max;
+		u32 count; // Primitives in a leaf, 0 for inner nodes
+	};
+
+	void Subdivide(u32 nodeIndex, u32 depth);
+	void UpdateNodeBounds(Node& node) const;
+
+	const glm::vec4* spheres;
+	Node* nodes;
+	u32 nodeCount;
+	u32* primitives;
+	u32 primitiveCount;
+	u32 capacity; // Primitives the arrays have room for
+
+	mutable BVHQueryStats lastQueryStats;
+};
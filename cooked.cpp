@@ -0,0 +1,112 @@
+#include "cooked.h"
+#include "system.h"
+
+static bool IsValidCookedBlock(const u8* const buffer, u64 size, u64 offset, u64 blockSize) {
+	if (offset == 0) {
+		return true;
+	}
+
+	return offset % cookedAssetAlignment == 0 && offset + blockSize <= size;
+}
+
+template <typename T>
+static bool GetCookedStream(const u8* const buffer, u64 size, u64 offset, u32 count, T** outStream) {
+	if (!IsValidCookedBlock(buffer, size, offset, sizeof(T) * (u64)count)) {
+		return false;
+	}
+
+	*outStream = offset == 0 ? nullptr : (T*)(buffer + offset);
+	return true;
+}
+
+bool GetCookedMeshInfo(const u8* const buffer, u64 size, Rendering::MeshCreateInfo& outInfo) {
+	if (buffer == nullptr || size < sizeof(CookedMeshHeader)) {
+		return false;
+	}
+
+	const CookedMeshHeader* header = (const CookedMeshHeader*)buffer;
+	if (header->magic != cookedMeshMagic) {
+		DEBUG_LOG("Not a cooked mesh");
+		return false;
+	}
+	if (header->version != cookedAssetVersion) {
+		DEBUG_LOG("Cooked mesh version %d doesn't match %d, recook assets", header->version, cookedAssetVersion);
+		return false;
+	}
+
+	if (header->vertexFormat >= Rendering::VERTEX_FORMAT_COUNT) {
+		DEBUG_LOG("Cooked mesh has unknown vertex format %d", header->vertexFormat);
+		return false;
+	}
+
+	outInfo.vertexCount = header->vertexCount;
+	outInfo.triangleCount = header->triangleCount;
+	outInfo.submeshCount = header->submeshCount;
+	outInfo.meshletCount = header->meshletCount;
+	outInfo.vertexFormat = (Rendering::VertexFormat)header->vertexFormat;
+
+	// Quantized streams go to the GPU as they are
+	bool streamsValid = true;
+	if (outInfo.vertexFormat == Rendering::VERTEX_FORMAT_QUANTIZED) {
+		const u64 offsets[Rendering::vertexStreamCount] = { header->positionOffset, header->texcoord0Offset, header->normalOffset, header->tangentOffset, header->colorOffset, header->jointsOffset, header->weightsOffset };
+		for (u32 i = 0; i < Rendering::vertexStreamCount && streamsValid; i++) {
+			streamsValid = IsValidCookedBlock(buffer, size, offsets[i], (u64)Rendering::vertexStreamStrides[i][Rendering::VERTEX_FORMAT_QUANTIZED] * header->vertexCount);
+			outInfo.encodedStreams[i] = offsets[i] == 0 ? nullptr : buffer + offsets[i];
+		}
+		outInfo.encodedQuantization = header->quantization;
+	}
+	else {
+		streamsValid = GetCookedStream(buffer, size, header->positionOffset, header->vertexCount, &outInfo.position) &&
+			GetCookedStream(buffer, size, header->texcoord0Offset, header->vertexCount, &outInfo.texcoord0) &&
+			GetCookedStream(buffer, size, header->normalOffset, header->vertexCount, &outInfo.normal) &&
+			GetCookedStream(buffer, size, header->tangentOffset, header->vertexCount, &outInfo.tangent) &&
+			GetCookedStream(buffer, size, header->colorOffset, header->vertexCount, &outInfo.color) &&
+			GetCookedStream(buffer, size, header->jointsOffset, header->vertexCount, &outInfo.joints) &&
+			GetCookedStream(buffer, size, header->weightsOffset, header->vertexCount, &outInfo.weights);
+	}
+
+	if (!streamsValid ||
+		(header->indexSize == sizeof(u16) && !GetCookedStream(buffer, size, header->trianglesOffset, header->triangleCount, &outInfo.triangles16)) ||
+		(header->indexSize == sizeof(u32) && !GetCookedStream(buffer, size, header->trianglesOffset, header->triangleCount, &outInfo.triangles)) ||
+		!GetCookedStream(buffer, size, header->submeshesOffset, header->submeshCount, &outInfo.submeshes) ||
+		!GetCookedStream(buffer, size, header->meshletsOffset, header->meshletCount, &outInfo.meshlets)) {
+		DEBUG_LOG("Cooked mesh is corrupted");
+		return false;
+	}
+
+	return outInfo.triangles != nullptr || outInfo.triangles16 != nullptr;
+}
+
+bool GetCookedTextureInfo(const u8* const buffer, u64 size, Rendering::TextureCreateInfo& outInfo) {
+	if (buffer == nullptr || size < sizeof(CookedTextureHeader)) {
+		return false;
+	}
+
+	const CookedTextureHeader* header = (const CookedTextureHeader*)buffer;
+	if (header->magic != cookedTextureMagic) {
+		DEBUG_LOG("Not a cooked texture");
+		return false;
+	}
+	if (header->version != cookedAssetVersion) {
+		DEBUG_LOG("Cooked texture version %d doesn't match %d, recook assets", header->version, cookedAssetVersion);
+		return false;
+	}
+	if (header->dataOffset == 0 || !IsValidCookedBlock(buffer, size, header->dataOffset, header->dataSize)) {
+		DEBUG_LOG("Cooked texture is corrupted");
+		return false;
+	}
+
+	outInfo.width = header->width;
+	outInfo.height = header->height;
+	outInfo.mipCount = header->mipCount;
+	outInfo.layerCount = header->layerCount;
+	outInfo.type = (Rendering::TextureType)header->type;
+	outInfo.space = (Rendering::ColorSpace)header->space;
+	outInfo.compression = (Rendering::TextureCompression)header->compression;
+	outInfo.generateMips = false;
+	outInfo.pixels = (u8*)(buffer + header->dataOffset);
+	outInfo.readLevel = nullptr;
+	outInfo.readLevelUserData = nullptr;
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+#include "typedef.h"
+#include "rendering.h"
+
+// Engine native asset blobs produced by the asset cooker (tools/asset_cooker)
+// Everything is little endian and laid out exactly like the runtime wants it, so loading is just a header check
+
+constexpr u32 cookedMeshMagic = 0x48534D4E; // "NMSH"
+constexpr u32 cookedTextureMagic = 0x5845544E; // "NTEX"
+constexpr u32 cookedAssetVersion = 7;
+constexpr u32 cookedAssetAlignment = 16; // Alignment of every data block from the start of the file
+
+struct CookedMeshHeader {
+	u32 magic;
+	u32 version;
+	u32 vertexCount;
+	u32 triangleCount;
+	u32 submeshCount; // 0 if the whole mesh is drawn with one material
+	u32 indexSize; // 2 or 4
+	u32 meshletCount; // 0 if the mesh isn't culled per cluster
+	u32 vertexFormat; // Rendering::VertexFormat the streams are encoded in
+
+	// Offsets from the start of the file, 0 if the stream doesn't exist
+	// Streams match the vertex input bindings of Vulkan::CreateShaderRenderPipeline, the element sizes are in Rendering::vertexStreamStrides
+	u64 positionOffset; // glm::vec3, or snorm16 x4 mapped to the bounds by quantization
+	u64 texcoord0Offset; // glm::vec2, or half x2
+	u64 normalOffset; // glm::vec3, or octahedral snorm16 x2
+	u64 tangentOffset; // glm::vec4, or octahedral snorm16 x2 with the bitangent sign in y
+	u64 colorOffset; // Rendering::Color, or unorm8 x4
+	u64 jointsOffset; // Rendering::VertexJoints
+	u64 weightsOffset; // glm::vec4, or unorm16 x4
+	u64 trianglesOffset; // Rendering::Triangle16 or Rendering::Triangle depending on indexSize
+	u64 submeshesOffset; // Rendering::Submesh
+	u64 meshletsOffset; // Rendering::Meshlet
+
+	Rendering::VertexQuantizationData quantization; // Identity for float streams
+};
+
+struct CookedTextureHeader {
+	u32 magic;
+	u32 version;
+	u32 width;
+	u32 height;
+	u32 mipCount;
+	u32 layerCount;
+	u32 type; // Rendering::TextureType
+	u32 space; // Rendering::ColorSpace
+	u32 compression; // Rendering::TextureCompression
+
+	u32 reserved;
+	u64 dataOffset; // Mip chain, largest first, tightly packed
+	u64 dataSize;
+};
+
+// The returned info points into buffer, so it has to stay alive until the resource is created
+bool GetCookedMeshInfo(const u8* const buffer, u64 size, Rendering::MeshCreateInfo& outInfo);
+bool GetCookedTextureInfo(const u8* const buffer, u64 size, Rendering::TextureCreateInfo& outInfo);
@@ -0,0 +1,61 @@
+#include "frame_arena.h"
+#include "system.h"
+#include <cstdlib>
+
+FrameArena::FrameArena(u64 blockSize, u32 frameCount) {
+	this->blockSize = blockSize;
+	this->frameCount = frameCount;
+	frameIndex = 0;
+	offset = 0;
+	peakUsed = 0;
+
+	memory = (u8*)malloc(blockSize * frameCount);
+	if (memory == nullptr) {
+		DEBUG_ERROR("Failed to allocate frame arena");
+	}
+}
+
+FrameArena::~FrameArena() {
+	free(memory);
+}
+
+void FrameArena::BeginFrame() {
+	frameIndex = (frameIndex + 1) % frameCount;
+	offset = 0;
+}
+
+void* FrameArena::Allocate(u64 size, u64 alignment) {
+	u8* block = memory + blockSize * frameIndex;
+	// Align the address, not just the offset, malloc only guarantees the fundamental alignment
+	const u64 address = (u64)(block + offset);
+	const u64 aligned = (address + alignment - 1) & ~(alignment - 1);
+	const u64 newOffset = aligned - (u64)block + size;
+	if (newOffset > blockSize) {
+		DEBUG_LOG("Frame arena full, can't allocate %llu bytes (%llu of %llu used)", (unsigned long long)size, (unsigned long long)offset, (unsigned long long)blockSize);
+		return nullptr;
+	}
+
+	offset = newOffset;
+	if (offset > peakUsed) {
+		peakUsed = offset;
+	}
+	return (void*)aligned;
+}
+
+u64 FrameArena::GetMarker() const {
+	return offset;
+}
+
+void FrameArena::ResetToMarker(u64 marker) {
+	if (marker <= offset) {
+		offset = marker;
+	}
+}
+
+u64 FrameArena::GetUsed() const {
+	return offset;
+}
+
+u64 FrameArena::GetPeakUsed() const {
+	return peakUsed;
+}
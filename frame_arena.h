@@ -0,0 +1,49 @@
+#pragma once
+#include "typedef.h"
+
+// Bump allocator for data that only lives for one frame, with a separate block per frame in flight
+// Everything allocated during a frame is dropped at once when that frame's block comes around again
+// Not thread safe, meant for the thread that builds the frame
+class FrameArena {
+public:
+	FrameArena(u64 blockSize, u32 frameCount);
+	~FrameArena();
+
+	// Switches to the next frame's block and empties it
+	void BeginFrame();
+	// Returns null if the block is full. alignment must be a power of two
+	void* Allocate(u64 size, u64 alignment = 16);
+	// Uninitialized, objects aren't constructed or destroyed
+	template <typename T>
+	T* AllocateArray(u64 count) {
+		return (T*)Allocate(sizeof(T) * count, alignof(T) > 16 ? alignof(T) : 16);
+	}
+
+	// Everything allocated after the marker can be released early with ResetToMarker
+	u64 GetMarker() const;
+	void ResetToMarker(u64 marker);
+	u64 GetUsed() const;
+	u64 GetPeakUsed() const; // Highest use of any frame so far, for sizing the blocks
+
+	// Releases the allocations made during its lifetime
+	class Scope {
+	public:
+		Scope(FrameArena& arena) : arena(arena), marker(arena.GetMarker()) {}
+		~Scope() {
+			arena.ResetToMarker(marker);
+		}
+		Scope(const Scope& other) = delete;
+		Scope& operator=(const Scope& other) = delete;
+	private:
+		FrameArena& arena;
+		u64 marker;
+	};
+
+private:
+	u8* memory;
+	u64 blockSize;
+	u32 frameCount;
+	u32 frameIndex;
+	u64 offset; // In the current block
+	u64 peakUsed;
+};
@@ -42,7 +42,7 @@ function(glsl_spv_shader)
         ENTRY_POINT
         TARGET_ENV
     )
-    set(multiValueArgs EXTRA_DEPENDS)
+    set(multiValueArgs EXTRA_DEPENDS DEFINES)
     cmake_parse_arguments(
         _glsl_spv
         "${options}"
@@ -50,6 +50,7 @@ function(glsl_spv_shader)
         "${multiValueArgs}"
         ${ARGN}
     )
+    list(TRANSFORM _glsl_spv_DEFINES PREPEND "-D" OUTPUT_VARIABLE _glsl_spv_define_flags)
 
     if(GLSL_COMPILER)
         add_custom_command(
@@ -62,6 +63,7 @@ function(glsl_spv_shader)
                 $<IF:$<OR:$<CONFIG:Debug>,$<CONFIG:RelWithDebInfo>>,-g,>
                 $<IF:$<CONFIG:Debug>,-O0,-O>
                 "--target-env=${_glsl_spv_TARGET_ENV}"
+                ${_glsl_spv_define_flags}
                 "${_glsl_spv_INPUT}"
             MAIN_DEPENDENCY "${_glsl_spv_INPUT}"
             DEPENDS "${_glsl_spv_INPUT}" ${_glsl_spv_EXTRA_DEPENDS}
@@ -79,6 +81,7 @@ function(glsl_spv_shader)
                 $<$<CONFIG:Debug>:-Od>
                 $<$<CONFIG:Release>:-g0>
                 "--target-env" "${_glsl_spv_TARGET_ENV}"
+                ${_glsl_spv_define_flags}
                 -V 
                 "${_glsl_spv_INPUT}"
             MAIN_DEPENDENCY "${_glsl_spv_INPUT}"
@@ -1,86 +1,103 @@
 #define CGLTF_IMPLEMENTATION
 #include "gltf.h"
 #include "system.h"
+#include "vertex_decode.h"
+#include "mesh_optimize.h"
 #include <algorithm>
+#include <cmath>
+#include <vector>
 
-size_t ProcessVertexBuffer(cgltf_accessor* accessor, u8** pOutBuffer, size_t outElementSize) {
-	cgltf_buffer_view* bufView = accessor->buffer_view;
-	cgltf_buffer* buffer = bufView->buffer;
-
-	size_t componentCount = 0;
-	switch (accessor->type) {
-		case cgltf_type_vec2:
-			componentCount = 2;
-			break;
-		case cgltf_type_vec3:
-			componentCount = 3;
-			break;
-		case cgltf_type_vec4:
-			componentCount = 4;
-			break;
-		case cgltf_type_mat2:
-			componentCount = 4;
-			break;
-		case cgltf_type_mat3:
-			componentCount = 9;
-			break;
-		case cgltf_type_mat4:
-			componentCount = 16;
-			break;
-		case cgltf_type_scalar:
-			componentCount = 1;
-			break;
-		default:
-			DEBUG_ERROR("Unknown accessor type %d", accessor->type);
-			break;
+static bool GetVertexStreamDesc(const cgltf_accessor* accessor, VertexStreamDesc& outDesc) {
+	if (accessor->buffer_view == nullptr || accessor->buffer_view->buffer->data == nullptr) {
+		DEBUG_LOG("Accessor has no buffer data (sparse accessors are not supported)");
+		return false;
 	}
 
-	size_t componentSize = 0;
 	switch (accessor->component_type) {
 		case cgltf_component_type_r_8:
-			componentSize = sizeof(s8);
+			outDesc.componentType = VERTEX_COMPONENT_S8;
 			break;
 		case cgltf_component_type_r_8u:
-			componentSize = sizeof(u8);
+			outDesc.componentType = VERTEX_COMPONENT_U8;
 			break;
 		case cgltf_component_type_r_16:
-			componentSize = sizeof(s16);
+			outDesc.componentType = VERTEX_COMPONENT_S16;
 			break;
 		case cgltf_component_type_r_16u:
-			componentSize = sizeof(u16);
+			outDesc.componentType = VERTEX_COMPONENT_U16;
 			break;
 		case cgltf_component_type_r_32u:
-			componentSize = sizeof(u32);
+			outDesc.componentType = VERTEX_COMPONENT_U32;
 			break;
 		case cgltf_component_type_r_32f:
-			componentSize = sizeof(r32);
+			outDesc.componentType = VERTEX_COMPONENT_FLOAT;
 			break;
 		default:
 			DEBUG_ERROR("Unknown accessor component type %d", accessor->component_type);
 			break;
 	}
 
-	size_t elementSize = componentCount * componentSize;
-	*pOutBuffer = (u8*)calloc(accessor->count, outElementSize);
+	const cgltf_buffer_view* bufView = accessor->buffer_view;
+	outDesc.data = (const u8*)bufView->buffer->data + bufView->offset + accessor->offset;
+	outDesc.stride = accessor->stride;
+	outDesc.componentCount = cgltf_num_components(accessor->type);
+	outDesc.normalized = accessor->normalized;
+	return true;
+}
 
-	size_t srcStride = bufView->stride == 0 ? elementSize : bufView->stride;
-	size_t copySize = std::min(elementSize, outElementSize);
-	if (elementSize > outElementSize) {
-		DEBUG_LOG("Out element size %d is smaller than %d, clamping will occur", outElementSize, elementSize);
+// Converts the accessor elements to tightly packed floats in pOut
+size_t ProcessVertexBuffer(const cgltf_accessor* accessor, r32* pOut, u32 outComponentCount, JobSystem* jobSystem) {
+	VertexStreamDesc desc;
+	if (!GetVertexStreamDesc(accessor, desc)) {
+		return 0;
 	}
 
-	const u8* pSrc = (u8*)buffer->data + bufView->offset + accessor->offset;
-	for (int i = 0; i < accessor->count; i++) {
-		int dstOffset = outElementSize * i;
-		int srcOffset = srcStride * i;
-		memcpy(*pOutBuffer + dstOffset, pSrc + srcOffset, copySize);
+	if (desc.componentCount > outComponentCount) {
+		DEBUG_LOG("Out component count %d is smaller than %d, clamping will occur", outComponentCount, desc.componentCount);
 	}
 
+	DecodeVertexStream(desc, pOut, outComponentCount, accessor->count, jobSystem);
 	return accessor->count;
 }
 
+// Widens the indices to u32
+size_t ProcessIndexBuffer(const cgltf_accessor* accessor, u32* pOut, JobSystem* jobSystem) {
+	VertexStreamDesc desc;
+	if (!GetVertexStreamDesc(accessor, desc)) {
+		return 0;
+	}
+
+	DecodeIndexStream(desc.data, GetVertexComponentSize(desc.componentType), pOut, accessor->count, jobSystem);
+	return accessor->count;
+}
+
+// u16 indices are copied as is, u8 indices are widened
+size_t ProcessIndexBuffer(const cgltf_accessor* accessor, u16* pOut, JobSystem* jobSystem) {
+	VertexStreamDesc desc;
+	if (!GetVertexStreamDesc(accessor, desc)) {
+		return 0;
+	}
+
+	DecodeIndexStream(desc.data, GetVertexComponentSize(desc.componentType), pOut, accessor->count, jobSystem);
+	return accessor->count;
+}
+
+// Joint indices are integers, they go through the float kernels (exact for any u16) and get narrowed back
+size_t ProcessJointBuffer(const cgltf_accessor* accessor, Rendering::VertexJoints* pOut, JobSystem* jobSystem) {
+	r32* decoded = (r32*)malloc(sizeof(r32) * 4 * accessor->count);
+	const size_t count = ProcessVertexBuffer(accessor, decoded, 4, jobSystem);
+	for (size_t i = 0; i < count; i++) {
+		for (u32 c = 0; c < 4; c++) {
+			pOut[i].index[c] = (u16)decoded[i * 4 + c];
+		}
+	}
+	free(decoded);
+	return count;
+}
+
 // TODO: Validate that element size matches source...
-void ProcessVertexAttributeData(Rendering::MeshCreateInfo& meshInfo, cgltf_attribute* attr) {
+// Streams are allocated for the whole mesh the first time a primitive has the attribute, so primitives without it get zeroes
+void ProcessVertexAttributeData(Rendering::MeshCreateInfo& meshInfo, cgltf_attribute* attr, u32 vertexOffset, JobSystem* jobSystem) {
 	u8** pOutBuffer = nullptr;
 	size_t outElementSize = 0;
 
@@ -104,63 +121,99 @@ void ProcessVertexAttributeData(Rendering::MeshCreateInfo& meshInfo, cgltf_attri
 		outElementSize = sizeof(Rendering::Color);
 		pOutBuffer = (u8**)&meshInfo.color;
 	}
+	else if (attr->type == cgltf_attribute_type_joints && attr->index == 0) {
+		if (meshInfo.joints == nullptr) {
+			meshInfo.joints = (Rendering::VertexJoints*)calloc(meshInfo.vertexCount, sizeof(Rendering::VertexJoints));
+		}
+		ProcessJointBuffer(attr->data, meshInfo.joints + vertexOffset, jobSystem);
+		return;
+	}
+	else if (attr->type == cgltf_attribute_type_weights && attr->index == 0) {
+		outElementSize = sizeof(glm::vec4);
+		pOutBuffer = (u8**)&meshInfo.weights;
+	}
 	else {
 		DEBUG_LOG("Unsupported buffer \"%d\", ignoring!", attr->type);
 		return;
 	}
 
-	meshInfo.vertexCount = ProcessVertexBuffer(attr->data, pOutBuffer, outElementSize);
+	if (*pOutBuffer == nullptr) {
+		*pOutBuffer = (u8*)calloc(meshInfo.vertexCount, outElementSize);
+	}
+
+	ProcessVertexBuffer(attr->data, (r32*)(*pOutBuffer + outElementSize * vertexOffset), outElementSize / sizeof(r32), jobSystem);
 }
 
-bool LoadGLTF(const u8* const buf, u32 bufferSize, cgltf_data** outData, AAssetManager *assetManager) {
+bool LoadGLTF(const u8* const buf, u32 bufferSize, GLTFData& outData, AAssetManager *assetManager) {
+	outData.data = nullptr;
+	outData.files.clear();
+
 	cgltf_options options{};
-	cgltf_result result = cgltf_parse(&options, buf, bufferSize, outData);
+	cgltf_result result = cgltf_parse(&options, buf, bufferSize, &outData.data);
 	if (result != cgltf_result_success) {
 		DEBUG_LOG("Failed to load gltf :c");
+		outData.data = nullptr;
 		return false;
 	}
 
-	if ((*outData)->file_type == cgltf_file_type_glb) {
-		cgltf_load_buffers(&options, *outData, nullptr);
+	if (outData.data->file_type == cgltf_file_type_glb) {
+		cgltf_load_buffers(&options, outData.data, nullptr);
 	}
 
 	return true;
 }
 
-bool LoadGLTF(const char* path, const char* fname, cgltf_data** outData, AAssetManager *assetManager) {
+bool LoadGLTF(const char* path, const char* fname, GLTFData& outData, AAssetManager *assetManager) {
 	char filePath[1024];
 	sprintf(filePath, "%s/%s", path, fname);
 
-	u32 fileSize;
-	u8* buf = (u8*)AllocFileBytes(filePath, fileSize, assetManager);
+	FileView view;
+	if (!OpenFileView(filePath, view, assetManager)) {
+		DEBUG_LOG("File %s not found", filePath);
+		return false;
+	}
 
-	if (!LoadGLTF(buf, fileSize, outData, assetManager)) {
+	if (!LoadGLTF(view.data, view.size, outData, assetManager)) {
+		CloseFileView(view);
 		return false;
 	}
 
-	free(buf);
+	// GLB binary chunk is used in place, so the file has to stay around
+	outData.files.push_back(view);
 
 	// Load buffers
-	if ((*outData)->file_type == cgltf_file_type_gltf) {
-		for (int i = 0; i < (*outData)->buffers_count; i++) {
-			cgltf_buffer &gltfBuffer = (*outData)->buffers[i];
-			u32 bufferSize;
+	if (outData.data->file_type == cgltf_file_type_gltf) {
+		for (int i = 0; i < outData.data->buffers_count; i++) {
+			cgltf_buffer &gltfBuffer = outData.data->buffers[i];
 			char bufferPath[1024];
 			sprintf(bufferPath, "%s/%s", path, gltfBuffer.uri);
-			gltfBuffer.data = (void*)AllocFileBytes(bufferPath, bufferSize, assetManager);
-			gltfBuffer.data_free_method = cgltf_data_free_method_memory_free;
+
+			FileView bufferView;
+			if (!OpenFileView(bufferPath, bufferView, assetManager)) {
+				DEBUG_LOG("Buffer %s not found", bufferPath);
+				FreeGLTFData(outData);
+				return false;
+			}
+
+			gltfBuffer.data = (void*)bufferView.data;
+			gltfBuffer.data_free_method = cgltf_data_free_method_none;
+			outData.files.push_back(bufferView);
 		}
 	}
 
 	return true;
 }
 
-void FreeGLTFData(cgltf_data* data) {
-	if (data == nullptr) {
-		return;
+void FreeGLTFData(GLTFData& data) {
+	if (data.data != nullptr) {
+		cgltf_free(data.data);
+		data.data = nullptr;
 	}
 
-	cgltf_free(data);
+	for (FileView& view : data.files) {
+		CloseFileView(view);
+	}
+	data.files.clear();
 }
 
 bool FindGLTFMeshByName(const cgltf_data* const data, const char* meshName, cgltf_mesh& outMesh) {
@@ -188,31 +241,378 @@ bool FindGLTFMeshByName(const cgltf_data* const data, const char* meshName, cglt
 	return true;
 }
 
-// TODO:  Support multiple primitives
-bool GetGLTFMeshInfo(const cgltf_mesh& mesh, Rendering::MeshCreateInfo& outMeshInfo) {
+static const cgltf_accessor* GetGLTFPositionAccessor(const cgltf_primitive& prim) {
+	for (int i = 0; i < prim.attributes_count; i++) {
+		if (prim.attributes[i].type == cgltf_attribute_type_position) {
+			return prim.attributes[i].data;
+		}
+	}
+	return nullptr;
+}
+
+// Every triangle primitive becomes a submesh. Vertices and indices are concatenated, indices stay relative to the primitive's first vertex
+bool GetGLTFMeshInfo(const cgltf_data* const data, const cgltf_mesh& mesh, Rendering::MeshCreateInfo& outMeshInfo, JobSystem* jobSystem) {
 	if (mesh.primitives_count == 0) {
 		DEBUG_LOG("Mesh %s has no primitives", mesh.name);
 		return false;
 	}
+	if (mesh.primitives_count > Rendering::maxSubmeshCount) {
+		DEBUG_LOG("Mesh %s has too many primitives (%d), only %d will be imported", mesh.name, mesh.primitives_count, Rendering::maxSubmeshCount);
+	}
+
+	u32 vertexCount = 0;
+	u32 triangleCount = 0;
+	u32 submeshCount = 0;
+	bool shortIndices = true; // Keep 8/16 bit indices as 16 bit if every primitive has them
+	for (int i = 0; i < mesh.primitives_count && submeshCount < Rendering::maxSubmeshCount; i++) {
+		const cgltf_primitive& prim = mesh.primitives[i];
+		const cgltf_accessor* positions = GetGLTFPositionAccessor(prim);
+		if (prim.type != cgltf_primitive_type_triangles || positions == nullptr) {
+			DEBUG_LOG("Skipping primitive %d of mesh %s, only triangles supported for now", i, mesh.name);
+			continue;
+		}
+
+		if (positions->count > 0x10000 || (prim.indices != nullptr && prim.indices->component_type == cgltf_component_type_r_32u)) {
+			shortIndices = false;
+		}
 
-	cgltf_primitive &prim = mesh.primitives[0];
-	if (prim.type != cgltf_primitive_type_triangles) {
-		DEBUG_LOG("Only triangles supported for now");
+		vertexCount += positions->count;
+		triangleCount += (prim.indices != nullptr ? prim.indices->count : positions->count) / 3;
+		submeshCount++;
+	}
+
+	if (submeshCount == 0) {
+		DEBUG_LOG("Mesh %s has no triangle primitives", mesh.name);
 		return false;
 	}
 
-	for (int i = 0; i < prim.attributes_count; i++) {
-		cgltf_attribute &attr = prim.attributes[i];
-		ProcessVertexAttributeData(outMeshInfo, &attr);
+	outMeshInfo.vertexCount = vertexCount;
+	outMeshInfo.triangleCount = triangleCount;
+	if (shortIndices) {
+		outMeshInfo.triangles16 = (Rendering::Triangle16*)calloc(triangleCount, sizeof(Rendering::Triangle16));
 	}
+	else {
+		outMeshInfo.triangles = (Rendering::Triangle*)calloc(triangleCount, sizeof(Rendering::Triangle));
+	}
+	outMeshInfo.submeshCount = submeshCount;
+	outMeshInfo.submeshes = (Rendering::Submesh*)calloc(submeshCount, sizeof(Rendering::Submesh));
+
+	u32 vertexOffset = 0;
+	u32 triangleOffset = 0;
+	u32 submeshIndex = 0;
+	for (int i = 0; i < mesh.primitives_count && submeshIndex < submeshCount; i++) {
+		cgltf_primitive& prim = mesh.primitives[i];
+		const cgltf_accessor* positions = GetGLTFPositionAccessor(prim);
+		if (prim.type != cgltf_primitive_type_triangles || positions == nullptr) {
+			continue;
+		}
+
+		for (int j = 0; j < prim.attributes_count; j++) {
+			cgltf_attribute &attr = prim.attributes[j];
+			ProcessVertexAttributeData(outMeshInfo, &attr, vertexOffset, jobSystem);
+		}
+
+		u32 primTriangleCount;
+		if (prim.indices != nullptr) {
+			primTriangleCount = prim.indices->count / 3;
+			if (shortIndices) {
+				ProcessIndexBuffer(prim.indices, (u16*)(outMeshInfo.triangles16 + triangleOffset), jobSystem);
+			}
+			else {
+				ProcessIndexBuffer(prim.indices, (u32*)(outMeshInfo.triangles + triangleOffset), jobSystem);
+			}
+		}
+		else {
+			primTriangleCount = positions->count / 3;
+			for (u32 t = 0; t < primTriangleCount; t++) {
+				if (shortIndices) {
+					outMeshInfo.triangles16[triangleOffset + t] = Rendering::Triangle16(t * 3, t * 3 + 1, t * 3 + 2);
+				}
+				else {
+					outMeshInfo.triangles[triangleOffset + t] = Rendering::Triangle(t * 3, t * 3 + 1, t * 3 + 2);
+				}
+			}
+		}
+
+		Rendering::Submesh& submesh = outMeshInfo.submeshes[submeshIndex];
+		submesh.vertexOffset = vertexOffset;
+		submesh.materialIndex = prim.material != nullptr ? (u32)cgltf_material_index(data, prim.material) : (u32)data->materials_count;
+		submesh.lodCount = 1;
+		submesh.lods[0] = { triangleOffset, primTriangleCount, 0.0f };
+
+		vertexOffset += positions->count;
+		triangleOffset += primTriangleCount;
+		submeshIndex++;
+	}
+
+	DEBUG_LOG("Mesh %s: %d submeshes, triangle count = %d, %d bit indices", mesh.name, submeshCount, outMeshInfo.triangleCount, shortIndices ? 16 : 32);
 
-	size_t indexCount = ProcessVertexBuffer(prim.indices, (u8**)&outMeshInfo.triangles, sizeof(u32));
-	outMeshInfo.triangleCount = indexCount / 3;
-	DEBUG_LOG("Mesh triangle count = %d", outMeshInfo.triangleCount);
+	OptimizeMesh(outMeshInfo, mesh.name);
+	GenerateMeshLods(outMeshInfo, mesh.name);
+	BuildMeshlets(outMeshInfo, mesh.name);
 
 	return true;
 }
 
+static void GetGLTFNodeInstances(const cgltf_data* const data, const cgltf_node* const node, std::vector<GLTFMeshInstance>& outInstances) {
+	if (node->mesh != nullptr) {
+		GLTFMeshInstance instance;
+		instance.meshIndex = (u32)cgltf_mesh_index(data, node->mesh);
+		cgltf_node_transform_world(node, (r32*)&instance.transform);
+		outInstances.push_back(instance);
+	}
+
+	for (int i = 0; i < node->children_count; i++) {
+		GetGLTFNodeInstances(data, node->children[i], outInstances);
+	}
+}
+
+bool GetGLTFMeshInstances(const cgltf_data* const data, std::vector<GLTFMeshInstance>& outInstances) {
+	const cgltf_scene* scene = data->scene != nullptr ? data->scene : (data->scenes_count > 0 ? &data->scenes[0] : nullptr);
+	if (scene == nullptr) {
+		// No scene, so treat every root node as part of it
+		for (int i = 0; i < data->nodes_count; i++) {
+			if (data->nodes[i].parent == nullptr) {
+				GetGLTFNodeInstances(data, &data->nodes[i], outInstances);
+			}
+		}
+		return !outInstances.empty();
+	}
+
+	for (int i = 0; i < scene->nodes_count; i++) {
+		GetGLTFNodeInstances(data, scene->nodes[i], outInstances);
+	}
+	return !outInstances.empty();
+}
+
+void FreeGLTFMeshInfo(Rendering::MeshCreateInfo& meshInfo) {
+	free(meshInfo.position);
+	free(meshInfo.texcoord0);
+	free(meshInfo.normal);
+	free(meshInfo.tangent);
+	free(meshInfo.color);
+	free(meshInfo.joints);
+	free(meshInfo.weights);
+	free(meshInfo.triangles);
+	free(meshInfo.triangles16);
+	free(meshInfo.submeshes);
+	free(meshInfo.meshlets);
+	meshInfo = {};
+}
+
+static s32 GetGLTFJointIndex(const cgltf_skin& skin, const cgltf_node* node) {
+	for (u32 i = 0; i < skin.joints_count; i++) {
+		if (skin.joints[i] == node) {
+			return (s32)i;
+		}
+	}
+	return -1;
+}
+
+static void GetGLTFNodeJointTransform(const cgltf_node* node, JointTransform& outTransform) {
+	if (node->has_matrix) {
+		DecomposeJointMatrix(node->matrix, outTransform);
+		return;
+	}
+
+	MakeIdentityJointTransform(outTransform);
+	if (node->has_rotation) {
+		memcpy(outTransform.channels[ANIMATION_CHANNEL_ROTATION], node->rotation, sizeof(r32) * 4);
+	}
+	if (node->has_translation) {
+		memcpy(outTransform.channels[ANIMATION_CHANNEL_TRANSLATION], node->translation, sizeof(r32) * 3);
+	}
+	if (node->has_scale) {
+		memcpy(outTransform.channels[ANIMATION_CHANNEL_SCALE], node->scale, sizeof(r32) * 3);
+	}
+}
+
+// Nodes between two joints that aren't joints themselves are skipped, their transforms are lost
+bool GetGLTFSkeleton(const cgltf_skin& skin, Skeleton& outSkeleton) {
+	if (skin.joints_count == 0 || skin.joints_count > maxSkeletonJointCount) {
+		DEBUG_LOG("Skin %s has %d joints, expected 1 to %d", skin.name, skin.joints_count, maxSkeletonJointCount);
+		return false;
+	}
+
+	const u32 jointCount = skin.joints_count;
+	outSkeleton.jointCount = jointCount;
+	outSkeleton.parents = (s16*)malloc(sizeof(s16) * jointCount);
+	outSkeleton.order = (u16*)malloc(sizeof(u16) * jointCount);
+	outSkeleton.bindPose = (JointTransform*)malloc(sizeof(JointTransform) * jointCount);
+	outSkeleton.inverseBindMatrices = (r32*)malloc(sizeof(r32) * 16 * jointCount);
+
+	u32 depths[maxSkeletonJointCount];
+	const cgltf_node* rootParent = nullptr;
+	for (u32 i = 0; i < jointCount; i++) {
+		const cgltf_node* joint = skin.joints[i];
+		s32 parent = -1;
+		u32 depth = 0;
+		for (const cgltf_node* node = joint->parent; node != nullptr; node = node->parent) {
+			const s32 index = GetGLTFJointIndex(skin, node);
+			if (index >= 0) {
+				if (parent < 0) {
+					parent = index;
+				}
+				depth++;
+			}
+		}
+		if (parent < 0 && rootParent == nullptr) {
+			rootParent = joint->parent;
+		}
+
+		outSkeleton.parents[i] = (s16)parent;
+		outSkeleton.order[i] = (u16)i;
+		depths[i] = depth;
+		GetGLTFNodeJointTransform(joint, outSkeleton.bindPose[i]);
+
+		r32* inverseBindMatrix = outSkeleton.inverseBindMatrices + i * 16;
+		if (skin.inverse_bind_matrices == nullptr || !cgltf_accessor_read_float(skin.inverse_bind_matrices, i, inverseBindMatrix, 16)) {
+			memcpy(inverseBindMatrix, &glm::identity<glm::mat4>()[0][0], sizeof(r32) * 16);
+		}
+	}
+
+	// Shallower joints first, so parents are always done before their children
+	std::stable_sort(outSkeleton.order, outSkeleton.order + jointCount, [&depths](u16 a, u16 b) {
+		return depths[a] < depths[b];
+	});
+
+	if (rootParent != nullptr) {
+		cgltf_node_transform_world(rootParent, outSkeleton.rootTransform);
+	}
+	else {
+		memcpy(outSkeleton.rootTransform, &glm::identity<glm::mat4>()[0][0], sizeof(r32) * 16);
+	}
+
+	return true;
+}
+
+static void SampleGLTFChannel(const cgltf_animation_sampler& sampler, const r32* times, u32 keyCount, u32 componentCount, r32 time, r32* outValue) {
+	const bool cubic = sampler.interpolation == cgltf_interpolation_type_cubic_spline;
+	// Cubic spline keys are in-tangent, value, out-tangent
+	const u32 stride = cubic ? 3 : 1;
+	const u32 valueOffset = cubic ? 1 : 0;
+
+	if (keyCount == 1 || time <= times[0]) {
+		cgltf_accessor_read_float(sampler.output, valueOffset, outValue, componentCount);
+		return;
+	}
+	if (time >= times[keyCount - 1]) {
+		cgltf_accessor_read_float(sampler.output, (keyCount - 1) * stride + valueOffset, outValue, componentCount);
+		return;
+	}
+
+	const u32 next = (u32)(std::upper_bound(times, times + keyCount, time) - times);
+	const u32 prev = next - 1;
+	r32 a[4], b[4];
+	cgltf_accessor_read_float(sampler.output, prev * stride + valueOffset, a, componentCount);
+	if (sampler.interpolation == cgltf_interpolation_type_step) {
+		memcpy(outValue, a, sizeof(r32) * componentCount);
+		return;
+	}
+	cgltf_accessor_read_float(sampler.output, next * stride + valueOffset, b, componentCount);
+
+	const r32 dt = times[next] - times[prev];
+	const r32 t = dt > 0.0f ? (time - times[prev]) / dt : 0.0f;
+	if (cubic) {
+		r32 outTangent[4], inTangent[4];
+		cgltf_accessor_read_float(sampler.output, prev * stride + 2, outTangent, componentCount);
+		cgltf_accessor_read_float(sampler.output, next * stride, inTangent, componentCount);
+		const r32 t2 = t * t;
+		const r32 t3 = t2 * t;
+		for (u32 c = 0; c < componentCount; c++) {
+			outValue[c] = (2.0f * t3 - 3.0f * t2 + 1.0f) * a[c] + (t3 - 2.0f * t2 + t) * dt * outTangent[c] +
+				(-2.0f * t3 + 3.0f * t2) * b[c] + (t3 - t2) * dt * inTangent[c];
+		}
+		return;
+	}
+
+	// Quaternions take the short way around, nlerp is close enough at the import frame rate
+	r32 sign = 1.0f;
+	if (componentCount == 4) {
+		const r32 dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+		sign = dot < 0.0f ? -1.0f : 1.0f;
+	}
+	for (u32 c = 0; c < componentCount; c++) {
+		outValue[c] = a[c] + (b[c] * sign - a[c]) * t;
+	}
+}
+
+bool GetGLTFAnimationClip(const cgltf_animation& animation, const cgltf_skin& skin, const Skeleton& skeleton, AnimationClip& outClip) {
+	r32 duration = 0.0f;
+	for (u32 i = 0; i < animation.samplers_count; i++) {
+		const cgltf_accessor* input = animation.samplers[i].input;
+		if (input->has_max) {
+			duration = std::max(duration, input->max[0]);
+		}
+		else if (input->count > 0) {
+			r32 lastTime;
+			cgltf_accessor_read_float(input, input->count - 1, &lastTime, 1);
+			duration = std::max(duration, lastTime);
+		}
+	}
+
+	const u32 jointCount = skeleton.jointCount;
+	const u32 frameCount = (u32)ceilf(duration * animationImportFrameRate) + 1;
+	JointTransform* frames = (JointTransform*)malloc(sizeof(JointTransform) * frameCount * jointCount);
+	for (u32 f = 0; f < frameCount; f++) {
+		memcpy(frames + f * jointCount, skeleton.bindPose, sizeof(JointTransform) * jointCount);
+	}
+
+	u32 channelCount = 0;
+	for (u32 i = 0; i < animation.channels_count; i++) {
+		const cgltf_animation_channel& channel = animation.channels[i];
+		const s32 joint = GetGLTFJointIndex(skin, channel.target_node);
+		if (joint < 0) {
+			continue;
+		}
+
+		AnimationChannel target;
+		u32 componentCount;
+		switch (channel.target_path) {
+			case cgltf_animation_path_type_rotation:
+				target = ANIMATION_CHANNEL_ROTATION;
+				componentCount = 4;
+				break;
+			case cgltf_animation_path_type_translation:
+				target = ANIMATION_CHANNEL_TRANSLATION;
+				componentCount = 3;
+				break;
+			case cgltf_animation_path_type_scale:
+				target = ANIMATION_CHANNEL_SCALE;
+				componentCount = 3;
+				break;
+			default:
+				DEBUG_LOG("Animation %s: skipping unsupported channel path %d", animation.name, channel.target_path);
+				continue;
+		}
+
+		const cgltf_animation_sampler& sampler = *channel.sampler;
+		const u32 keyCount = (u32)sampler.input->count;
+		if (keyCount == 0) {
+			continue;
+		}
+		r32* times = (r32*)malloc(sizeof(r32) * keyCount);
+		cgltf_accessor_unpack_floats(sampler.input, times, keyCount);
+
+		for (u32 f = 0; f < frameCount; f++) {
+			const r32 time = std::min((r32)f / animationImportFrameRate, duration);
+			SampleGLTFChannel(sampler, times, keyCount, componentCount, time, frames[f * jointCount + joint].channels[target]);
+		}
+		free(times);
+		channelCount++;
+	}
+
+	if (channelCount == 0) {
+		DEBUG_LOG("Animation %s doesn't animate skin %s", animation.name, skin.name);
+		free(frames);
+		return false;
+	}
+
+	const bool result = CompressAnimationClip(frames, frameCount, animationImportFrameRate, skeleton, outClip);
+	free(frames);
+	return result;
+}
+
 void DebugPrintNodes(const cgltf_node* const node, u32 indent) {
 	DEBUG_LOG("%*s%s", indent, "->", node->name);
 	for (int i = 0; i < node->children_count; i++) {
@@ -1,11 +1,37 @@
 #pragma once
 #include "rendering.h"
-#include <android/asset_manager.h>
+#include "animation.h"
+#include "system.h"
 #include "cgltf.h"
+#include <vector>
 
-bool LoadGLTF(const u8* const buf, u32 bufferSize, cgltf_data** outData, AAssetManager *assetManager);
-bool LoadGLTF(const char* path, const char* fname, cgltf_data** outData, AAssetManager *assetManager);
-void FreeGLTFData(cgltf_data* data);
+class JobSystem;
+
+// Mesh referenced by a node, with the node's world transform baked in
+struct GLTFMeshInstance {
+	u32 meshIndex;
+	glm::mat4 transform;
+};
+
+// Parsed glTF and the files its buffers point into, both freed by FreeGLTFData
+struct GLTFData {
+	cgltf_data* data;
+	std::vector<FileView> files;
+};
+
+// For GLB the binary chunk is used in place, so buf has to outlive the returned data
+bool LoadGLTF(const u8* const buf, u32 bufferSize, GLTFData& outData, AAssetManager *assetManager);
+bool LoadGLTF(const char* path, const char* fname, GLTFData& outData, AAssetManager *assetManager);
+void FreeGLTFData(GLTFData& data);
 bool FindGLTFMeshByName(const cgltf_data* const data, const char* meshName, cgltf_mesh& outMesh);
-bool GetGLTFMeshInfo(const cgltf_mesh& mesh, Rendering::MeshCreateInfo& outMeshInfo);
+// Big accessors are decoded in parallel if a job system is given
+// Submesh material slots are the file's material indices, primitives without a material get the slot after the last one
+bool GetGLTFMeshInfo(const cgltf_data* const data, const cgltf_mesh& mesh, Rendering::MeshCreateInfo& outMeshInfo, JobSystem* jobSystem = nullptr);
+void FreeGLTFMeshInfo(Rendering::MeshCreateInfo& meshInfo);
+// Walks the node hierarchy of the default scene
+bool GetGLTFMeshInstances(const cgltf_data* const data, std::vector<GLTFMeshInstance>& outInstances);
+// Joint hierarchy, bind pose and inverse bind matrices of a skin. Free with FreeSkeleton
+bool GetGLTFSkeleton(const cgltf_skin& skin, Skeleton& outSkeleton);
+// Resamples the channels that target the skin's joints at animationImportFrameRate and compresses them. Free with FreeAnimationClip
+bool GetGLTFAnimationClip(const cgltf_animation& animation, const cgltf_skin& skin, const Skeleton& skeleton, AnimationClip& outClip);
 void DebugPrintNodes(const cgltf_node* const node, u32 indent);
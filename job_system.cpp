@@ -0,0 +1,93 @@
+#include "job_system.h"
+#include "system.h"
+
+JobSystem::JobSystem(u32 workerCount) {
+	stopping = false;
+
+	if (workerCount == 0) {
+		const u32 coreCount = std::thread::hardware_concurrency();
+		workerCount = coreCount > 1 ? coreCount - 1 : 1;
+	}
+
+	DEBUG_LOG("Starting %d job workers", workerCount);
+	for (u32 i = 0; i < workerCount; i++) {
+		workers.emplace_back(&JobSystem::WorkerLoop, this);
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopping = true;
+	}
+	queueCondition.notify_all();
+
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+void JobSystem::Schedule(JobFunction function, void* userData, JobCounter* counter) {
+	if (counter != nullptr) {
+		counter->pending++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		queue.push_back({ function, userData, counter });
+	}
+	queueCondition.notify_one();
+}
+
+void JobSystem::Wait(JobCounter& counter) {
+	while (counter.pending.load() > 0) {
+		Job job;
+		if (PopJob(job)) {
+			RunJob(job);
+		}
+		else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+u32 JobSystem::GetWorkerCount() const {
+	return workers.size();
+}
+
+bool JobSystem::PopJob(Job& outJob) {
+	std::lock_guard<std::mutex> lock(queueMutex);
+	if (queue.empty()) {
+		return false;
+	}
+
+	outJob = queue.front();
+	queue.pop_front();
+	return true;
+}
+
+void JobSystem::RunJob(const Job& job) {
+	job.function(job.userData);
+
+	if (job.counter != nullptr) {
+		job.counter->pending--;
+	}
+}
+
+void JobSystem::WorkerLoop() {
+	for (;;) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+			if (stopping && queue.empty()) {
+				return;
+			}
+
+			job = queue.front();
+			queue.pop_front();
+		}
+
+		RunJob(job);
+	}
+}
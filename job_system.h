@@ -0,0 +1,44 @@
+#pragma once
+#include "typedef.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef void (*JobFunction)(void* userData);
+
+// Counts jobs that haven't finished yet, can be waited on
+struct JobCounter {
+	std::atomic<u32> pending{ 0 };
+};
+
+class JobSystem {
+public:
+	// 0 workers = one less than the number of cores, but at least one
+	JobSystem(u32 workerCount = 0);
+	~JobSystem();
+
+	void Schedule(JobFunction function, void* userData, JobCounter* counter = nullptr);
+	// Runs pending jobs on the calling thread until the counter reaches zero
+	void Wait(JobCounter& counter);
+	u32 GetWorkerCount() const;
+
+private:
+	struct Job {
+		JobFunction function;
+		void* userData;
+		JobCounter* counter;
+	};
+
+	bool PopJob(Job& outJob);
+	static void RunJob(const Job& job);
+	void WorkerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<Job> queue;
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	bool stopping;
+};
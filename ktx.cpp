@@ -0,0 +1,157 @@
+#include "ktx.h"
+#include "system.h"
+#include <vulkan/vulkan.h>
+#include <cstring>
+#include "zstd.h"
+
+static const u8 ktx2Identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+static const KTX2LevelIndex* GetLevelIndex(const KTX2Header* const header) {
+	return (const KTX2LevelIndex*)(header + 1);
+}
+
+static bool GetKTX2Format(u32 vkFormat, Rendering::TextureCompression& outCompression, Rendering::ColorSpace& outSpace) {
+	switch (vkFormat) {
+		case VK_FORMAT_R8G8B8A8_UNORM:
+			outCompression = Rendering::TEXCOMPRESSION_NONE;
+			outSpace = Rendering::COLORSPACE_LINEAR;
+			return true;
+		case VK_FORMAT_R8G8B8A8_SRGB:
+			outCompression = Rendering::TEXCOMPRESSION_NONE;
+			outSpace = Rendering::COLORSPACE_SRGB;
+			return true;
+		default:
+			break;
+	}
+
+	// ASTC formats come in UNORM / SRGB pairs, in the same order as TextureCompression
+	if (vkFormat >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && vkFormat <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+		static const Rendering::TextureCompression astcCompressions[] = {
+			Rendering::TEXCOMPRESSION_ASTC_4x4,
+			Rendering::TEXCOMPRESSION_ASTC_5x4,
+			Rendering::TEXCOMPRESSION_ASTC_5x5,
+			Rendering::TEXCOMPRESSION_ASTC_6x5,
+			Rendering::TEXCOMPRESSION_ASTC_6x6,
+			Rendering::TEXCOMPRESSION_ASTC_8x5,
+			Rendering::TEXCOMPRESSION_ASTC_8x6,
+			Rendering::TEXCOMPRESSION_ASTC_8x8,
+			Rendering::TEXCOMPRESSION_ASTC_10x5,
+			Rendering::TEXCOMPRESSION_ASTC_10x6,
+			Rendering::TEXCOMPRESSION_ASTC_10x8,
+			Rendering::TEXCOMPRESSION_ASTC_10x10,
+			Rendering::TEXCOMPRESSION_ASTC_12x10,
+			Rendering::TEXCOMPRESSION_ASTC_12x12,
+		};
+
+		const u32 index = vkFormat - VK_FORMAT_ASTC_4x4_UNORM_BLOCK;
+		outCompression = astcCompressions[index / 2];
+		outSpace = (index % 2) ? Rendering::COLORSPACE_SRGB : Rendering::COLORSPACE_LINEAR;
+		return true;
+	}
+
+	return false;
+}
+
+bool IsValidKTX2(const u8* const buffer, u64 size) {
+	if (size < sizeof(KTX2Header) || memcmp(buffer, ktx2Identifier, sizeof(ktx2Identifier)) != 0) {
+		return false;
+	}
+
+	const KTX2Header* header = (const KTX2Header*)buffer;
+	const u32 levelCount = header->levelCount > 0 ? header->levelCount : 1;
+	if (size < sizeof(KTX2Header) + sizeof(KTX2LevelIndex) * levelCount) {
+		return false;
+	}
+
+	const KTX2LevelIndex* levels = GetLevelIndex(header);
+	for (u32 i = 0; i < levelCount; i++) {
+		if (levels[i].byteOffset + levels[i].byteLength > size) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool GetKTX2Info(const u8* const buffer, u64 size, Rendering::TextureCreateInfo& outInfo) {
+	if (!IsValidKTX2(buffer, size)) {
+		DEBUG_LOG("Invalid KTX2 file");
+		return false;
+	}
+
+	const KTX2Header* header = (const KTX2Header*)buffer;
+	if (header->pixelDepth > 1) {
+		DEBUG_LOG("3D textures are not supported");
+		return false;
+	}
+	if (header->faceCount != 1 && header->faceCount != 6) {
+		DEBUG_LOG("Invalid KTX2 face count %d", header->faceCount);
+		return false;
+	}
+	if (header->supercompressionScheme != KTX2_SUPERCOMPRESSION_NONE && header->supercompressionScheme != KTX2_SUPERCOMPRESSION_ZSTD) {
+		DEBUG_LOG("Unsupported KTX2 supercompression scheme %d", header->supercompressionScheme);
+		return false;
+	}
+	if (!GetKTX2Format(header->vkFormat, outInfo.compression, outInfo.space)) {
+		DEBUG_LOG("Unsupported KTX2 format %d", header->vkFormat);
+		return false;
+	}
+
+	outInfo.width = header->pixelWidth;
+	outInfo.height = header->pixelHeight;
+	outInfo.type = header->faceCount == 6 ? Rendering::TEXTURE_CUBEMAP : Rendering::TEXTURE_2D;
+	outInfo.layerCount = header->layerCount;
+	// Level count of 0 means the mips are supposed to be generated at load time
+	outInfo.mipCount = header->levelCount > 0 ? header->levelCount : 1;
+	outInfo.generateMips = header->levelCount == 0;
+	outInfo.pixels = nullptr;
+	outInfo.readLevel = ReadKTX2Level;
+	outInfo.readLevelUserData = (void*)buffer;
+
+	return true;
+}
+
+void ReadKTX2Level(void* buffer, u32 level, u8* dst, u64 size) {
+	const u8* const bytes = (const u8*)buffer;
+	const KTX2Header* header = (const KTX2Header*)bytes;
+	const KTX2LevelIndex& index = GetLevelIndex(header)[level];
+
+	if (header->supercompressionScheme == KTX2_SUPERCOMPRESSION_ZSTD) {
+		if (index.uncompressedByteLength != size) {
+			DEBUG_ERROR("KTX2 level %d size mismatch (%llu, expected %llu)", level, index.uncompressedByteLength, size);
+		}
+
+		const size_t result = ZSTD_decompress(dst, size, bytes + index.byteOffset, index.byteLength);
+		if (ZSTD_isError(result) || result != size) {
+			DEBUG_ERROR("Failed to decompress KTX2 level %d: %s", level, ZSTD_getErrorName(result));
+		}
+		return;
+	}
+
+	if (index.byteLength != size) {
+		DEBUG_ERROR("KTX2 level %d size mismatch (%llu, expected %llu)", level, index.byteLength, size);
+	}
+	memcpy(dst, bytes + index.byteOffset, size);
+}
+
+u8* AllocKTX2Levels(const u8* const buffer, u64& outSize) {
+	const KTX2Header* header = (const KTX2Header*)buffer;
+	const KTX2LevelIndex* levels = GetLevelIndex(header);
+	const u32 levelCount = header->levelCount > 0 ? header->levelCount : 1;
+	const bool supercompressed = header->supercompressionScheme != KTX2_SUPERCOMPRESSION_NONE;
+
+	outSize = 0;
+	for (u32 i = 0; i < levelCount; i++) {
+		outSize += supercompressed ? levels[i].uncompressedByteLength : levels[i].byteLength;
+	}
+
+	u8* result = (u8*)malloc(outSize);
+	u8* dst = result;
+	for (u32 i = 0; i < levelCount; i++) {
+		const u64 levelSize = supercompressed ? levels[i].uncompressedByteLength : levels[i].byteLength;
+		ReadKTX2Level((void*)buffer, i, dst, levelSize);
+		dst += levelSize;
+	}
+
+	return result;
+}
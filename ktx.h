@@ -0,0 +1,43 @@
+#pragma once
+#include "typedef.h"
+#include "rendering.h"
+
+struct KTX2Header {
+	u8 identifier[12];
+	u32 vkFormat;
+	u32 typeSize;
+	u32 pixelWidth;
+	u32 pixelHeight;
+	u32 pixelDepth;
+	u32 layerCount;
+	u32 faceCount;
+	u32 levelCount;
+	u32 supercompressionScheme;
+
+	u32 dfdByteOffset;
+	u32 dfdByteLength;
+	u32 kvdByteOffset;
+	u32 kvdByteLength;
+	u64 sgdByteOffset;
+	u64 sgdByteLength;
+};
+
+struct KTX2LevelIndex {
+	u64 byteOffset;
+	u64 byteLength;
+	u64 uncompressedByteLength;
+};
+
+enum KTX2Supercompression {
+	KTX2_SUPERCOMPRESSION_NONE = 0,
+	KTX2_SUPERCOMPRESSION_BASISLZ = 1,
+	KTX2_SUPERCOMPRESSION_ZSTD = 2,
+	KTX2_SUPERCOMPRESSION_ZLIB = 3,
+};
+
+bool IsValidKTX2(const u8* const buffer, u64 size);
+// Fills in everything needed to create the texture. Levels are read straight from the buffer (and decompressed if needed) when the texture is created, so the buffer has to stay alive until then
+bool GetKTX2Info(const u8* const buffer, u64 size, Rendering::TextureCreateInfo& outInfo);
+void ReadKTX2Level(void* buffer, u32 level, u8* dst, u64 size);
+// Decodes all levels to one tightly packed allocation, largest first. Memory is owned by caller
+u8* AllocKTX2Levels(const u8* const buffer, u64& outSize);
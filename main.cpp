@@ -6,9 +6,10 @@
 #include "system.h"
 #include "renderer.h"
 #include "xr.h"
-#include "astc.h"
-#include "gltf.h"
+#include "asset_loader.h"
+#include "scene.h"
 #include "math.h"
+#include <cstring>
 
 static bool running;
 static Rendering::Renderer* rendererPtr; // Stupid hack...
@@ -18,43 +19,61 @@ struct AndroidAppState {
 	bool resumed = false;
 };
 
-bool CreateGLTFMesh(Rendering::Renderer& renderer, const cgltf_mesh& mesh, Rendering::MeshHandle& outMeshHandle) {
-	Rendering::MeshCreateInfo meshInfo{};
-	if (!GetGLTFMeshInfo(mesh, meshInfo)) {
-		DEBUG_LOG("Failed to get mesh!");
+static bool LateLatchXRCamera(void* userData, Rendering::CameraData& outData) {
+	return ((XR::XRInstance*)userData)->LateLatchCameraData(outData);
+}
+
+bool CreateTexture(Rendering::Renderer& renderer, ResourceId id, const char* fname, bool stream, AAssetManager* assetManager, Rendering::TextureHandle& outTextureHandle) {
+	FileView file;
+	Rendering::TextureCreateInfo texInfo{};
+	if (!OpenTextureFile(fname, file, texInfo, assetManager)) {
 		return false;
 	}
+	texInfo.stream = stream;
 
-	outMeshHandle = renderer.CreateMesh(mesh.name, meshInfo);
-
-	if (meshInfo.position != nullptr) {
-		free(meshInfo.position);
-	}
-	if (meshInfo.texcoord0 != nullptr) {
-		free(meshInfo.texcoord0);
-	}
-	if (meshInfo.normal != nullptr) {
-		free(meshInfo.normal);
-	}
-	if (meshInfo.tangent != nullptr) {
-		free(meshInfo.tangent);
-	}
-	if (meshInfo.color != nullptr) {
-		free(meshInfo.color);
-	}
-	free(meshInfo.triangles);
+	outTextureHandle = renderer.CreateTexture(id, texInfo);
+	CloseFileView(file);
 
 	return true;
 }
 
-bool CreateGLTFMesh(Rendering::Renderer& renderer, const cgltf_data* const data, const char* meshName, Rendering::MeshHandle& outMeshHandle) {
-	cgltf_mesh mesh;
-	if (!FindGLTFMeshByName(data, meshName, mesh)) {
-		DEBUG_LOG("Cannot find mesh %s", meshName);
-		return false;
-	}
+// Small cube shown while the real meshes are loading
+Rendering::MeshHandle CreatePlaceholderMesh(Rendering::Renderer& renderer) {
+	const r32 halfSize = 0.05f;
+	glm::vec3 verts[] = {
+		{-halfSize,-halfSize,-halfSize},
+		{halfSize,-halfSize,-halfSize},
+		{halfSize,halfSize,-halfSize},
+		{-halfSize,halfSize,-halfSize},
+		{-halfSize,-halfSize,halfSize},
+		{halfSize,-halfSize,halfSize},
+		{halfSize,halfSize,halfSize},
+		{-halfSize,halfSize,halfSize},
+	};
+	Rendering::VertexUV uv[8] = {};
+	Rendering::Triangle tris[] = {
+		{0,2,1},
+		{0,3,2},
+		{4,5,6},
+		{4,6,7},
+		{0,1,5},
+		{0,5,4},
+		{3,6,2},
+		{3,7,6},
+		{0,4,7},
+		{0,7,3},
+		{1,2,6},
+		{1,6,5}
+	};
 
-	return CreateGLTFMesh(renderer, mesh, outMeshHandle);
+	Rendering::MeshCreateInfo info{};
+	info.vertexCount = 8;
+	info.position = verts;
+	info.texcoord0 = uv;
+	info.triangleCount = 12;
+	info.triangles = tris;
+
+	return renderer.CreateMesh("Placeholder"_rid, info);
 }
 
 /**
@@ -131,35 +150,24 @@ extern "C" void android_main(struct android_app *app) {
 
 	xrInstance.CreateSession(renderer);
 	renderer.CreateXRSwapchain(&xrInstance);
+	renderer.SetCameraLateLatch(LateLatchXRCamera, &xrInstance);
 	xrInstance.RequestStartSession();
 
-	// Test render stuff
-	u32 devTexSize;
-	u8* devTexBuffer = (u8*)AllocFileBytes("textures/dev.astc", devTexSize, app->activity->assetManager);
-	Rendering::TextureCreateInfo texInfo{};
-	texInfo.type = Rendering::TEXTURE_2D;
-	texInfo.generateMips = false;
-	texInfo.space = Rendering::COLORSPACE_SRGB;
-	texInfo.filter = Rendering::TEXFILTER_LINEAR;
-	GetAstcInfo(devTexBuffer, texInfo.width, texInfo.height, texInfo.compression);
-	GetAstcPayload(devTexBuffer, &texInfo.pixels);
-
-	Rendering::TextureHandle devTexHandle = renderer.CreateTexture("dev", texInfo);
-	free(devTexBuffer);
-
-	devTexBuffer = (u8*)AllocFileBytes("textures/tv_albedo.astc", devTexSize, app->activity->assetManager);
-	GetAstcInfo(devTexBuffer, texInfo.width, texInfo.height, texInfo.compression);
-	GetAstcPayload(devTexBuffer, &texInfo.pixels);
+	JobSystem jobSystem;
+	AssetLoader assetLoader(renderer, jobSystem, app->activity->assetManager);
 
-	Rendering::TextureHandle tvAlbedoHandle = renderer.CreateTexture("tv_albedo", texInfo);
-	free(devTexBuffer);
-
-	devTexBuffer = (u8*)AllocFileBytes("textures/hands_albedo.astc", devTexSize, app->activity->assetManager);
-	GetAstcInfo(devTexBuffer, texInfo.width, texInfo.height, texInfo.compression);
-	GetAstcPayload(devTexBuffer, &texInfo.pixels);
+	// Test render stuff
+	// The dev texture is tiny and doubles as the placeholder for everything else, so it's loaded right away
+	Rendering::TextureHandle devTexHandle;
+	if (!CreateTexture(renderer, "dev"_rid, "textures/dev.ntex", false, app->activity->assetManager, devTexHandle) &&
+		!CreateTexture(renderer, "dev"_rid, "textures/dev.astc", false, app->activity->assetManager, devTexHandle)) {
+		DEBUG_ERROR("Failed to load dev texture!");
+	}
+	Rendering::MeshHandle placeholderMesh = CreatePlaceholderMesh(renderer);
 
-	Rendering::TextureHandle handsAlbedoHandle = renderer.CreateTexture("hands_albedo", texInfo);
-	free(devTexBuffer);
+	// Cooked assets are preferred, the source formats are the fallback
+	AssetId tvAlbedo = assetLoader.LoadTexture("tv_albedo", "textures/tv_albedo.ntex", "textures/tv_albedo.astc", true, devTexHandle);
+	AssetId handsAlbedo = assetLoader.LoadTexture("hands_albedo", "textures/hands_albedo.ntex", "textures/hands_albedo.astc", true, devTexHandle);
 
 	r32 playAreaWidth, playAreaDepth;
 	xrInstance.GetSpaceDimensions(playAreaWidth, playAreaDepth);
@@ -269,38 +277,14 @@ extern "C" void android_main(struct android_app *app) {
 	cubeInfo.triangleCount = 12;
 	cubeInfo.triangles = tris;
 
-	Rendering::MeshHandle cubeMesh = renderer.CreateMesh("Cube", cubeInfo);
-
-	// Load gltf
-	cgltf_data* gltfData = nullptr;
-	Rendering::MeshHandle tvMesh;
-	if (!LoadGLTF("models", "tv.gltf", &gltfData, app->activity->assetManager)) {
-		DEBUG_ERROR("Failed to load TV asset!");
-	}
-	if (!CreateGLTFMesh(renderer, gltfData, "Mesh.010", tvMesh)) {
-		DEBUG_ERROR("Failed to create TV mesh");
-	}
-	FreeGLTFData(gltfData);
-
-	// Load hands
-	Rendering::MeshHandle handsMesh;
-	if (!LoadGLTF("models", "hands.gltf", &gltfData, app->activity->assetManager)) {
-		DEBUG_ERROR("Failed to load hand asset!");
-	}
-	if (!CreateGLTFMesh(renderer, gltfData, "handsShape", handsMesh)) {
-		DEBUG_ERROR("Failed to create hand meshes");
-	}
-	FreeGLTFData(gltfData);
+	Rendering::MeshHandle cubeMesh = renderer.CreateMesh("Cube"_rid, cubeInfo);
 
-	// Load placeholder gamepad
-	Rendering::MeshHandle gamepadMesh;
-	if (!LoadGLTF("models", "gamepad.gltf", &gltfData, app->activity->assetManager)) {
-		DEBUG_ERROR("Failed to load gamepad asset!");
-	}
-	if (!CreateGLTFMesh(renderer, gltfData, "Mesh.004", gamepadMesh)) {
-		DEBUG_ERROR("Failed to create gamepad mesh");
-	}
-	FreeGLTFData(gltfData);
+	AssetId tvMesh = assetLoader.LoadMesh("models/tv.nmesh", "models", "tv.gltf", "Mesh.010", placeholderMesh);
+	AssetId handsMesh = assetLoader.LoadMesh("models/hands.nmesh", "models", "hands.gltf", "handsShape", placeholderMesh);
+	// The hands file has no animations yet, so they're posed with the skin's bind pose
+	AssetId handsSkeleton = assetLoader.LoadSkeleton("models", "hands.gltf", "handsShape", nullptr);
+	// Placeholder gamepad
+	AssetId gamepadMesh = assetLoader.LoadMesh("models/gamepad.nmesh", "models", "gamepad.gltf", "Mesh.004", placeholderMesh);
 
 	Rendering::ShaderDataLayout shaderLayout{};
 	shaderLayout.dataSize = 0;
@@ -311,35 +295,74 @@ extern "C" void android_main(struct android_app *app) {
 	shaderInfo.metadata.dataLayout = shaderLayout;
 	shaderInfo.vertexInputs = (Rendering::VertexAttribFlags)(Rendering::VERTEX_POSITION_BIT | Rendering::VERTEX_TEXCOORD_0_BIT);
 	shaderInfo.samplerCount = 1;
-	shaderInfo.vertShader = AllocFileBytes("shaders/vert.spv", shaderInfo.vertShaderLength, app->activity->assetManager);
-	shaderInfo.fragShader = AllocFileBytes("shaders/test_frag.spv", shaderInfo.fragShaderLength, app->activity->assetManager);
+	FileView vertFile, fragFile;
+	if (!OpenFileView("shaders/vert.spv", vertFile, app->activity->assetManager) ||
+		!OpenFileView("shaders/test_frag.spv", fragFile, app->activity->assetManager)) {
+		DEBUG_ERROR("Failed to load shaders!");
+	}
+	shaderInfo.vertShader = (const char*)vertFile.data;
+	shaderInfo.vertShaderLength = vertFile.size;
+	shaderInfo.fragShader = (const char*)fragFile.data;
+	shaderInfo.fragShaderLength = fragFile.size;
+
+	Rendering::ShaderHandle shader = renderer.CreateShader("TestShader"_rid, shaderInfo);
+	CloseFileView(vertFile);
+
+	// Same shader with joint and weight inputs
+	FileView skinnedVertFile;
+	if (!OpenFileView("shaders/vert_skinned.spv", skinnedVertFile, app->activity->assetManager)) {
+		DEBUG_ERROR("Failed to load shaders!");
+	}
+	shaderInfo.vertexInputs = (Rendering::VertexAttribFlags)(shaderInfo.vertexInputs | Rendering::VERTEX_JOINTS_BIT | Rendering::VERTEX_WEIGHTS_BIT);
+	shaderInfo.vertShader = (const char*)skinnedVertFile.data;
+	shaderInfo.vertShaderLength = skinnedVertFile.size;
 
-	Rendering::ShaderHandle shader = renderer.CreateShader("TestShader", shaderInfo);
-	free(shaderInfo.vertShader);
-	free(shaderInfo.fragShader);
+	Rendering::ShaderHandle skinnedShader = renderer.CreateShader("SkinnedShader"_rid, shaderInfo);
+	CloseFileView(skinnedVertFile);
+	CloseFileView(fragFile);
 
 	Rendering::MaterialCreateInfo matInfo{};
 	matInfo.metadata.shader = shader;
 	matInfo.metadata.castShadows = true;
 	matInfo.data.textures[0] = devTexHandle;
 
-	Rendering::MaterialHandle material = renderer.CreateMaterial("TestMat", matInfo);
+	Rendering::MaterialHandle material = renderer.CreateMaterial("TestMat"_rid, matInfo);
+
+	Rendering::MaterialHandle tvMaterial = renderer.CreateMaterial("TVMat"_rid, matInfo);
+	assetLoader.BindTexture(tvAlbedo, tvMaterial, 0);
 
-	matInfo.data.textures[0] = tvAlbedoHandle;
-	Rendering::MaterialHandle tvMaterial = renderer.CreateMaterial("TVMat", matInfo);
+	// The placeholder isn't skinned, so it's drawn with the regular shader until the hands have loaded
+	Rendering::MaterialHandle handsMaterial = renderer.CreateMaterial("HandsMat"_rid, matInfo);
+	assetLoader.BindTexture(handsAlbedo, handsMaterial, 0);
 
-	matInfo.data.textures[0] = handsAlbedoHandle;
-	Rendering::MaterialHandle handsMaterial = renderer.CreateMaterial("HandsMat", matInfo);
+	matInfo.metadata.shader = skinnedShader;
+	Rendering::MaterialHandle handsSkinnedMaterial = renderer.CreateMaterial("HandsSkinnedMat"_rid, matInfo);
+	assetLoader.BindTexture(handsAlbedo, handsSkinnedMaterial, 0);
 
 	const glm::mat4 leftHandControllerOffset = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(0.038f, -0.025f, 0.004f)), glm::radians(-9.4f), glm::vec3(0,0,1));
 	const glm::mat4 rightHandControllerOffset = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(-0.038f, -0.025f, 0.004f)), glm::radians(9.4f), glm::vec3(0,0,1));
 
 	//u64 time = GetTickCount64();
-	bool controllerModelsLoaded = false;
-	std::vector<Rendering::MeshHandle> leftControllerMeshes;
-	std::vector<Rendering::MeshHandle> rightControllerMeshes;
+	s64 animationStartTime = 0;
+	bool controllerModelsRequested = false;
+	AssetId leftControllerModel = 0, rightControllerModel = 0;
 	const glm::mat4 controllerPoseCorrection = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.055f));
 
+	Scene scene(renderer);
+	scene.CreateObject(cubeMesh, material, renderer.GetMeshBounds(cubeMesh));
+	const SceneObjectHandle tvObject = scene.CreateObject(assetLoader.GetMesh(tvMesh), tvMaterial, renderer.GetMeshBounds(assetLoader.GetMesh(tvMesh)));
+	scene.SetPosition(tvObject, glm::vec3(0.0, 1.0f, -roomHalfDepth + 0.5f));
+	const SceneObjectHandle gamepadObject = scene.CreateObject(assetLoader.GetMesh(gamepadMesh), material, renderer.GetMeshBounds(assetLoader.GetMesh(gamepadMesh)));
+	// Hands hold the gamepad, so they follow it. The scene has no joint palettes, so they're drawn skinned separately
+	const SceneObjectHandle handsObject = scene.CreateNode(gamepadObject);
+	// Controller model parts are attached to these once the runtime's models have loaded
+	SceneObjectHandle controllerNodes[2] = { scene.CreateNode(), scene.CreateNode() };
+	// Where the gamepad sits relative to each controller
+	SceneObjectHandle gamepadOffsetNodes[2] = { scene.CreateNode(controllerNodes[XR::VR_HAND_LEFT]), scene.CreateNode(controllerNodes[XR::VR_HAND_RIGHT]) };
+	scene.SetTransform(gamepadOffsetNodes[XR::VR_HAND_LEFT], leftHandControllerOffset);
+	scene.SetTransform(gamepadOffsetNodes[XR::VR_HAND_RIGHT], rightHandControllerOffset);
+	bool controllerObjectsCreated[2] = { false, false };
+
 	while (app->destroyRequested == 0) {
 		// Read all pending events.
 		for (;;) {
@@ -358,47 +381,15 @@ extern "C" void android_main(struct android_app *app) {
 			}
 		}
 
-		if (!controllerModelsLoaded && xrInstance.SessionRunning()) {
-			cgltf_data* controllerData = nullptr;
-			u8* controllerBuffer = nullptr;
-			u32 controllerBufferSize;
-			xrInstance.GetControllerGeometry(XR::VR_HAND_LEFT, &controllerBuffer, controllerBufferSize);
-			if (!LoadGLTF(controllerBuffer, controllerBufferSize, &controllerData, app->activity->assetManager)) {
-				DEBUG_ERROR("Failed to load left controller asset!");
-			}
-
-			free(controllerBuffer);
-
-			for (int i = 0; i < controllerData->meshes_count; i++) {
-				auto& mesh = controllerData->meshes[i];
-				DEBUG_LOG("Found left controller mesh %s", mesh.name);
-				Rendering::MeshHandle meshHandle;
-				CreateGLTFMesh(renderer, mesh, meshHandle);
-				leftControllerMeshes.push_back(meshHandle);
-			}
-
-			FreeGLTFData(controllerData);
-
-			xrInstance.GetControllerGeometry(XR::VR_HAND_RIGHT, &controllerBuffer, controllerBufferSize);
-			if (!LoadGLTF(controllerBuffer, controllerBufferSize, &controllerData, app->activity->assetManager)) {
-				DEBUG_ERROR("Failed to load right controller asset!");
-			}
-
-			free(controllerBuffer);
-
-			for (int i = 0; i < controllerData->meshes_count; i++) {
-				auto& mesh = controllerData->meshes[i];
-				DEBUG_LOG("Found right controller mesh %s", mesh.name);
-				Rendering::MeshHandle meshHandle;
-				CreateGLTFMesh(renderer, mesh, meshHandle);
-				rightControllerMeshes.push_back(meshHandle);
-			}
-
-			FreeGLTFData(controllerData);
-
-			controllerModelsLoaded = true;
+		// Render models are only available once the session is running
+		if (!controllerModelsRequested && xrInstance.SessionRunning()) {
+			leftControllerModel = assetLoader.LoadControllerModel(&xrInstance, XR::VR_HAND_LEFT);
+			rightControllerModel = assetLoader.LoadControllerModel(&xrInstance, XR::VR_HAND_RIGHT);
+			controllerModelsRequested = true;
 		}
 
+		assetLoader.Update();
+
 		/*u64 newTime = GetTickCount64();
 		u64 deltaTime = newTime - time;
 		r32 deltaTimeSeconds = deltaTime / 1000.0f;
@@ -412,34 +403,42 @@ extern "C" void android_main(struct android_app *app) {
 			xrInstance.GetNextSwapchainImage(xrSwapchainImageIndex);
 
 			Rendering::CameraData camData{};
-			xrInstance.GetCameraData(xrDisplayTime, 0.01f, 100.0f, camData);
+			xrInstance.GetCameraData(0.01f, 100.0f, camData);
 			renderer.UpdateCameraRaw(camData);
 
-			// Draw hands
-			bool leftHandVisible = false;
-			bool rightHandVisible = false;
-			glm::mat4 leftHandTransform = glm::mat4(1.0);
-			if (xrInstance.GetHandTransform(xrDisplayTime, XR::VR_HAND_LEFT, leftHandTransform)) {
-				if (controllerModelsLoaded) {
-					for (auto& meshHandle : leftControllerMeshes) {
-						renderer.DrawMesh(meshHandle, material, leftHandTransform * controllerPoseCorrection);
+			// Meshes switch from the placeholder once loaded
+			scene.SetMesh(tvObject, assetLoader.GetMesh(tvMesh), renderer.GetMeshBounds(assetLoader.GetMesh(tvMesh)));
+			scene.SetMesh(gamepadObject, assetLoader.GetMesh(gamepadMesh), renderer.GetMeshBounds(assetLoader.GetMesh(gamepadMesh)));
+
+			// Hands
+			const AssetId controllerModels[2] = { leftControllerModel, rightControllerModel };
+			glm::mat4 handTransforms[2] = { glm::mat4(1.0f), glm::mat4(1.0f) };
+			bool handVisible[2];
+			for (u32 hand = 0; hand < 2; hand++) {
+				handVisible[hand] = xrInstance.GetHandTransform((XR::HandIndex)hand, handTransforms[hand]);
+
+				if (controllerModelsRequested && !controllerObjectsCreated[hand] && assetLoader.IsReady(controllerModels[hand])) {
+					for (u32 i = 0; i < assetLoader.GetInstanceCount(controllerModels[hand]); i++) {
+						const Rendering::MeshHandle mesh = assetLoader.GetInstanceMesh(controllerModels[hand], i);
+						const SceneObjectHandle part = scene.CreateObject(mesh, material, renderer.GetMeshBounds(mesh), controllerNodes[hand]);
+						scene.SetTransform(part, assetLoader.GetInstanceTransform(controllerModels[hand], i));
 					}
+					controllerObjectsCreated[hand] = true;
 				}
-				leftHandVisible = true;
-			}
-			glm::mat4 rightHandTransform = glm::mat4(1.0);
-			if (xrInstance.GetHandTransform(xrDisplayTime, XR::VR_HAND_RIGHT, rightHandTransform)) {
-				if (controllerModelsLoaded) {
-					for (auto& meshHandle : rightControllerMeshes) {
-						renderer.DrawMesh(meshHandle, material, rightHandTransform * controllerPoseCorrection);
-					}
+				scene.SetVisible(controllerNodes[hand], handVisible[hand]);
+				if (handVisible[hand]) {
+					scene.SetTransform(controllerNodes[hand], handTransforms[hand] * controllerPoseCorrection);
 				}
-				rightHandVisible = true;
 			}
+			const bool leftHandVisible = handVisible[XR::VR_HAND_LEFT];
+			const bool rightHandVisible = handVisible[XR::VR_HAND_RIGHT];
 
+			// The offset nodes follow the controllers, the gamepad goes between them once they're updated
+			scene.UpdateWorldMatrices();
+			scene.SetVisible(gamepadObject, leftHandVisible || rightHandVisible);
 			if (leftHandVisible || rightHandVisible) {
-				const glm::mat4 gamepadLeftTransform = leftHandTransform * controllerPoseCorrection * leftHandControllerOffset;
-				const glm::mat4 gamepadRightTransform = rightHandTransform * controllerPoseCorrection * rightHandControllerOffset;
+				const glm::mat4& gamepadLeftTransform = scene.GetWorldMatrix(gamepadOffsetNodes[XR::VR_HAND_LEFT]);
+				const glm::mat4& gamepadRightTransform = scene.GetWorldMatrix(gamepadOffsetNodes[XR::VR_HAND_RIGHT]);
 
 				const glm::quat gamepadLeftRot = glm::quat_cast(gamepadLeftTransform);
 				const glm::quat gamepadRightRot = glm::quat_cast(gamepadRightTransform);
@@ -455,22 +454,42 @@ extern "C" void android_main(struct android_app *app) {
 					gamepadTransform = gamepadRightTransform;
 				}
 
-				renderer.DrawMesh(gamepadMesh, material, gamepadTransform);
-				renderer.DrawMesh(handsMesh, handsMaterial, gamepadTransform);
+				scene.SetTransform(gamepadObject, gamepadTransform);
 			}
 
-			// Draw room
-			renderer.DrawMesh(cubeMesh, material, glm::mat4(1.0f));
+			scene.UpdateWorldMatrices();
+			renderer.DrawScene(scene);
 
-			// Draw TV
-			glm::mat4 tvTransform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 1.0f, -roomHalfDepth + 0.5f));
-			renderer.DrawMesh(tvMesh, tvMaterial, tvTransform);
+			if (leftHandVisible || rightHandVisible) {
+				const Rendering::MeshHandle hands = assetLoader.GetMesh(handsMesh);
+				const glm::mat4& handsTransform = scene.GetWorldMatrix(handsObject);
+				const Skeleton* skeleton = assetLoader.GetSkeleton(handsSkeleton);
+				// The skin has to cover every joint the vertices index
+				const bool skinned = skeleton != nullptr && renderer.GetMeshJointCount(hands) > 0 && renderer.GetMeshJointCount(hands) <= skeleton->jointCount;
+				u32 handJointOffset;
+				glm::mat4* handJoints = skinned ? renderer.AllocateJoints(skeleton->jointCount, handJointOffset) : nullptr;
+				if (handJoints != nullptr) {
+					if (animationStartTime == 0) {
+						animationStartTime = xrDisplayTime;
+					}
+					AnimationSampleJob job{};
+					job.skeleton = skeleton;
+					job.clip = assetLoader.GetAnimationClip(handsSkeleton);
+					job.time = (xrDisplayTime - animationStartTime) / 1000000000.0f;
+					job.loop = true;
+					job.outPalette = &handJoints[0][0][0];
+					SampleAnimations(&job, 1, &jobSystem);
+					renderer.DrawSkinnedMeshInstanced(hands, handsSkinnedMaterial, 1, &handsTransform, handJointOffset, skeleton->jointCount);
+				} else {
+					renderer.DrawMesh(hands, handsMaterial, handsTransform);
+				}
+			}
 
 			renderer.Render(xrSwapchainImageIndex);
 
 			xrInstance.ReleaseSwapchainImage();
 		}
-		xrInstance.EndFrame(xrDisplayTime);
+		xrInstance.EndFrame();
 	}
 
 	xrInstance.DestroySession();
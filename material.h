@@ -50,9 +50,9 @@ namespace Rendering {
 		ShaderMetadata metadata;
 		VertexAttribFlags vertexInputs;
 		u32 samplerCount;
-		char* vertShader;
+		const char* vertShader;
 		u32 vertShaderLength;
-		char* fragShader;
+		const char* fragShader;
 		u32 fragShaderLength;
 	};
 
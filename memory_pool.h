@@ -1,5 +1,6 @@
 #pragma once
 #include "typedef.h"
+#include <atomic>
 
 template <typename T>
 class PoolHandle {
@@ -32,85 +33,166 @@ public:
 	}
 };
 
+// Objects live in fixed size chunks, so growing never moves them and pointers from Get stay valid until Remove
+// Reserve allocates chunks up front, otherwise Add grows the pool a chunk at a time up to maxSize (0 = no limit)
 template<typename T, typename THandle = PoolHandle<T>>
 class Pool
 {
 private:
-	T* objs;
-	THandle* handles;
-	u32* erase;
+	static constexpr u32 chunkShift = 6;
+	static constexpr u32 chunkSize = 1 << chunkShift; // Objects per chunk
+	static constexpr u32 chunkMask = chunkSize - 1;
 
-	u32 size;
+	T** chunks;
+	THandle* handles; // Live handles first, then the free ones to be reused
+	u32* erase; // Index of each object's handle in handles
+
+	u32 chunkCount;
+	u32 size; // Objects in all the chunks
+	u32 maxSize;
 	u32 count;
+
+	inline T* GetObject(u32 arrayIndex) const {
+		return &chunks[arrayIndex >> chunkShift][arrayIndex & chunkMask];
+	}
+	bool Grow(u32 newSize) {
+		const u32 newChunkCount = (newSize + chunkMask) >> chunkShift;
+		if (newChunkCount <= chunkCount) {
+			return true;
+		}
+		newSize = newChunkCount << chunkShift;
+
+		T** newChunks = (T**)realloc(chunks, sizeof(T*) * newChunkCount);
+		if (newChunks == nullptr) {
+			return false;
+		}
+		chunks = newChunks;
+		THandle* newHandles = (THandle*)realloc(handles, sizeof(THandle) * newSize);
+		if (newHandles == nullptr) {
+			return false;
+		}
+		handles = newHandles;
+		u32* newErase = (u32*)realloc(erase, sizeof(u32) * newSize);
+		if (newErase == nullptr) {
+			return false;
+		}
+		erase = newErase;
+
+		// Chunks allocated before a failure are kept, with their slots set up like after a full grow
+		bool allocated = true;
+		u32 allocatedChunkCount = chunkCount;
+		for (; allocatedChunkCount < newChunkCount; allocatedChunkCount++) {
+			chunks[allocatedChunkCount] = (T*)calloc(chunkSize, sizeof(T));
+			if (chunks[allocatedChunkCount] == nullptr) {
+				allocated = false;
+				break;
+			}
+		}
+		newSize = allocatedChunkCount << chunkShift;
+
+		// Free slots are at the end of handles, and count <= size, so the new ones can just be appended
+		for (u32 i = size; i < newSize; i++) {
+			handles[i] = THandle(i, 0);
+			erase[i] = i;
+		}
+		chunkCount = allocatedChunkCount;
+		size = newSize;
+		return allocated;
+	}
 public:
 	Pool() {
 		Init(0);
 	}
-	Pool(u32 s) {
-		Init(s);
+	Pool(u32 reserve, u32 max = 0) {
+		Init(reserve, max);
 	}
 	void Free() {
-		free(objs);
+		for (u32 i = 0; i < chunkCount; i++) {
+			free(chunks[i]);
+		}
+		free(chunks);
 		free(handles);
 		free(erase);
+		chunks = nullptr;
+		handles = nullptr;
+		erase = nullptr;
+		chunkCount = 0;
+		size = 0;
+		count = 0;
 	}
 	~Pool() {
 		Free();
 	}
-	void Init(u32 s) {
-		size = s;
+	void Init(u32 reserve, u32 max = 0) {
+		chunks = nullptr;
+		handles = nullptr;
+		erase = nullptr;
+		chunkCount = 0;
+		size = 0;
 		count = 0;
-
-		objs = (T*)calloc(size, sizeof(T));
-		handles = (THandle*)calloc(size, sizeof(THandle));
-		erase = (u32*)calloc(size, sizeof(u32));
-
-		for (u32 i = 0; i < size; i++)
-		{
-			handles[i] = THandle(i, 0);
-			erase[i] = i;
+		maxSize = max;
+		Reserve(reserve);
+	}
+	// Makes room for at least capacity objects. Fails past maxSize or if out of memory
+	bool Reserve(u32 capacity) {
+		if (maxSize != 0 && capacity > maxSize) {
+			return false;
 		}
+		return Grow(capacity);
 	}
+	// Returns null if the pool is at maxSize or can't grow
 	T* Add(THandle& outHandle) {
-		if (count >= size) {
+		if (maxSize != 0 && count >= maxSize) {
+			return nullptr;
+		}
+		if (count >= size && !Grow(count + 1)) {
 			return nullptr;
 		}
 
 		THandle handle = handles[count++];
 		const u32 arrayIndex = handle.Index();
 		outHandle = handle;
-		return &objs[arrayIndex];
+		return GetObject(arrayIndex);
 	}
 	T* Get(const THandle handle) const {
 		const u32 arrayIndex = handle.Index();
+		if (arrayIndex >= size) {
+			return nullptr;
+		}
 		const u32 handleIndex = erase[arrayIndex];
 		const THandle h = handles[handleIndex];
-		if (h != handle) {
+		if (handleIndex >= count || h != handle) {
 			return nullptr;
 		}
-		return &objs[arrayIndex];
+		return GetObject(arrayIndex);
 	}
 	T* operator[](THandle handle) {
 		return Get(handle);
 	}
 	bool Remove(const THandle handle) {
 		const u32 arrayIndex = handle.Index();
+		if (arrayIndex >= size) {
+			return false;
+		}
 		const u32 handleIndex = erase[arrayIndex];
 		THandle h = handles[handleIndex];
-		if (h != handle) {
+		if (handleIndex >= count || h != handle) {
 			return false;
 		}
-		handles[handleIndex] = handles[--count];
+		--count;
+		const THandle last = handles[count];
+		handles[handleIndex] = last;
+		erase[last.Index()] = handleIndex;
 		handles[count] = THandle(arrayIndex, h.Generation() + 1);
-
-		const u32 swap = erase[arrayIndex];
-		erase[arrayIndex] = erase[count];
-		erase[count] = swap;
+		erase[arrayIndex] = count;
 		return true;
 	}
 	u32 Count() const {
 		return count;
 	}
+	u32 Capacity() const {
+		return size;
+	}
 	bool GetHandle(u32 index, THandle& outHandle) const {
 		if (index >= count) {
 			return false;
@@ -118,4 +200,255 @@ public:
 		outHandle = handles[index];
 		return true;
 	}
-};
\ No newline at end of file
+};
+
+// Pool that can be used from several threads at once without locking
+// Add and Get are lock-free. Removed slots go to a pending list and are only reused after Reclaim,
+// so a pointer another thread got just before the Remove stays valid until then
+// ReserveHandle hands out a handle before the object exists, it's filled through GetReserved and made visible with Commit
+// Free slots are a stack whose head is tagged with a counter, so a pop can't succeed on a stale head (ABA)
+// Grows a chunk at a time up to maxChunkCount chunks, chunks are never moved or freed before the pool
+template<typename T, typename THandle = PoolHandle<T>, u32 maxChunkCount = 1024>
+class ConcurrentPool
+{
+private:
+	static constexpr u32 chunkShift = 6;
+	static constexpr u32 chunkSize = 1 << chunkShift; // Slots per chunk
+	static constexpr u32 chunkMask = chunkSize - 1;
+	static constexpr u32 maxSize = maxChunkCount * chunkSize;
+	static constexpr u32 invalidIndex = 0xffffffff;
+
+	struct Slot {
+		T obj;
+		std::atomic<u32> generation; // Odd while the slot is in use, handles carry the odd value. Reserved slots stay even
+		std::atomic<u32> next; // Next free or pending slot
+	};
+
+	std::atomic<Slot*> chunks[maxChunkCount];
+	std::atomic<u64> freeHead; // Tag in the high 32 bits, slot index in the low
+	std::atomic<u32> pendingHead; // Removed slots waiting for Reclaim
+	std::atomic<u32> highWater; // Slots below this have been handed out at least once
+	std::atomic<u32> count;
+
+	inline Slot* GetSlot(u32 index) const {
+		return &chunks[index >> chunkShift].load(std::memory_order_acquire)[index & chunkMask];
+	}
+	bool EnsureChunk(u32 chunkIndex) {
+		if (chunks[chunkIndex].load(std::memory_order_acquire) != nullptr) {
+			return true;
+		}
+
+		Slot* chunk = (Slot*)calloc(chunkSize, sizeof(Slot));
+		if (chunk == nullptr) {
+			return false;
+		}
+		// Another thread may have added the chunk in the meantime, then this one isn't needed
+		Slot* expected = nullptr;
+		if (!chunks[chunkIndex].compare_exchange_strong(expected, chunk, std::memory_order_acq_rel)) {
+			free(chunk);
+		}
+		return true;
+	}
+	bool PopFree(u32& outIndex) {
+		u64 head = freeHead.load(std::memory_order_acquire);
+		while ((u32)head != invalidIndex) {
+			const u32 index = (u32)head;
+			// Might be stale if another thread popped the slot already, the tag makes the exchange fail then
+			const u32 next = GetSlot(index)->next.load(std::memory_order_relaxed);
+			const u64 newHead = (((head >> 32ull) + 1) << 32ull) | (u64)next;
+			if (freeHead.compare_exchange_weak(head, newHead, std::memory_order_acq_rel, std::memory_order_acquire)) {
+				outIndex = index;
+				return true;
+			}
+		}
+		return false;
+	}
+	// A fresh slot's chunk exists before highWater covers it, so Get and GetSlotHandle never see a missing chunk
+	bool ClaimIndex(u32& outIndex) {
+		if (PopFree(outIndex)) {
+			return true;
+		}
+
+		u32 index = highWater.load(std::memory_order_acquire);
+		do {
+			if (index >= maxSize || !EnsureChunk(index >> chunkShift)) {
+				return false;
+			}
+		} while (!highWater.compare_exchange_weak(index, index + 1, std::memory_order_acq_rel, std::memory_order_acquire));
+
+		outIndex = index;
+		return true;
+	}
+	void PushFree(u32 index) {
+		Slot* slot = GetSlot(index);
+		u64 head = freeHead.load(std::memory_order_relaxed);
+		u64 newHead;
+		do {
+			slot->next.store((u32)head, std::memory_order_relaxed);
+			newHead = (((head >> 32ull) + 1) << 32ull) | (u64)index;
+		} while (!freeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+	}
+public:
+	ConcurrentPool() {
+		for (u32 i = 0; i < maxChunkCount; i++) {
+			chunks[i].store(nullptr, std::memory_order_relaxed);
+		}
+		freeHead.store(invalidIndex, std::memory_order_relaxed);
+		pendingHead.store(invalidIndex, std::memory_order_relaxed);
+		highWater.store(0, std::memory_order_relaxed);
+		count.store(0, std::memory_order_relaxed);
+	}
+	ConcurrentPool(u32 reserve) : ConcurrentPool() {
+		Reserve(reserve);
+	}
+	~ConcurrentPool() {
+		Free();
+	}
+	// Not thread safe
+	void Free() {
+		for (u32 i = 0; i < maxChunkCount; i++) {
+			free(chunks[i].exchange(nullptr, std::memory_order_relaxed));
+		}
+		freeHead.store(invalidIndex, std::memory_order_relaxed);
+		pendingHead.store(invalidIndex, std::memory_order_relaxed);
+		highWater.store(0, std::memory_order_relaxed);
+		count.store(0, std::memory_order_relaxed);
+	}
+	// Allocates the chunks for the first capacity slots up front
+	bool Reserve(u32 capacity) {
+		if (capacity > maxSize) {
+			return false;
+		}
+		for (u32 i = 0; i < (capacity + chunkMask) >> chunkShift; i++) {
+			if (!EnsureChunk(i)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	// Returns null if the pool is full or can't grow
+	T* Add(THandle& outHandle) {
+		u32 index;
+		if (!ClaimIndex(index)) {
+			return nullptr;
+		}
+
+		Slot* slot = GetSlot(index);
+		const u32 generation = slot->generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+		count.fetch_add(1, std::memory_order_relaxed);
+		outHandle = THandle(index, generation);
+		return &slot->obj;
+	}
+	// Takes a slot without making it visible, Get fails for the handle until Commit. False if the pool is full
+	bool ReserveHandle(THandle& outHandle) {
+		u32 index;
+		if (!ClaimIndex(index)) {
+			return false;
+		}
+
+		const u32 generation = GetSlot(index)->generation.load(std::memory_order_acquire);
+		outHandle = THandle(index, generation + 1);
+		return true;
+	}
+	// The object of a reserved handle, to be filled in before Commit
+	T* GetReserved(const THandle handle) const {
+		const u32 index = handle.Index();
+		if (index >= highWater.load(std::memory_order_acquire) || (handle.Generation() & 1) == 0) {
+			return nullptr;
+		}
+		Slot* slot = GetSlot(index);
+		if (slot->generation.load(std::memory_order_acquire) != handle.Generation() - 1) {
+			return nullptr;
+		}
+		return &slot->obj;
+	}
+	// Publishes the object, writes to it before this are seen by threads that Get it
+	bool Commit(const THandle handle) {
+		const u32 index = handle.Index();
+		u32 generation = handle.Generation() - 1;
+		if (index >= highWater.load(std::memory_order_acquire) || (generation & 1) != 0) {
+			return false;
+		}
+		if (!GetSlot(index)->generation.compare_exchange_strong(generation, generation + 1, std::memory_order_acq_rel)) {
+			return false;
+		}
+		count.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+	// Gives a reserved slot back. Nothing can have got the object, so it's free again right away
+	bool CancelReservation(const THandle handle) {
+		const u32 index = handle.Index();
+		u32 generation = handle.Generation() - 1;
+		if (index >= highWater.load(std::memory_order_acquire) || (generation & 1) != 0) {
+			return false;
+		}
+		// Skip the reserved generation, so the cancelled handle can't commit a later reservation of the slot
+		if (!GetSlot(index)->generation.compare_exchange_strong(generation, generation + 2, std::memory_order_acq_rel)) {
+			return false;
+		}
+		PushFree(index);
+		return true;
+	}
+	T* Get(const THandle handle) const {
+		const u32 index = handle.Index();
+		if (index >= highWater.load(std::memory_order_acquire) || (handle.Generation() & 1) == 0) {
+			return nullptr;
+		}
+		Slot* slot = GetSlot(index);
+		if (slot->generation.load(std::memory_order_acquire) != handle.Generation()) {
+			return nullptr;
+		}
+		return &slot->obj;
+	}
+	T* operator[](THandle handle) const {
+		return Get(handle);
+	}
+	// The handle stops working right away, the slot is reused after the next Reclaim
+	bool Remove(const THandle handle) {
+		const u32 index = handle.Index();
+		u32 generation = handle.Generation();
+		if (index >= highWater.load(std::memory_order_acquire) || (generation & 1) == 0) {
+			return false;
+		}
+		// Only one of several threads removing the same handle gets past this
+		Slot* slot = GetSlot(index);
+		if (!slot->generation.compare_exchange_strong(generation, generation + 1, std::memory_order_acq_rel)) {
+			return false;
+		}
+		count.fetch_sub(1, std::memory_order_relaxed);
+
+		u32 head = pendingHead.load(std::memory_order_relaxed);
+		do {
+			slot->next.store(head, std::memory_order_relaxed);
+		} while (!pendingHead.compare_exchange_weak(head, index, std::memory_order_release, std::memory_order_relaxed));
+		return true;
+	}
+	// Makes removed slots available to Add again. Call when no thread holds pointers to removed objects anymore
+	void Reclaim() {
+		u32 index = pendingHead.exchange(invalidIndex, std::memory_order_acquire);
+		while (index != invalidIndex) {
+			const u32 next = GetSlot(index)->next.load(std::memory_order_relaxed);
+			PushFree(index);
+			index = next;
+		}
+	}
+	u32 Count() const {
+		return count.load(std::memory_order_relaxed);
+	}
+	// Slots that have ever been used, for iterating with GetSlotHandle
+	u32 SlotCount() const {
+		return highWater.load(std::memory_order_acquire);
+	}
+	// Handle of the object in a slot, false if the slot is free
+	bool GetSlotHandle(u32 index, THandle& outHandle) const {
+		if (index >= SlotCount()) {
+			return false;
+		}
+		const u32 generation = GetSlot(index)->generation.load(std::memory_order_acquire);
+		if ((generation & 1) == 0) {
+			return false;
+		}
+		outHandle = THandle(index, generation);
+		return true;
+	}
+};
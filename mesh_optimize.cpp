@@ -0,0 +1,317 @@
+#include "mesh_optimize.h"
+#include "system.h"
+#include "math.h"
+#include "meshoptimizer.h"
+#include <cstring>
+#include <cstdlib>
+
+constexpr u32 meshOptimizeStreamCount = 7;
+
+enum MeshOptimizeStage {
+	MESH_OPTIMIZE_ORIGINAL,
+	MESH_OPTIMIZE_WELD,
+	MESH_OPTIMIZE_VERTEX_CACHE,
+	MESH_OPTIMIZE_OVERDRAW,
+	MESH_OPTIMIZE_VERTEX_FETCH,
+	MESH_OPTIMIZE_STAGE_COUNT
+};
+
+static const char* meshOptimizeStageNames[MESH_OPTIMIZE_STAGE_COUNT] = {
+	"original",
+	"weld",
+	"vertex cache",
+	"overdraw",
+	"vertex fetch"
+};
+
+// Summed over all submeshes so the whole mesh can be reported at once
+struct MeshOptimizeStats {
+	u64 verticesTransformed;
+	u64 vertexCount;
+	u64 bytesFetched;
+};
+
+static void AddStats(MeshOptimizeStats& stats, const u32* indices, u32 indexCount, u32 vertexCount, u32 vertexSize) {
+	const meshopt_VertexCacheStatistics cache = meshopt_analyzeVertexCache(indices, indexCount, vertexCount, meshOptimizeCacheSize, 0, 0);
+	const meshopt_VertexFetchStatistics fetch = meshopt_analyzeVertexFetch(indices, indexCount, vertexCount, vertexSize);
+	stats.verticesTransformed += cache.vertices_transformed;
+	stats.vertexCount += vertexCount;
+	stats.bytesFetched += fetch.bytes_fetched;
+}
+
+void OptimizeMesh(Rendering::MeshCreateInfo& info, const char* name) {
+	if (info.triangleCount == 0 || info.vertexCount == 0) {
+		return;
+	}
+
+	u8** streams[meshOptimizeStreamCount] = { (u8**)&info.position, (u8**)&info.texcoord0, (u8**)&info.normal, (u8**)&info.tangent, (u8**)&info.color, (u8**)&info.joints, (u8**)&info.weights };
+	const u32 streamSizes[meshOptimizeStreamCount] = { sizeof(glm::vec3), sizeof(glm::vec2), sizeof(glm::vec3), sizeof(glm::vec4), sizeof(Rendering::Color), sizeof(Rendering::VertexJoints), sizeof(glm::vec4) };
+
+	// Welding only ever removes vertices, so the original count is enough for the new streams
+	u8* newStreams[meshOptimizeStreamCount]{};
+	u32 vertexSize = 0;
+	for (u32 s = 0; s < meshOptimizeStreamCount; s++) {
+		if (*streams[s] != nullptr) {
+			newStreams[s] = (u8*)malloc((u64)info.vertexCount * streamSizes[s]);
+			vertexSize += streamSizes[s];
+		}
+	}
+
+	const u32 indexCount = info.triangleCount * 3;
+	u32* indices = (u32*)malloc(sizeof(u32) * indexCount);
+	for (u32 i = 0; i < indexCount; i++) {
+		indices[i] = info.triangles16 != nullptr ? info.triangles16[i / 3].index[i % 3] : info.triangles[i / 3].index[i % 3];
+	}
+
+	Rendering::Submesh wholeMesh{};
+	wholeMesh.lodCount = 1;
+	wholeMesh.lods[0] = { 0, info.triangleCount, 0.0f };
+	const u32 submeshCount = info.submeshes != nullptr ? info.submeshCount : 1;
+	Rendering::Submesh* submeshes = info.submeshes != nullptr ? info.submeshes : &wholeMesh;
+
+	MeshOptimizeStats stats[MESH_OPTIMIZE_STAGE_COUNT]{};
+	u32* remap = (u32*)malloc(sizeof(u32) * info.vertexCount);
+	u32 newVertexCount = 0;
+	for (u32 i = 0; i < submeshCount; i++) {
+		Rendering::Submesh& submesh = submeshes[i];
+		u32* subIndices = indices + submesh.lods[0].firstTriangle * 3;
+		const u32 subIndexCount = submesh.lods[0].triangleCount * 3;
+
+		// Submeshes don't store their vertex range, but the indices tell it
+		u32 subVertexCount = 0;
+		for (u32 j = 0; j < subIndexCount; j++) {
+			subVertexCount = subIndices[j] + 1 > subVertexCount ? subIndices[j] + 1 : subVertexCount;
+		}
+		AddStats(stats[MESH_OPTIMIZE_ORIGINAL], subIndices, subIndexCount, subVertexCount, vertexSize);
+
+		meshopt_Stream subStreams[meshOptimizeStreamCount];
+		u32 subStreamCount = 0;
+		for (u32 s = 0; s < meshOptimizeStreamCount; s++) {
+			if (*streams[s] != nullptr) {
+				subStreams[subStreamCount++] = { *streams[s] + (u64)submesh.vertexOffset * streamSizes[s], streamSizes[s], streamSizes[s] };
+			}
+		}
+
+		const u32 uniqueCount = meshopt_generateVertexRemapMulti(remap, subIndices, subIndexCount, subVertexCount, subStreams, subStreamCount);
+		meshopt_remapIndexBuffer(subIndices, subIndices, subIndexCount, remap);
+		for (u32 s = 0; s < meshOptimizeStreamCount; s++) {
+			if (*streams[s] != nullptr) {
+				meshopt_remapVertexBuffer(newStreams[s] + (u64)newVertexCount * streamSizes[s], *streams[s] + (u64)submesh.vertexOffset * streamSizes[s], subVertexCount, streamSizes[s], remap);
+			}
+		}
+		AddStats(stats[MESH_OPTIMIZE_WELD], subIndices, subIndexCount, uniqueCount, vertexSize);
+
+		meshopt_optimizeVertexCache(subIndices, subIndices, subIndexCount, uniqueCount);
+		AddStats(stats[MESH_OPTIMIZE_VERTEX_CACHE], subIndices, subIndexCount, uniqueCount, vertexSize);
+
+		if (newStreams[0] != nullptr) {
+			const r32* positions = (const r32*)(newStreams[0] + (u64)newVertexCount * sizeof(glm::vec3));
+			meshopt_optimizeOverdraw(subIndices, subIndices, subIndexCount, positions, uniqueCount, sizeof(glm::vec3), meshOptimizeOverdrawThreshold);
+		}
+		AddStats(stats[MESH_OPTIMIZE_OVERDRAW], subIndices, subIndexCount, uniqueCount, vertexSize);
+
+		meshopt_optimizeVertexFetchRemap(remap, subIndices, subIndexCount, uniqueCount);
+		meshopt_remapIndexBuffer(subIndices, subIndices, subIndexCount, remap);
+		for (u32 s = 0; s < meshOptimizeStreamCount; s++) {
+			if (newStreams[s] != nullptr) {
+				u8* subStream = newStreams[s] + (u64)newVertexCount * streamSizes[s];
+				meshopt_remapVertexBuffer(subStream, subStream, uniqueCount, streamSizes[s], remap);
+			}
+		}
+		AddStats(stats[MESH_OPTIMIZE_VERTEX_FETCH], subIndices, subIndexCount, uniqueCount, vertexSize);
+
+		submesh.vertexOffset = newVertexCount;
+		newVertexCount += uniqueCount;
+	}
+	free(remap);
+
+	// Welding can't push indices over 16 bits, so the index width stays the same
+	for (u32 i = 0; i < indexCount; i++) {
+		if (info.triangles16 != nullptr) {
+			info.triangles16[i / 3].index[i % 3] = (u16)indices[i];
+		}
+		else {
+			info.triangles[i / 3].index[i % 3] = indices[i];
+		}
+	}
+	free(indices);
+
+	for (u32 s = 0; s < meshOptimizeStreamCount; s++) {
+		free(*streams[s]);
+		*streams[s] = newStreams[s];
+	}
+	info.vertexCount = newVertexCount;
+
+	// ACMR = transformed vertices per triangle, ATVR = transformed vertices per unique vertex, both 1.0 at best
+	for (u32 i = 0; i < MESH_OPTIMIZE_STAGE_COUNT; i++) {
+		const MeshOptimizeStats& stage = stats[i];
+		DEBUG_LOG("Mesh %s %s: %llu vertices, ACMR %.3f, ATVR %.3f, overfetch %.3f", name, meshOptimizeStageNames[i],
+			(unsigned long long)stage.vertexCount,
+			(r32)stage.verticesTransformed / info.triangleCount,
+			(r32)stage.verticesTransformed / stage.vertexCount,
+			(r32)stage.bytesFetched / (stage.vertexCount * vertexSize));
+	}
+}
+
+void GenerateMeshLods(Rendering::MeshCreateInfo& info, const char* name) {
+	if (info.position == nullptr || info.triangleCount == 0) {
+		return;
+	}
+
+	if (info.submeshes == nullptr) {
+		info.submeshCount = 1;
+		info.submeshes = (Rendering::Submesh*)calloc(1, sizeof(Rendering::Submesh));
+		info.submeshes[0].lodCount = 1;
+		info.submeshes[0].lods[0] = { 0, info.triangleCount, 0.0f };
+	}
+
+	// The simplifier never outputs more than it's given, so each LOD fits in the full detail count
+	const u32 baseIndexCount = info.triangleCount * 3;
+	u32* indices = (u32*)malloc(sizeof(u32) * baseIndexCount * (Rendering::maxLodCount + 1));
+	for (u32 i = 0; i < baseIndexCount; i++) {
+		indices[i] = info.triangles16 != nullptr ? info.triangles16[i / 3].index[i % 3] : info.triangles[i / 3].index[i % 3];
+	}
+	u32 indexCount = baseIndexCount;
+
+	for (u32 i = 0; i < info.submeshCount; i++) {
+		Rendering::Submesh& submesh = info.submeshes[i];
+		const u32* baseIndices = indices + submesh.lods[0].firstTriangle * 3;
+		const u32 baseCount = submesh.lods[0].triangleCount * 3;
+
+		u32 subVertexCount = 0;
+		for (u32 j = 0; j < baseCount; j++) {
+			subVertexCount = baseIndices[j] + 1 > subVertexCount ? baseIndices[j] + 1 : subVertexCount;
+		}
+		const r32* positions = (const r32*)(info.position + submesh.vertexOffset);
+		// Simplification error is relative, this turns it into mesh units
+		const r32 scale = meshopt_simplifyScale(positions, subVertexCount, sizeof(glm::vec3));
+
+		submesh.lodCount = 1;
+		while (submesh.lodCount < Rendering::maxLodCount) {
+			const Rendering::SubmeshLod& previous = submesh.lods[submesh.lodCount - 1];
+			const u32 previousCount = previous.triangleCount * 3;
+			const u32 targetCount = (u32)(previous.triangleCount * meshLodReduction) * 3;
+			if (targetCount < meshLodMinTriangles * 3) {
+				break;
+			}
+
+			// Simplifying the previous level instead of the full detail one is faster
+			// The step errors add up, the sum bounds this level's deviation from full detail
+			u32* lodIndices = indices + indexCount;
+			r32 error = 0.0f;
+			const u32 lodCount = meshopt_simplify(lodIndices, indices + previous.firstTriangle * 3, previousCount, positions, subVertexCount, sizeof(glm::vec3), targetCount, meshLodMaxError, 0, &error);
+			if (lodCount == 0 || lodCount > previousCount * 0.85f) {
+				// Hit the error limit before getting meaningfully smaller
+				break;
+			}
+
+			meshopt_optimizeVertexCache(lodIndices, lodIndices, lodCount, subVertexCount);
+
+			Rendering::SubmeshLod& lod = submesh.lods[submesh.lodCount++];
+			lod.firstTriangle = indexCount / 3;
+			lod.triangleCount = lodCount / 3;
+			lod.error = previous.error + error * scale;
+			indexCount += lodCount;
+
+			DEBUG_LOG("Mesh %s submesh %d LOD %d: %d triangles, error %f", name, i, submesh.lodCount - 1, lod.triangleCount, lod.error);
+		}
+	}
+
+	info.triangleCount = indexCount / 3;
+	if (info.triangles16 != nullptr) {
+		info.triangles16 = (Rendering::Triangle16*)realloc(info.triangles16, sizeof(Rendering::Triangle16) * info.triangleCount);
+		for (u32 i = 0; i < indexCount; i++) {
+			info.triangles16[i / 3].index[i % 3] = (u16)indices[i];
+		}
+	}
+	else {
+		info.triangles = (Rendering::Triangle*)realloc(info.triangles, sizeof(Rendering::Triangle) * info.triangleCount);
+		for (u32 i = 0; i < indexCount; i++) {
+			info.triangles[i / 3].index[i % 3] = indices[i];
+		}
+	}
+	free(indices);
+}
+
+void BuildMeshlets(Rendering::MeshCreateInfo& info, const char* name) {
+	// Meshlet bounds only hold in the bind pose
+	if (info.position == nullptr || info.submeshes == nullptr || info.joints != nullptr) {
+		return;
+	}
+
+	u32 baseTriangleCount = 0;
+	u64 maxMeshletCount = 0;
+	for (u32 i = 0; i < info.submeshCount; i++) {
+		const Rendering::SubmeshLod& base = info.submeshes[i].lods[0];
+		baseTriangleCount += base.triangleCount;
+		maxMeshletCount += meshopt_buildMeshletsBound(base.triangleCount * 3, Rendering::meshletMaxVertices, Rendering::meshletMaxTriangles);
+	}
+	if (baseTriangleCount < meshletMinTriangles) {
+		return;
+	}
+
+	meshopt_Meshlet* meshlets = (meshopt_Meshlet*)malloc(sizeof(meshopt_Meshlet) * maxMeshletCount);
+	u32* meshletVertices = (u32*)malloc(sizeof(u32) * maxMeshletCount * Rendering::meshletMaxVertices);
+	u8* meshletTriangles = (u8*)malloc(maxMeshletCount * Rendering::meshletMaxTriangles * 3);
+	u32* indices = (u32*)malloc(sizeof(u32) * baseTriangleCount * 3);
+	info.meshlets = (Rendering::Meshlet*)calloc(maxMeshletCount, sizeof(Rendering::Meshlet));
+	info.meshletCount = 0;
+
+	for (u32 i = 0; i < info.submeshCount; i++) {
+		Rendering::Submesh& submesh = info.submeshes[i];
+		const Rendering::SubmeshLod& base = submesh.lods[0];
+		const u32 indexCount = base.triangleCount * 3;
+		for (u32 j = 0; j < indexCount; j++) {
+			const u32 index = base.firstTriangle * 3 + j;
+			indices[j] = info.triangles16 != nullptr ? info.triangles16[index / 3].index[index % 3] : info.triangles[index / 3].index[index % 3];
+		}
+
+		u32 subVertexCount = 0;
+		for (u32 j = 0; j < indexCount; j++) {
+			subVertexCount = indices[j] + 1 > subVertexCount ? indices[j] + 1 : subVertexCount;
+		}
+		const r32* positions = (const r32*)(info.position + submesh.vertexOffset);
+
+		const u32 meshletCount = meshopt_buildMeshlets(meshlets, meshletVertices, meshletTriangles, indices, indexCount, positions, subVertexCount, sizeof(glm::vec3), Rendering::meshletMaxVertices, Rendering::meshletMaxTriangles, meshletConeWeight);
+
+		submesh.firstMeshlet = info.meshletCount;
+		submesh.meshletCount = meshletCount;
+
+		// Every triangle ends up in exactly one meshlet, so the reordered triangles fill the same range
+		u32 triangle = base.firstTriangle;
+		for (u32 m = 0; m < meshletCount; m++) {
+			const meshopt_Meshlet& meshlet = meshlets[m];
+			const u32* vertices = meshletVertices + meshlet.vertex_offset;
+			const u8* triangles = meshletTriangles + meshlet.triangle_offset;
+			const meshopt_Bounds bounds = meshopt_computeMeshletBounds(vertices, triangles, meshlet.triangle_count, positions, subVertexCount, sizeof(glm::vec3));
+
+			Rendering::Meshlet& out = info.meshlets[info.meshletCount++];
+			out.center = glm::vec3(bounds.center[0], bounds.center[1], bounds.center[2]);
+			out.radius = bounds.radius;
+			out.coneApex = glm::vec3(bounds.cone_apex[0], bounds.cone_apex[1], bounds.cone_apex[2]);
+			out.coneAxis = glm::vec3(bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2]);
+			out.coneCutoff = bounds.cone_cutoff;
+			out.firstTriangle = triangle;
+			out.triangleCount = meshlet.triangle_count;
+
+			for (u32 t = 0; t < meshlet.triangle_count; t++, triangle++) {
+				for (u32 k = 0; k < 3; k++) {
+					const u32 index = vertices[triangles[t * 3 + k]];
+					if (info.triangles16 != nullptr) {
+						info.triangles16[triangle].index[k] = (u16)index;
+					}
+					else {
+						info.triangles[triangle].index[k] = index;
+					}
+				}
+			}
+		}
+	}
+
+	DEBUG_LOG("Mesh %s: %d meshlets for %d triangles", name, info.meshletCount, baseTriangleCount);
+
+	free(indices);
+	free(meshletTriangles);
+	free(meshletVertices);
+	free(meshlets);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "rendering.h"
+
+constexpr u32 meshOptimizeCacheSize = 16; // Post-transform cache size to optimize and report for
+constexpr r32 meshOptimizeOverdrawThreshold = 1.05f; // How much vertex cache efficiency overdraw sorting may cost
+constexpr r32 meshLodReduction = 0.5f; // Target triangle count of each LOD relative to the previous one
+constexpr r32 meshLodMaxError = 0.05f; // Relative to the mesh extents
+constexpr u32 meshLodMinTriangles = 32; // Don't bother simplifying below this
+constexpr u32 meshletMinTriangles = 4096; // Smaller meshes are cheaper to draw whole than to cull per cluster
+constexpr r32 meshletConeWeight = 0.25f; // Favors clusters with narrow normal cones over compact ones
+
+// Welds identical vertices, then reorders triangles for the vertex cache and overdraw, and vertices for fetch locality
+// Each submesh is processed on its own. Vertex streams are replaced, so they have to be malloc'd (like the glTF importer's)
+void OptimizeMesh(Rendering::MeshCreateInfo& info, const char* name);
+// Simplifies every submesh into up to maxLodCount - 1 coarser levels, appended after the existing triangles
+// Run after OptimizeMesh, the LODs reuse its vertices. Same allocation rules apply
+void GenerateMeshLods(Rendering::MeshCreateInfo& info, const char* name);
+// Splits the full detail triangles of big meshes into meshlets with bounding spheres and normal cones
+// The triangles are reordered so every meshlet is a contiguous range. Skinned meshes are skipped. Same allocation rules apply
+void BuildMeshlets(Rendering::MeshCreateInfo& info, const char* name);
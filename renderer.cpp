@@ -1,14 +1,20 @@
 #include "renderer.h"
 #include "system.h"
+#include "math.h"
+#include "scene.h"
 #include <algorithm>
 #include <math.h>
+#include <cstring>
 
 namespace Rendering {
+	// Only the handle indices go into the key for sorting, the full handles are in DrawcallData
+	// Meshes get 24 bits since the mesh pool grows, materials are capped at maxMaterialCount so 16 is plenty
+	static_assert(maxDrawcallCount <= 0x10000, "Drawcall data index doesn't fit in the sort key");
 	Drawcall::Drawcall(u16 dataIndex, MeshHandle mesh, MaterialHandle mat, RenderLayer layer) {
 		id = 0;
-		id += (u64)(dataIndex % 0x1000);
-		id += (u64)mesh << 12ull;
-		id += (u64)mat << 20ull;
+		id += (u64)dataIndex;
+		id += (u64)(mesh & 0xffffff) << 16ull;
+		id += (u64)(mat & 0xffff) << 40ull;
 		id += (u64)layer << 56ull;
 	}
 
@@ -21,65 +27,295 @@ namespace Rendering {
 	RenderLayer Drawcall::Layer() const {
 		return (RenderLayer)(id >> 56ull);
 	}
-	MaterialHandle Drawcall::Material() const {
-		return (MaterialHandle)((id >> 20ull) % 0x1000);
-	}
-	MeshHandle Drawcall::Mesh() const {
-		return (MeshHandle)((id >> 12ull) % 0x100);
-	}
 	u16 Drawcall::DataIndex() const {
-		return (u16)(id % 0x1000);
+		return (u16)(id % 0x10000);
 	}
 
 
-	Renderer::Renderer(const XR::XRInstance* const xrInstance): vulkan(xrInstance) {
-		drawcallData = (DrawcallData*)calloc(maxDrawcallCount, sizeof(DrawcallData));
+	Renderer::Renderer(const XR::XRInstance* const xrInstance): frameArena(frameArenaSize, maxFramesInFlight), vulkan(xrInstance) {
 		instanceData = vulkan.GetInstanceDataPtr(instanceDataStride);
-
-		renderQueue = (Drawcall*)calloc(maxDrawcallCount, sizeof(Drawcall));
+		jointData = vulkan.GetJointDataPtr();
+		jointDataCount = 0;
+		lodBias = 1.0f;
+		clusterRangeCount = 0;
+		resourceMemoryBudget = defaultResourceMemoryBudget;
+		frameNumber = 0;
+		retiredResourceFirst = 0;
+		retiredResourceCount = 0;
+		cameraLateLatch = nullptr;
+		cameraLateLatchUserData = nullptr;
+
+		AllocateFrameData();
 		drawcallCount = 0;
 		instanceCount = 0;
 
 		cameraData = (CameraData*)vulkan.GetCameraDataPtr();
+		camera = {};
+		vulkan.GetRenderResolution(renderWidth, renderHeight);
 		lightingData = (LightingData*)vulkan.GetLightingDataPtr();
 	}
 
-	Renderer::~Renderer() {
-		free(drawcallData);
-		free(renderQueue);
+	void Renderer::AllocateFrameData() {
+		drawcallData = frameArena.AllocateArray<DrawcallData>(maxDrawcallCount);
+		renderQueue = frameArena.AllocateArray<Drawcall>(maxDrawcallCount);
+		clusterRanges = frameArena.AllocateArray<SubmeshLod>(maxClusterRangeCount);
 	}
 
 	void Renderer::CreateXRSwapchain(const XR::XRInstance* const xrInstance) {
 		vulkan.CreateXRSwapchain(xrInstance);
 	}
 
-	MeshHandle Renderer::CreateMesh(std::string name, const MeshCreateInfo& info) {
-		/*if (meshNameMap.contains(name)) {
-			DEBUG_ERROR("Mesh with name %s already exists", name.c_str());
+	static inline u64 RotateLeft(u64 x, u32 r) {
+		return (x << r) | (x >> (64 - r));
+	}
+
+	// MurmurHash3 finalizer, every input bit affects every output bit
+	static inline u64 MixBits(u64 x) {
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdull;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ull;
+		x ^= x >> 33;
+		return x;
+	}
+
+	// Stale entries of IDs that were reused for another resource are told apart on eviction
+	static void SetResourceId(std::unordered_map<ResourceId, u64>& map, std::unordered_multimap<u64, ResourceId>& reverseMap, ResourceId id, u64 handle) {
+		map[id] = handle;
+		auto range = reverseMap.equal_range(handle);
+		for (auto it = range.first; it != range.second; it++) {
+			if (it->second == id) {
+				return;
+			}
+		}
+		reverseMap.emplace(handle, id);
+	}
+
+	// MurmurHash3 style: each word is scrambled before it's folded in, the zero padded tail is one more word
+	static u64 HashBytes(u64 hash, const void* data, size_t size) {
+		constexpr u64 c1 = 0x87c37b91114253d5ull;
+		constexpr u64 c2 = 0x4cf5ad432745937full;
+		const u8* bytes = (const u8*)data;
+		size_t i = 0;
+		for (; i + sizeof(u64) <= size; i += sizeof(u64)) {
+			u64 word;
+			memcpy(&word, bytes + i, sizeof(u64));
+			hash ^= RotateLeft(word * c1, 31) * c2;
+			hash = RotateLeft(hash, 27) * 5 + 0x52dce729;
+		}
+		if (i < size) {
+			u64 word = 0;
+			memcpy(&word, bytes + i, size - i);
+			hash ^= RotateLeft(word * c1, 31) * c2;
+		}
+		return MixBits(hash ^ size);
+	}
+
+	// Meshlets are derived from the rest, so they're left out. Different seeds give independent hashes
+	static u64 HashMeshContent(const MeshCreateInfo& info, u64 seed) {
+		u64 hash = seed;
+		const u32 header[4] = { info.vertexCount, info.triangleCount, info.submeshCount, (u32)info.vertexFormat };
+		hash = HashBytes(hash, header, sizeof(header));
+
+		// Which streams are present matters too, so hash a marker for missing ones
+		const void* streams[vertexStreamCount] = { info.position, info.texcoord0, info.normal, info.tangent, info.color, info.joints, info.weights };
+		for (u32 i = 0; i < vertexStreamCount; i++) {
+			const bool encoded = info.encodedStreams[i] != nullptr;
+			const u8 present = encoded ? 2 : streams[i] != nullptr;
+			hash = HashBytes(hash, &present, 1);
+			if (present) {
+				const u32 stride = vertexStreamStrides[i][encoded ? info.vertexFormat : VERTEX_FORMAT_FLOAT];
+				hash = HashBytes(hash, encoded ? info.encodedStreams[i] : streams[i], (size_t)stride * info.vertexCount);
+			}
+		}
+		if (info.encodedStreams[0] != nullptr) {
+			hash = HashBytes(hash, &info.encodedQuantization, sizeof(VertexQuantizationData));
+		}
+
+		if (info.triangles16 != nullptr) {
+			hash = HashBytes(hash, info.triangles16, sizeof(Triangle16) * info.triangleCount);
+		}
+		else if (info.triangles != nullptr) {
+			hash = HashBytes(hash, info.triangles, sizeof(Triangle) * info.triangleCount);
+		}
+		if (info.submeshes != nullptr) {
+			hash = HashBytes(hash, info.submeshes, sizeof(Submesh) * info.submeshCount);
+		}
+		return hash;
+	}
+
+	static glm::vec3 GetVertexPosition(const MeshCreateInfo& info, u32 index) {
+		if (info.encodedStreams[0] == nullptr) {
+			return info.position[index];
+		}
+
+		// Quantized positions are snorm16, scaled to the mesh bounds
+		const s16* encoded = (const s16*)info.encodedStreams[0] + (u64)index * 4;
+		const glm::vec3 snorm = glm::max(glm::vec3(encoded[0], encoded[1], encoded[2]) / 32767.0f, glm::vec3(-1.0f));
+		return snorm * glm::vec3(info.encodedQuantization.positionScale) + glm::vec3(info.encodedQuantization.positionOffset);
+	}
+
+	MeshHandle Renderer::ReserveMesh() {
+		return vulkan.ReserveMesh();
+	}
+
+	void Renderer::CancelMesh(MeshHandle reserved) {
+		vulkan.CancelMesh(reserved);
+	}
+
+	MeshHandle Renderer::CreateMesh(ResourceId id, const MeshCreateInfo& info) {
+		return CreateMesh(id, info, vulkan.ReserveMesh());
+	}
+
+	MeshHandle Renderer::CreateMesh(ResourceId id, const MeshCreateInfo& info, MeshHandle reserved) {
+		/*if (meshIdMap.contains(id)) {
+			DEBUG_ERROR("Mesh with name %s already exists", GetResourceName(id));
 		}*/
 
-		if (info.triangles == nullptr) {
+		if (info.triangles == nullptr && info.triangles16 == nullptr) {
 			DEBUG_ERROR("Triangles cannot be null");
 		}
 
-		auto handle = vulkan.CreateMesh(info);
-		meshNameMap[name] = handle;
+		// Keeping a copy of the contents to compare would double the memory, so a hit has to match a second hash as well
+		const u64 contentHash = HashMeshContent(info, 0xcbf29ce484222325ull);
+		const u64 contentCheck = HashMeshContent(info, 0x9e3779b97f4a7c15ull);
+		bool collision = false;
+		auto existing = meshHashMap.find(contentHash);
+		if (existing != meshHashMap.end()) {
+			const MeshMetadata& existingMetadata = meshMetadataMap.at(existing->second);
+			if (existingMetadata.contentCheck == contentCheck && existingMetadata.vertexCount == info.vertexCount &&
+				existingMetadata.triangleCount == info.triangleCount && existingMetadata.submeshCount == info.submeshCount) {
+				vulkan.CancelMesh(reserved);
+				resourceCache.AddReference(RESOURCE_MESH, existing->second);
+				SetResourceId(meshIdMap, resourceIds[RESOURCE_MESH], id, existing->second);
+				DEBUG_LOG("Mesh %s has the same content as an existing mesh, sharing it (%d references)", GetResourceName(id), resourceCache.GetReferenceCount(RESOURCE_MESH, existing->second));
+				return existing->second;
+			}
+
+			DEBUG_LOG("Mesh %s collides with the content hash of a different mesh, not sharing it", GetResourceName(id));
+			collision = true;
+		}
+
+		MeshMetadata metadata{};
+		metadata.contentHash = contentHash;
+		metadata.contentCheck = contentCheck;
+		metadata.vertexCount = info.vertexCount;
+		metadata.triangleCount = info.triangleCount;
+		metadata.submeshCount = info.submeshCount;
+		if ((info.position != nullptr || info.encodedStreams[0] != nullptr) && info.vertexCount > 0) {
+			glm::vec3 min = GetVertexPosition(info, 0);
+			glm::vec3 max = min;
+			for (u32 i = 1; i < info.vertexCount; i++) {
+				const glm::vec3 position = GetVertexPosition(info, i);
+				min = glm::min(min, position);
+				max = glm::max(max, position);
+			}
+
+			metadata.bounds.center = (min + max) * 0.5f;
+			metadata.bounds.radius = 0.0f;
+			for (u32 i = 0; i < info.vertexCount; i++) {
+				metadata.bounds.radius = MAX(metadata.bounds.radius, glm::length(GetVertexPosition(info, i) - metadata.bounds.center));
+			}
+		}
+
+		// Joint indices are stored the same way in every vertex format
+		const VertexJoints* joints = info.encodedStreams[5] != nullptr ? (const VertexJoints*)info.encodedStreams[5] : info.joints;
+		const bool weighted = info.weights != nullptr || info.encodedStreams[6] != nullptr;
+		if (joints != nullptr && weighted) {
+			for (u32 i = 0; i < info.vertexCount; i++) {
+				for (u32 j = 0; j < 4; j++) {
+					metadata.jointCount = MAX(metadata.jointCount, (u32)joints[i].index[j] + 1);
+				}
+			}
+		}
+
+		// Instances pick one LOD level for all submeshes, so go by the worst error at each level
+		metadata.lodCount = 1;
+		metadata.lodErrors[0] = 0.0f;
+		for (u32 i = 0; i < info.submeshCount && info.submeshes != nullptr; i++) {
+			const Submesh& submesh = info.submeshes[i];
+			metadata.lodCount = MAX(metadata.lodCount, submesh.lodCount);
+		}
+		for (u32 lod = 1; lod < metadata.lodCount; lod++) {
+			metadata.lodErrors[lod] = 0.0f;
+			for (u32 i = 0; i < info.submeshCount; i++) {
+				const Submesh& submesh = info.submeshes[i];
+				metadata.lodErrors[lod] = MAX(metadata.lodErrors[lod], submesh.lods[MIN(lod, submesh.lodCount - 1)].error);
+			}
+		}
+
+		auto handle = vulkan.CreateMesh(info, reserved);
+		SetResourceId(meshIdMap, resourceIds[RESOURCE_MESH], id, handle);
+		if (!collision) {
+			meshHashMap[contentHash] = handle;
+		}
+		meshMetadataMap[handle] = metadata;
+		resourceCache.Add(RESOURCE_MESH, handle, vulkan.GetMeshMemorySize(handle));
 		return handle;
 	}
 
-	TextureHandle Renderer::CreateTexture(std::string name, const TextureCreateInfo& info) {
-		/*if (textureNameMap.contains(name)) {
-			DEBUG_ERROR("Texture with name %s already exists", name.c_str());
+	void Renderer::AcquireMesh(MeshHandle handle) {
+		resourceCache.AddReference(RESOURCE_MESH, handle);
+	}
+
+	void Renderer::ReleaseMesh(MeshHandle handle) {
+		resourceCache.RemoveReference(RESOURCE_MESH, handle);
+	}
+
+	// Unknown meshes get empty bounds, they aren't drawn anyway
+	const MeshBounds& Renderer::GetMeshBounds(MeshHandle mesh) {
+		static const MeshBounds emptyBounds{};
+		auto it = meshMetadataMap.find(mesh);
+		return it != meshMetadataMap.end() ? it->second.bounds : emptyBounds;
+	}
+
+	u32 Renderer::GetMeshJointCount(MeshHandle mesh) {
+		auto it = meshMetadataMap.find(mesh);
+		return it != meshMetadataMap.end() ? it->second.jointCount : 0;
+	}
+
+	TextureHandle Renderer::ReserveTexture() {
+		return vulkan.ReserveTexture();
+	}
+
+	void Renderer::CancelTexture(TextureHandle reserved) {
+		vulkan.CancelTexture(reserved);
+	}
+
+	TextureHandle Renderer::CreateTexture(ResourceId id, const TextureCreateInfo& info) {
+		return CreateTexture(id, info, vulkan.ReserveTexture());
+	}
+
+	TextureHandle Renderer::CreateTexture(ResourceId id, const TextureCreateInfo& info, TextureHandle reserved) {
+		/*if (textureIdMap.contains(id)) {
+			DEBUG_ERROR("Texture with name %s already exists", GetResourceName(id));
 		}*/
 
-		auto handle = vulkan.CreateTexture(info);
-		textureNameMap[name] = handle;
+		auto handle = vulkan.CreateTexture(info, reserved);
+		SetResourceId(textureIdMap, resourceIds[RESOURCE_TEXTURE], id, handle);
+		resourceCache.Add(RESOURCE_TEXTURE, handle, vulkan.GetTextureMemorySize(handle));
 		return handle;
 	}
 
-	ShaderHandle Renderer::CreateShader(std::string name, const ShaderCreateInfo& info) {
-		/*if (shaderNameMap.contains(name)) {
-			DEBUG_ERROR("Shader with name %s already exists", name.c_str());
+	void Renderer::AcquireTexture(TextureHandle handle) {
+		resourceCache.AddReference(RESOURCE_TEXTURE, handle);
+	}
+
+	void Renderer::ReleaseTexture(TextureHandle handle) {
+		resourceCache.RemoveReference(RESOURCE_TEXTURE, handle);
+	}
+
+	// Keeps the cache's memory use current while streaming changes the resident mips of referenced textures
+	static void UpdateCachedTextureSize(void* userData, TextureHandle texture, u64 residentBytes) {
+		ResourceCache* cache = (ResourceCache*)userData;
+		if (cache->Contains(RESOURCE_TEXTURE, texture)) {
+			cache->SetSize(RESOURCE_TEXTURE, texture, residentBytes);
+		}
+	}
+
+	ShaderHandle Renderer::CreateShader(ResourceId id, const ShaderCreateInfo& info) {
+		/*if (shaderIdMap.contains(id)) {
+			DEBUG_ERROR("Shader with name %s already exists", GetResourceName(id));
 		}*/
 
 		if (info.metadata.dataLayout.dataSize > maxShaderDataBlockSize) {
@@ -87,24 +323,101 @@ namespace Rendering {
 		}
 
 		auto handle = vulkan.CreateShader(info);
-		meshNameMap[name] = handle;
+		shaderIdMap[id] = handle;
 		shaderMetadataMap[handle] = info.metadata;
 		return handle;
 	}
 
-	MaterialHandle Renderer::CreateMaterial(std::string name, const MaterialCreateInfo& info) {
-		/*if (materialNameMap.contains(name)) {
-			DEBUG_ERROR("Material with name %s already exists", name.c_str());
+	MaterialHandle Renderer::CreateMaterial(ResourceId id, const MaterialCreateInfo& info) {
+		/*if (materialIdMap.contains(id)) {
+			DEBUG_ERROR("Material with name %s already exists", GetResourceName(id));
 		}*/
 
 		auto handle = vulkan.CreateMaterial(info);
-		materialNameMap[name] = handle;
+		SetResourceId(materialIdMap, resourceIds[RESOURCE_MATERIAL], id, handle);
 		materialMetadataMap[handle] = info.metadata;
+		resourceCache.Add(RESOURCE_MATERIAL, handle, 0);
+
+		u32 textureCount;
+		const TextureHandle* textures = vulkan.GetMaterialTextures(handle, textureCount);
+		for (u32 i = 0; i < textureCount; i++) {
+			if (resourceCache.Contains(RESOURCE_TEXTURE, textures[i])) {
+				resourceCache.AddReference(RESOURCE_TEXTURE, textures[i]);
+			}
+		}
 		return handle;
 	}
 
+	void Renderer::AcquireMaterial(MaterialHandle handle) {
+		resourceCache.AddReference(RESOURCE_MATERIAL, handle);
+	}
+
+	void Renderer::ReleaseMaterial(MaterialHandle handle) {
+		resourceCache.RemoveReference(RESOURCE_MATERIAL, handle);
+	}
+
+	template <typename THandle>
+	static bool FindResource(const std::unordered_map<ResourceId, THandle>& map, ResourceId id, THandle& outHandle) {
+		auto it = map.find(id);
+		if (it == map.end()) {
+			return false;
+		}
+		outHandle = it->second;
+		return true;
+	}
+
+	bool Renderer::FindMesh(ResourceId id, MeshHandle& outHandle) const {
+		return FindResource(meshIdMap, id, outHandle);
+	}
+
+	bool Renderer::FindTexture(ResourceId id, TextureHandle& outHandle) const {
+		return FindResource(textureIdMap, id, outHandle);
+	}
+
+	bool Renderer::FindShader(ResourceId id, ShaderHandle& outHandle) const {
+		return FindResource(shaderIdMap, id, outHandle);
+	}
+
+	bool Renderer::FindMaterial(ResourceId id, MaterialHandle& outHandle) const {
+		return FindResource(materialIdMap, id, outHandle);
+	}
+
+	void Renderer::UpdateMaterialTexture(MaterialHandle material, u32 index, TextureHandle texture) {
+		u32 textureCount;
+		const TextureHandle* textures = vulkan.GetMaterialTextures(material, textureCount);
+		const bool tracked = index < textureCount;
+		const TextureHandle previous = tracked ? textures[index] : 0;
+		if (tracked && resourceCache.Contains(RESOURCE_TEXTURE, texture)) {
+			resourceCache.AddReference(RESOURCE_TEXTURE, texture);
+		}
+
+		vulkan.UpdateMaterialTexture(material, index, texture);
+
+		if (tracked && resourceCache.Contains(RESOURCE_TEXTURE, previous)) {
+			ReleaseTexture(previous);
+		}
+	}
+
+	void Renderer::SetCameraLateLatch(CameraLateLatch callback, void* userData) {
+		cameraLateLatch = callback;
+		cameraLateLatchUserData = userData;
+	}
+
 	void Renderer::UpdateCameraRaw(const CameraData& data) {
 		*cameraData = data;
+		camera = data;
+
+		for (u32 eye = 0; eye < 2; eye++) {
+			// Columns of the transpose are the rows of the view projection matrix
+			const glm::mat4 viewProj = glm::transpose(data.proj[eye] * data.view[eye]);
+			frustumPlanes[eye][0] = viewProj[3] + viewProj[0];
+			frustumPlanes[eye][1] = viewProj[3] - viewProj[0];
+			frustumPlanes[eye][2] = viewProj[3] + viewProj[1];
+			frustumPlanes[eye][3] = viewProj[3] - viewProj[1];
+			for (u32 i = 0; i < 4; i++) {
+				frustumPlanes[eye][i] /= glm::length(glm::vec3(frustumPlanes[eye][i]));
+			}
+		}
 	}
 
 	/*void Renderer::UpdateMainLight(const Quaternion& rotation, const Color& color) {
@@ -118,28 +431,321 @@ namespace Rendering {
 		lightingData->ambientColor = color;
 	}
 
+	// Approximate diameter of the bounding sphere on screen in pixels, using whichever eye sees it bigger
+	r32 Renderer::GetProjectedDiameter(const MeshBounds& bounds, const glm::mat4x4& transform) const {
+		const glm::vec3 center = glm::vec3(transform * glm::vec4(bounds.center, 1.0f));
+		const r32 scale = MAX(glm::length(glm::vec3(transform[0])), MAX(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+		const r32 radius = bounds.radius * scale;
+
+		r32 result = 0.0f;
+		for (u32 eye = 0; eye < 2; eye++) {
+			const r32 distance = glm::length(center - camera.pos[eye]);
+			if (distance <= radius) {
+				return (r32)renderWidth;
+			}
+
+			result = MAX(result, radius / distance * camera.proj[eye][0][0] * renderWidth);
+		}
+		return result;
+	}
+
 	void Renderer::DrawMesh(MeshHandle mesh, MaterialHandle material, const glm::mat4x4& transform) {
 		DrawMeshInstanced(mesh, material, 1, &transform);
 	}
 
-	void Renderer::DrawMeshInstanced(MeshHandle mesh, MaterialHandle material, u16 count, const glm::mat4x4* transforms) {
-		u16 instanceOffset = instanceCount;
+	// Coarsest LOD whose error stays under the pixel threshold at this size on screen
+	u32 Renderer::SelectLod(const MeshMetadata& metadata, r32 screenPixels) const {
+		const r32 pixelsPerUnit = screenPixels / (2.0f * MAX(metadata.bounds.radius, 0.0001f));
+		const r32 maxError = defaultLodPixelError * lodBias;
+
+		u32 lod = 0;
+		while (lod + 1 < metadata.lodCount && metadata.lodErrors[lod + 1] * pixelsPerUnit <= maxError) {
+			lod++;
+		}
+		return lod;
+	}
+
+	bool Renderer::AllocateInstances(u32 count, u32& outOffset) {
+		if (instanceCount + count > maxInstanceCount) {
+			DEBUG_LOG("Instance buffer full, can't fit %d more instances", count);
+			return false;
+		}
+
+		outOffset = instanceCount;
 		instanceCount += count;
-		u16 callIndex = drawcallCount++;
+		return true;
+	}
 
-		DrawcallData data = { count, instanceOffset };
+	bool Renderer::AddDrawcall(MeshHandle mesh, u32 submesh, u32 lod, MaterialHandle material, u32 instanceOffset, u32 instanceCount) {
+		if (drawcallCount >= maxDrawcallCount) {
+			DEBUG_LOG("Render queue full, drawcall skipped");
+			return false;
+		}
+		const u32 callIndex = drawcallCount++;
 
+		// Submeshes can have fewer LODs than the mesh
+		lod = MIN(lod, vulkan.GetSubmesh(mesh, submesh).lodCount - 1);
+		DrawcallData data = { mesh, material, submesh, lod, instanceCount, instanceOffset, 0, 0, 0, 0 };
 		drawcallData[callIndex] = data;
 
-		// This is bad if I change the size of PerInstanceData...
-		PerInstanceData* instances = (PerInstanceData*)transforms;
-		u64 instanceByteOffset = instanceDataStride * instanceOffset;
-		memcpy(instanceData + instanceByteOffset, instances, sizeof(PerInstanceData) * count);
-
 		RenderLayer layer = shaderMetadataMap[materialMetadataMap[material].shader].layer;
-		Drawcall call(callIndex, mesh, material, layer);
+		Drawcall call((u16)callIndex, mesh, material, layer);
 
 		renderQueue[callIndex] = call;
+		return true;
+	}
+
+	// Near and far planes are left out, the far plane might be at infinity
+	bool Renderer::IsSphereInFrustum(const glm::vec3& center, r32 radius) const {
+		for (u32 eye = 0; eye < 2; eye++) {
+			bool inside = true;
+			for (u32 i = 0; i < 4 && inside; i++) {
+				const glm::vec4& plane = frustumPlanes[eye][i];
+				inside = glm::dot(glm::vec3(plane), center) + plane.w >= -radius;
+			}
+			if (inside) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Renderer::AddClusterDrawcall(MeshHandle mesh, u32 submeshIndex, MaterialHandle material, u32 instanceOffset, const glm::mat4x4& transform) {
+		const Submesh& submesh = vulkan.GetSubmesh(mesh, submeshIndex);
+		if (submesh.meshletCount == 0 || clusterRangeCount + submesh.meshletCount > maxClusterRangeCount) {
+			AddDrawcall(mesh, submeshIndex, 0, material, instanceOffset, 1);
+			return;
+		}
+
+		u32 meshletCount;
+		const Meshlet* meshlets = vulkan.GetMeshlets(mesh, meshletCount) + submesh.firstMeshlet;
+		const r32 scale = MAX(glm::length(glm::vec3(transform[0])), MAX(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+		const glm::mat3 rotation = glm::mat3(transform);
+
+		const u32 firstRange = clusterRangeCount;
+		for (u32 i = 0; i < submesh.meshletCount; i++) {
+			const Meshlet& meshlet = meshlets[i];
+			const glm::vec3 center = glm::vec3(transform * glm::vec4(meshlet.center, 1.0f));
+			if (!IsSphereInFrustum(center, meshlet.radius * scale)) {
+				continue;
+			}
+
+			// Only culled if every triangle faces away from both eyes
+			const glm::vec3 apex = glm::vec3(transform * glm::vec4(meshlet.coneApex, 1.0f));
+			const glm::vec3 axis = glm::normalize(rotation * meshlet.coneAxis);
+			if (glm::dot(glm::normalize(apex - camera.pos[0]), axis) >= meshlet.coneCutoff &&
+				glm::dot(glm::normalize(apex - camera.pos[1]), axis) >= meshlet.coneCutoff) {
+				continue;
+			}
+
+			// Meshlets are stored in order, so neighbours that are both visible merge into one draw
+			SubmeshLod* previous = clusterRangeCount > firstRange ? &clusterRanges[clusterRangeCount - 1] : nullptr;
+			if (previous != nullptr && previous->firstTriangle + previous->triangleCount == meshlet.firstTriangle) {
+				previous->triangleCount += meshlet.triangleCount;
+			}
+			else {
+				clusterRanges[clusterRangeCount++] = { meshlet.firstTriangle, meshlet.triangleCount, 0.0f };
+			}
+		}
+
+		if (clusterRangeCount == firstRange) {
+			return;
+		}
+
+		if (!AddDrawcall(mesh, submeshIndex, 0, material, instanceOffset, 1)) {
+			clusterRangeCount = firstRange;
+			return;
+		}
+		DrawcallData& data = drawcallData[drawcallCount - 1];
+		data.firstClusterRange = firstRange;
+		data.clusterRangeCount = clusterRangeCount - firstRange;
+	}
+
+	void Renderer::DrawMeshInstanced(MeshHandle mesh, MaterialHandle material, u32 count, const glm::mat4x4* transforms) {
+		auto metadataIt = meshMetadataMap.find(mesh);
+		if (metadataIt == meshMetadataMap.end()) {
+			DEBUG_LOG("Mesh %llu doesn't exist or was evicted, not drawn", (unsigned long long)mesh);
+			return;
+		}
+		const MeshMetadata& metadata = metadataIt->second;
+
+		FrameArena::Scope scratch(frameArena);
+		u8* instanceLods = frameArena.AllocateArray<u8>(count);
+		if (instanceLods == nullptr) {
+			return;
+		}
+		u32 offset;
+		if (!AllocateInstances(count, offset)) {
+			return;
+		}
+		u32 lodInstanceCounts[maxLodCount]{};
+		r32 screenPixels = 0.0f;
+		for (u32 i = 0; i < count; i++) {
+			const r32 diameter = GetProjectedDiameter(metadata.bounds, transforms[i]);
+			screenPixels = MAX(screenPixels, diameter);
+			instanceLods[i] = SelectLod(metadata, diameter);
+			lodInstanceCounts[instanceLods[i]]++;
+		}
+
+		// Let texture streaming know how much detail this material needs
+		vulkan.RequestMaterialTextureResolution(material, screenPixels);
+
+		// Instances are grouped by LOD so each group can be drawn with one call
+		u32 lodInstanceOffsets[maxLodCount];
+		for (u32 lod = 0; lod < metadata.lodCount; lod++) {
+			lodInstanceOffsets[lod] = offset;
+			offset += lodInstanceCounts[lod];
+		}
+
+		// Full detail instances of clustered meshes are culled and drawn one by one
+		u32 meshletCount;
+		const bool clustered = vulkan.GetMeshlets(mesh, meshletCount) != nullptr;
+		const u32 submeshCount = vulkan.GetSubmeshCount(mesh);
+
+		u32 lodInstanceWritten[maxLodCount]{};
+		for (u32 i = 0; i < count; i++) {
+			const u8 lod = instanceLods[i];
+			const u32 instanceOffset = lodInstanceOffsets[lod] + lodInstanceWritten[lod]++;
+			memcpy(instanceData + (u64)instanceDataStride * instanceOffset, &transforms[i], sizeof(PerInstanceData));
+
+			if (clustered && lod == 0) {
+				for (u32 j = 0; j < submeshCount; j++) {
+					AddClusterDrawcall(mesh, j, material, instanceOffset, transforms[i]);
+				}
+			}
+		}
+
+		for (u32 lod = 0; lod < metadata.lodCount; lod++) {
+			if (lodInstanceCounts[lod] == 0 || (clustered && lod == 0)) {
+				continue;
+			}
+
+			for (u32 i = 0; i < submeshCount; i++) {
+				AddDrawcall(mesh, i, lod, material, lodInstanceOffsets[lod], lodInstanceCounts[lod]);
+			}
+		}
+	}
+
+	void Renderer::DrawModel(MeshHandle mesh, const MaterialHandle* materials, u32 materialCount, const glm::mat4x4& transform) {
+		auto metadataIt = meshMetadataMap.find(mesh);
+		if (metadataIt == meshMetadataMap.end()) {
+			DEBUG_LOG("Mesh %llu doesn't exist or was evicted, not drawn", (unsigned long long)mesh);
+			return;
+		}
+		const MeshMetadata& metadata = metadataIt->second;
+		const r32 screenPixels = GetProjectedDiameter(metadata.bounds, transform);
+		const u32 lod = SelectLod(metadata, screenPixels);
+
+		u32 instanceOffset;
+		if (!AllocateInstances(1, instanceOffset)) {
+			return;
+		}
+		memcpy(instanceData + (u64)instanceDataStride * instanceOffset, &transform, sizeof(PerInstanceData));
+
+		const u32 submeshCount = vulkan.GetSubmeshCount(mesh);
+		for (u32 i = 0; i < submeshCount; i++) {
+			const u32 slot = MIN(vulkan.GetSubmesh(mesh, i).materialIndex, materialCount - 1);
+			vulkan.RequestMaterialTextureResolution(materials[slot], screenPixels);
+			if (lod == 0) {
+				AddClusterDrawcall(mesh, i, materials[slot], instanceOffset, transform);
+			}
+			else {
+				AddDrawcall(mesh, i, lod, materials[slot], instanceOffset, 1);
+			}
+		}
+	}
+
+	glm::mat4x4* Renderer::AllocateJoints(u32 count, u32& outOffset) {
+		if (jointDataCount + count > maxJointCount) {
+			DEBUG_LOG("Joint palette full, can't fit %d more joints", count);
+			return nullptr;
+		}
+
+		outOffset = jointDataCount;
+		jointDataCount += count;
+		return jointData + outOffset;
+	}
+
+	void Renderer::DrawSkinnedMeshInstanced(MeshHandle mesh, MaterialHandle material, u32 count, const glm::mat4x4* transforms, u32 jointOffset, u32 jointCount) {
+		auto metadataIt = meshMetadataMap.find(mesh);
+		if (metadataIt == meshMetadataMap.end()) {
+			DEBUG_LOG("Mesh %llu doesn't exist or was evicted, not drawn", (unsigned long long)mesh);
+			return;
+		}
+		const MeshMetadata& metadata = metadataIt->second;
+
+		// Instances index the palette with their draw instance index, so they can't be regrouped by LOD
+		u32 lod = metadata.lodCount - 1;
+		r32 screenPixels = 0.0f;
+		for (u32 i = 0; i < count; i++) {
+			const r32 diameter = GetProjectedDiameter(metadata.bounds, transforms[i]);
+			screenPixels = MAX(screenPixels, diameter);
+			lod = MIN(lod, SelectLod(metadata, diameter));
+		}
+
+		vulkan.RequestMaterialTextureResolution(material, screenPixels);
+
+		u32 instanceOffset;
+		if (!AllocateInstances(count, instanceOffset)) {
+			return;
+		}
+		for (u32 i = 0; i < count; i++) {
+			memcpy(instanceData + (u64)instanceDataStride * (instanceOffset + i), &transforms[i], sizeof(PerInstanceData));
+		}
+
+		const u32 submeshCount = vulkan.GetSubmeshCount(mesh);
+		for (u32 i = 0; i < submeshCount; i++) {
+			if (!AddDrawcall(mesh, i, lod, material, instanceOffset, count)) {
+				return;
+			}
+			DrawcallData& data = drawcallData[drawcallCount - 1];
+			data.jointOffset = jointOffset;
+			data.jointCount = jointCount;
+		}
+	}
+
+	void Renderer::DrawSkinnedMesh(MeshHandle mesh, MaterialHandle material, const glm::mat4x4& transform, const glm::mat4x4* jointMatrices, u32 jointCount) {
+		u32 jointOffset;
+		glm::mat4x4* joints = AllocateJoints(jointCount, jointOffset);
+		if (joints == nullptr) {
+			return;
+		}
+
+		memcpy(joints, jointMatrices, sizeof(glm::mat4x4) * jointCount);
+		DrawSkinnedMeshInstanced(mesh, material, 1, &transform, jointOffset, jointCount);
+	}
+
+	void Renderer::DrawScene(const Scene& scene) {
+		FrameArena::Scope scratch(frameArena);
+		const u32 objectCount = scene.GetObjectCount();
+		u32* visibleIndices = frameArena.AllocateArray<u32>(objectCount);
+		if (visibleIndices == nullptr) {
+			DEBUG_LOG("Frame arena is full, scene not drawn");
+			return;
+		}
+
+		// Back in array order, where objects sharing a mesh and material tend to be neighbours
+		const u32 visibleCount = scene.QueryFrustums(&frustumPlanes[0][0], 2, 4, visibleIndices, objectCount);
+		std::sort(visibleIndices, visibleIndices + visibleCount);
+
+		const SceneBatch objects = scene.GetRange(0, objectCount);
+		u32 runStart = 0;
+		u32 runLength = 0;
+		for (u32 i = 0; i <= visibleCount; i++) {
+			const u32 index = i < visibleCount ? visibleIndices[i] : 0;
+			const bool continuesRun = i < visibleCount && runLength > 0 && runLength < maxInstanceCountPerDraw && index == runStart + runLength &&
+				objects.meshes[index] == objects.meshes[runStart] && objects.materials[index] == objects.materials[runStart];
+			if (runLength > 0 && !continuesRun) {
+				DrawMeshInstanced(objects.meshes[runStart], objects.materials[runStart], runLength, objects.worldMatrices + runStart);
+				runLength = 0;
+			}
+			if (i < visibleCount) {
+				if (runLength == 0) {
+					runStart = index;
+				}
+				runLength++;
+			}
+		}
 	}
 
 	void Renderer::Render(const u32 xrSwapchainImageIndex) {
@@ -147,35 +753,173 @@ namespace Rendering {
 		// std::sort(&renderQueue[0], &renderQueue[drawcallCount]);
 
 		vulkan.BeginRenderCommands();
+		DestroyRetiredResources();
+		// Mip copies have to be recorded before the draws that sample the new images
+		vulkan.UpdateTextureStreaming(UpdateCachedTextureSize, &resourceCache);
 		vulkan.TransferUniformBufferData();
 		vulkan.TransferInstanceBufferData(0, instanceCount);
+		vulkan.TransferJointBufferData(jointDataCount);
 		vulkan.BeginForwardRenderPass(xrSwapchainImageIndex);
 
 		MeshHandle previousMesh = -1;
 		MaterialHandle previousMaterial = -1;
+		ShaderHandle previousShader = -1;
+		u32 previousInstanceOffset = -1;
+		u32 previousJointOffset = -1;
+		u32 previousJointCount = -1;
 		for (u32 i = 0; i < drawcallCount; i++) {
 			const Drawcall& call = renderQueue[i];
-			MeshHandle meshHandle = call.Mesh();
-			MaterialHandle matHandle = call.Material();
-			MaterialMetadata matData = materialMetadataMap[matHandle];
-			u16 dataIndex = call.DataIndex();
+			const u32 dataIndex = call.DataIndex();
 			DrawcallData data = drawcallData[dataIndex];
-			
-			if (matHandle != previousMaterial) {
-				vulkan.BindMaterial(matHandle, matData.shader, data.instanceOffset);
+			MaterialMetadata matData = materialMetadataMap[data.material];
+
+			// Instance data offset is bound with the material, so submeshes of the same model share the binding
+			if (data.material != previousMaterial || data.instanceOffset != previousInstanceOffset) {
+				vulkan.BindMaterial(data.material, matData.shader, data.instanceOffset);
+				previousMaterial = data.material;
+				previousInstanceOffset = data.instanceOffset;
+			}
+			// Bound vertex streams depend on the shader
+			if (data.mesh != previousMesh || matData.shader != previousShader) {
+				vulkan.BindMesh(data.mesh, matData.shader);
+				previousMesh = data.mesh;
+				previousShader = matData.shader;
+				previousJointCount = -1;
 			}
-			if (meshHandle != previousMesh) {
-				vulkan.BindMesh(meshHandle, matData.shader);
+			if (data.jointCount > 0 && (data.jointOffset != previousJointOffset || data.jointCount != previousJointCount)) {
+				vulkan.BindJoints(matData.shader, data.jointOffset, data.jointCount);
+				previousJointOffset = data.jointOffset;
+				previousJointCount = data.jointCount;
 			}
 
-			vulkan.Draw(meshHandle, data.instanceOffset, data.instanceCount);
+			if (data.clusterRangeCount > 0) {
+				vulkan.DrawRanges(data.mesh, data.submesh, &clusterRanges[data.firstClusterRange], data.clusterRangeCount, data.instanceCount);
+			}
+			else {
+				vulkan.Draw(data.mesh, data.submesh, data.lod, data.instanceOffset, data.instanceCount);
+			}
 		}
 		vulkan.EndRenderPass();
+
+		// The uniform copy recorded above runs on the GPU after submit, so the camera can still be replaced
+		CameraData latchedCamera;
+		if (cameraLateLatch != nullptr && cameraLateLatch(cameraLateLatchUserData, latchedCamera)) {
+			*cameraData = latchedCamera;
+			camera = latchedCamera;
+		}
 		vulkan.EndRenderCommands();
 
 		// Clear render queue
 		drawcallCount = 0;
 		instanceCount = 0;
+		clusterRangeCount = 0;
+		jointDataCount = 0;
+
+		frameArena.BeginFrame();
+		AllocateFrameData();
+
+		EvictResources();
+		frameNumber++;
+	}
+
+	// Only IDs that still point at the handle are removed, the others were reused since
+	static void EraseIds(std::unordered_map<ResourceId, u64>& map, std::unordered_multimap<u64, ResourceId>& reverseMap, u64 handle) {
+		auto range = reverseMap.equal_range(handle);
+		for (auto it = range.first; it != range.second; it++) {
+			auto idIt = map.find(it->second);
+			if (idIt != map.end() && idIt->second == handle) {
+				map.erase(idIt);
+			}
+		}
+		reverseMap.erase(range.first, range.second);
+	}
+
+	// Evicted resources can't be found or revived anymore, but frames in flight may still draw with them
+	// Whatever doesn't fit in the retired ring stays cached until a later frame
+	void Renderer::EvictResources() {
+		ResourceType type;
+		u64 handle;
+		while (retiredResourceCount < maxRetiredResourceCount && resourceCache.Evict(resourceMemoryBudget, type, handle)) {
+			switch (type) {
+				case RESOURCE_MESH: {
+					// A mesh that collided was never in the hash map, so don't remove the one that is
+					auto hashIt = meshHashMap.find(meshMetadataMap.at(handle).contentHash);
+					if (hashIt != meshHashMap.end() && hashIt->second == handle) {
+						meshHashMap.erase(hashIt);
+					}
+					meshMetadataMap.erase(handle);
+					EraseIds(meshIdMap, resourceIds[RESOURCE_MESH], handle);
+					break;
+				}
+				case RESOURCE_TEXTURE:
+					EraseIds(textureIdMap, resourceIds[RESOURCE_TEXTURE], handle);
+					break;
+				case RESOURCE_MATERIAL: {
+					// Might make some textures unreferenced, they're evicted in this loop if still needed
+					u32 textureCount;
+					const TextureHandle* textures = vulkan.GetMaterialTextures(handle, textureCount);
+					for (u32 i = 0; i < textureCount; i++) {
+						if (resourceCache.Contains(RESOURCE_TEXTURE, textures[i])) {
+							ReleaseTexture(textures[i]);
+						}
+					}
+					materialMetadataMap.erase(handle);
+					EraseIds(materialIdMap, resourceIds[RESOURCE_MATERIAL], handle);
+					break;
+				}
+				default:
+					break;
+			}
+
+			DEBUG_LOG("Evicted resource %llu of type %d, %llu bytes in use", (unsigned long long)handle, type, (unsigned long long)resourceCache.GetMemoryUsage());
+			retiredResources[(retiredResourceFirst + retiredResourceCount++) % maxRetiredResourceCount] = { type, handle, frameNumber };
+		}
+	}
+
+	// Called after BeginRenderCommands waited for the frame that last used this frame's resources
+	void Renderer::DestroyRetiredResources() {
+		while (retiredResourceCount > 0) {
+			const RetiredResource& resource = retiredResources[retiredResourceFirst];
+			if (resource.frame + maxFramesInFlight > frameNumber) {
+				break;
+			}
+
+			switch (resource.type) {
+				case RESOURCE_MESH:
+					vulkan.FreeMesh(resource.handle);
+					break;
+				case RESOURCE_TEXTURE:
+					vulkan.FreeTexture(resource.handle);
+					break;
+				case RESOURCE_MATERIAL:
+					vulkan.FreeMaterial(resource.handle);
+					break;
+				default:
+					break;
+			}
+			retiredResourceFirst = (retiredResourceFirst + 1) % maxRetiredResourceCount;
+			retiredResourceCount--;
+		}
+	}
+
+	void Renderer::SetTextureMemoryBudget(u64 bytes) {
+		vulkan.SetTextureMemoryBudget(bytes);
+	}
+
+	void Renderer::SetResourceMemoryBudget(u64 bytes) {
+		resourceMemoryBudget = bytes;
+	}
+
+	u64 Renderer::GetResourceMemoryUsage() const {
+		return resourceCache.GetMemoryUsage();
+	}
+
+	void Renderer::SetLodBias(r32 bias) {
+		lodBias = bias;
+	}
+
+	FrameArena& Renderer::GetFrameArena() {
+		return frameArena;
 	}
 
 	const Vulkan* Renderer::GetImplementation() const {
@@ -1,9 +1,13 @@
 #pragma once
 #include "vulkan.h"
-#include <string>
+#include "frame_arena.h"
+#include "resource_id.h"
+#include "resource_cache.h"
 #include <unordered_map>
 #include <compare>
 
+class Scene;
+
 namespace Rendering {
 	class Drawcall {
 		u64 id;
@@ -15,60 +19,167 @@ namespace Rendering {
 		//std::strong_ordering operator<=>(const Drawcall& other) const;
 
 		inline RenderLayer Layer() const;
-		inline MaterialHandle Material() const;
-		inline MeshHandle Mesh() const;
 		inline u16 DataIndex() const;
 	};
 
+	// Fills in a newer camera for the frame being submitted, returns false to keep the current one
+	typedef bool (*CameraLateLatch)(void* userData, CameraData& outData);
+
 	class Renderer {
 	public:
 		Renderer(const XR::XRInstance* const xrInstance);
-		~Renderer();
 
 		void CreateXRSwapchain(const XR::XRInstance* const xrInstance);
 
-		MeshHandle CreateMesh(std::string name, const MeshCreateInfo& data);
-		TextureHandle CreateTexture(std::string name, const TextureCreateInfo& info);
-		ShaderHandle CreateShader(std::string name, const ShaderCreateInfo& info);
-		MaterialHandle CreateMaterial(std::string name, const MaterialCreateInfo& info);
+		// Bounding sphere of all LODs in mesh space
+		const MeshBounds& GetMeshBounds(MeshHandle mesh);
+		// Joint matrices a skinned draw of the mesh needs, 0 if it has no joints and weights
+		u32 GetMeshJointCount(MeshHandle mesh);
+		// Meshes, textures and materials are created with one reference owned by the caller
+		// Released resources stay cached until they're evicted to keep the resource memory under budget
+		// Returns the existing handle if a mesh with identical content was already created, adding a reference to it
+		MeshHandle CreateMesh(ResourceId id, const MeshCreateInfo& data);
+		void AcquireMesh(MeshHandle handle);
+		void ReleaseMesh(MeshHandle handle);
+		// Thread safe, so loader threads can take handles while the data is still being read. See Vulkan::ReserveMesh
+		// Creating with a reserved handle gives it back and returns the existing mesh when the content is shared
+		MeshHandle ReserveMesh();
+		MeshHandle CreateMesh(ResourceId id, const MeshCreateInfo& data, MeshHandle reserved);
+		void CancelMesh(MeshHandle reserved);
+		TextureHandle CreateTexture(ResourceId id, const TextureCreateInfo& info);
+		TextureHandle ReserveTexture();
+		TextureHandle CreateTexture(ResourceId id, const TextureCreateInfo& info, TextureHandle reserved);
+		void CancelTexture(TextureHandle reserved);
+		void AcquireTexture(TextureHandle handle);
+		void ReleaseTexture(TextureHandle handle);
+		ShaderHandle CreateShader(ResourceId id, const ShaderCreateInfo& info);
+		// Materials hold a reference to their textures
+		MaterialHandle CreateMaterial(ResourceId id, const MaterialCreateInfo& info);
+		void AcquireMaterial(MaterialHandle handle);
+		void ReleaseMaterial(MaterialHandle handle);
+		// Handle of the resource last created with the ID, false if there is none. Cached unreferenced resources are found too,
+		// acquire them to keep them
+		bool FindMesh(ResourceId id, MeshHandle& outHandle) const;
+		bool FindTexture(ResourceId id, TextureHandle& outHandle) const;
+		bool FindShader(ResourceId id, ShaderHandle& outHandle) const;
+		bool FindMaterial(ResourceId id, MaterialHandle& outHandle) const;
+		void UpdateMaterialTexture(MaterialHandle material, u32 index, TextureHandle texture);
 
 		void UpdateCameraRaw(const CameraData& data);
+		// Called in Render after recording, right before submitting. Shaders get the latched camera,
+		// culling and LOD selection were already done with the one from UpdateCameraRaw
+		void SetCameraLateLatch(CameraLateLatch callback, void* userData);
 		//void UpdateMainLight(const Quaternion& direction, const Color& color);
 		void UpdateAmbientLight(const Color& color);
 		void DrawMesh(MeshHandle mesh, MaterialHandle material, const glm::mat4x4& transform);
-		void DrawMeshInstanced(MeshHandle mesh, MaterialHandle material, u16 count, const glm::mat4x4* transforms);
+		void DrawMeshInstanced(MeshHandle mesh, MaterialHandle material, u32 count, const glm::mat4x4* transforms);
+		// Draws every submesh with the material in its slot. Slots past materialCount use the last material
+		void DrawModel(MeshHandle mesh, const MaterialHandle* materials, u32 materialCount, const glm::mat4x4& transform);
+
+		// Reserves joint matrices for this frame, to be written directly. Returns null if the palette buffer is full
+		glm::mat4x4* AllocateJoints(u32 count, u32& outOffset);
+		// Joint matrices go from bind pose mesh space to mesh space (joint transform * inverse bind matrix)
+		// Instance i uses the jointCount matrices starting at jointOffset + i * jointCount
+		void DrawSkinnedMeshInstanced(MeshHandle mesh, MaterialHandle material, u32 count, const glm::mat4x4* transforms, u32 jointOffset, u32 jointCount);
+		void DrawSkinnedMesh(MeshHandle mesh, MaterialHandle material, const glm::mat4x4& transform, const glm::mat4x4* jointMatrices, u32 jointCount);
+		// Draws the visible objects that pass frustum culling against the scene's BVH, call Scene::UpdateWorldMatrices first
+		// Neighbouring objects with the same mesh and material are drawn instanced straight from the scene's matrices
+		void DrawScene(const Scene& scene);
 
 		void Render(const u32 xrSwapchainImageIndex);
 
+		void SetTextureMemoryBudget(u64 bytes);
+		// Evicting starts at the end of the frame, destruction waits until no frame in flight can use the resource
+		void SetResourceMemoryBudget(u64 bytes);
+		u64 GetResourceMemoryUsage() const;
+		// Multiplies the allowed on-screen LOD error, higher values switch to coarser LODs sooner
+		void SetLodBias(r32 bias);
+
+		// Scratch memory for the frame being built, dropped after the frame's Render
+		FrameArena& GetFrameArena();
+
 		// This kind of defeats the point of wrapping the implementation, figure out a better way to do this
 		const Vulkan* GetImplementation() const;
 		
 	private:
 		void RecalculateCameraMatrices();
+		void AllocateFrameData();
+		void EvictResources();
+		void DestroyRetiredResources();
+		r32 GetProjectedDiameter(const MeshBounds& bounds, const glm::mat4x4& transform) const;
+		u32 SelectLod(const MeshMetadata& metadata, r32 screenPixels) const;
+		// Reserves per instance data for this frame. False if the instance buffer is full
+		bool AllocateInstances(u32 count, u32& outOffset);
+		// False if the render queue is full, then the drawcall is skipped
+		bool AddDrawcall(MeshHandle mesh, u32 submesh, u32 lod, MaterialHandle material, u32 instanceOffset, u32 instanceCount);
+		bool IsSphereInFrustum(const glm::vec3& center, r32 radius) const;
+		// Culls the meshlets of a single instance and draws the rest, nothing is drawn if every meshlet is culled
+		void AddClusterDrawcall(MeshHandle mesh, u32 submeshIndex, MaterialHandle material, u32 instanceOffset, const glm::mat4x4& transform);
 
 		CameraData* cameraData;
+		CameraData camera; // Copy of the camera data so that it doesn't have to be read back from mapped memory
+		CameraLateLatch cameraLateLatch;
+		void* cameraLateLatchUserData;
+		glm::vec4 frustumPlanes[2][4]; // Side planes of each eye in world space, pointing in
+		u32 renderWidth, renderHeight;
 
 		LightingData* lightingData;
 
 		u8* instanceData;
 		u32 instanceDataStride;
 
+		glm::mat4x4* jointData;
+		u32 jointDataCount; // Joints allocated this frame
+
+		r32 lodBias;
+
+		// Drawcall data, render queue and cluster ranges are allocated from here every frame
+		FrameArena frameArena;
+
 		struct DrawcallData {
-			u16 instanceCount;
-			u16 instanceOffset;
+			MeshHandle mesh;
+			MaterialHandle material;
+			u32 submesh;
+			u32 lod;
+			u32 instanceCount;
+			u32 instanceOffset;
+			u32 firstClusterRange;
+			u32 clusterRangeCount; // 0 draws the whole LOD
+			u32 jointOffset;
+			u32 jointCount; // 0 if not skinned
 		} *drawcallData;
 
+		SubmeshLod* clusterRanges; // Visible meshlet runs of this frame
+		u32 clusterRangeCount;
+
 		Drawcall* renderQueue;
-		u16 drawcallCount;
-		u16 instanceCount;
+		u32 drawcallCount;
+		u32 instanceCount;
 
 		Vulkan vulkan;
 
-		std::unordered_map<std::string, MeshHandle> meshNameMap;
-		std::unordered_map<std::string, TextureHandle> textureNameMap;
-		std::unordered_map<std::string, ShaderHandle> shaderNameMap;
-		std::unordered_map<std::string, MaterialHandle> materialNameMap;
-
+		std::unordered_map<ResourceId, MeshHandle> meshIdMap;
+		std::unordered_map<ResourceId, TextureHandle> textureIdMap;
+		std::unordered_map<ResourceId, ShaderHandle> shaderIdMap;
+		std::unordered_map<ResourceId, MaterialHandle> materialIdMap;
+		// IDs each mesh, texture and material was registered under, so eviction doesn't have to search the maps above
+		std::unordered_multimap<u64, ResourceId> resourceIds[RESOURCE_TYPE_COUNT];
+
+		ResourceCache resourceCache;
+		u64 resourceMemoryBudget;
+		struct RetiredResource {
+			ResourceType type;
+			u64 handle;
+			u64 frame; // Last frame that could have used it
+		};
+		// Ring in eviction order, so the oldest are always at the front
+		RetiredResource retiredResources[maxRetiredResourceCount];
+		u32 retiredResourceFirst;
+		u32 retiredResourceCount;
+		u64 frameNumber;
+
+		std::unordered_map<u64, MeshHandle> meshHashMap;
+		std::unordered_map<MeshHandle, MeshMetadata> meshMetadataMap;
 		std::unordered_map<ShaderHandle, ShaderMetadata> shaderMetadataMap;
 		std::unordered_map<MaterialHandle, MaterialMetadata> materialMetadataMap;
 	};
@@ -7,6 +7,7 @@
 
 namespace Rendering {
 	constexpr u32 maxMaterialCount = 256;
+	// Initial capacity of the resource pools, they grow past this when needed
 	constexpr u32 maxShaderCount = 64;
 	constexpr u32 maxTextureCount = 256;
 	constexpr u32 maxVertexBufferCount = 256;
@@ -14,6 +15,21 @@ namespace Rendering {
 	constexpr u32 maxInstanceCount = 32768; // This is not max instances per drawcall, but in general
 	constexpr u32 maxInstanceCountPerDraw = 1024; // TODO: Get this from VkPhysicalDeviceLimits
 	constexpr u32 maxSamplerCount = 8;
+	constexpr u32 maxSubmeshCount = 16;
+	constexpr u32 maxLodCount = 4;
+	constexpr r32 defaultLodPixelError = 1.0f; // A LOD is used when its simplification error projects to less than this
+	constexpr u32 meshletMaxVertices = 64;
+	constexpr u32 meshletMaxTriangles = 124;
+	constexpr u32 maxClusterRangeCount = 4096; // Visible cluster runs drawn per frame
+	constexpr u32 maxJointCount = 8192; // Joint matrices of all skinned instances per frame
+	constexpr u32 maxFramesInFlight = 2;
+	constexpr u64 frameArenaSize = 512 * 1024; // Transient render data of one frame
+	constexpr u64 defaultTextureMemoryBudget = 128 * 1024 * 1024;
+	constexpr u64 defaultResourceMemoryBudget = 256 * 1024 * 1024; // Unreferenced meshes and textures are evicted above this
+	constexpr u32 maxRetiredResourceCount = 256; // Evicted resources waiting for the frames in flight, eviction pauses when it's full
+	constexpr u32 textureStreamingTailSize = 256; // Mips at or below this size are always resident
+	constexpr u32 maxTextureStreamingUploadsPerFrame = 2;
+	constexpr u32 textureEvictionDelayFrames = 90; // Frames a mip has to go unused before it's dropped
 
 	typedef glm::vec3 VertexPos;
 	typedef glm::vec2 VertexUV;
@@ -37,6 +53,23 @@ namespace Rendering {
 			index[2] = c;
 		}
 	};
+	struct Triangle16
+	{
+		u16 index[3];
+
+		Triangle16(): index{} {}
+		Triangle16(u16 a, u16 b, u16 c) {
+			index[0] = a;
+			index[1] = b;
+			index[2] = c;
+		}
+	};
+
+	// Up to 4 joints influence a vertex, indices point to the mesh's joint palette
+	struct VertexJoints
+	{
+		u16 index[4];
+	};
 
 	enum VertexAttribFlags
 	{
@@ -52,6 +85,65 @@ namespace Rendering {
 		VERTEX_WEIGHTS_BIT = 1 << 9,
 	};
 
+	// Layout of the vertex streams on the GPU
+	enum VertexFormat
+	{
+		VERTEX_FORMAT_FLOAT = 0, // Everything fp32
+		// Positions snorm16 (scaled to the mesh bounds), normals and tangents octahedral snorm16,
+		// texcoords half float, colors unorm8
+		VERTEX_FORMAT_QUANTIZED = 1,
+		VERTEX_FORMAT_COUNT
+	};
+
+	// Position, texcoord0, normal, tangent, color, joints, weights. The index is also the vertex binding
+	constexpr u32 vertexStreamCount = 7;
+	// Bytes per vertex of each stream in each vertex format
+	constexpr u32 vertexStreamStrides[vertexStreamCount][VERTEX_FORMAT_COUNT] = {
+		{ sizeof(glm::vec3), sizeof(s16) * 4 },
+		{ sizeof(glm::vec2), sizeof(u16) * 2 },
+		{ sizeof(glm::vec3), sizeof(s16) * 2 },
+		{ sizeof(glm::vec4), sizeof(s16) * 2 },
+		{ sizeof(Color), sizeof(u8) * 4 },
+		{ sizeof(VertexJoints), sizeof(VertexJoints) },
+		{ sizeof(glm::vec4), sizeof(u16) * 4 },
+	};
+
+	// Push constants of the vertex stage, position = stored * positionScale + positionOffset
+	struct VertexQuantizationData {
+		glm::vec4 positionScale;
+		glm::vec4 positionOffset;
+	};
+
+	// Range of a mesh drawn with its own material
+	struct SubmeshLod
+	{
+		u32 firstTriangle;
+		u32 triangleCount;
+		r32 error; // Simplification error in mesh units, 0 for full detail
+	};
+	struct Submesh
+	{
+		s32 vertexOffset; // Added to every index of the submesh
+		u32 materialIndex; // Material slot of the model
+		u32 lodCount;
+		SubmeshLod lods[maxLodCount]; // From full detail to coarsest, all LODs share the vertices
+		// Clusters of the full detail LOD, their triangles are stored in meshlet order
+		u32 firstMeshlet;
+		u32 meshletCount;
+	};
+
+	// Cluster of the full detail triangles for culling, in mesh space
+	struct Meshlet
+	{
+		glm::vec3 center;
+		r32 radius;
+		glm::vec3 coneApex;
+		r32 coneCutoff; // Backfacing if dot(normalize(apex - eye), axis) >= cutoff
+		glm::vec3 coneAxis;
+		u32 firstTriangle;
+		u32 triangleCount;
+	};
+
 	struct MeshCreateInfo
 	{
 		u32 vertexCount;
@@ -60,8 +152,39 @@ namespace Rendering {
 		glm::vec3* normal;
 		glm::vec4* tangent;
 		Color* color;
-		u32 triangleCount;
+		VertexJoints* joints; // Joints and weights are both set for skinned meshes
+		glm::vec4* weights;
+		u32 triangleCount; // Including all LODs
+		// One of these is set. 32 bit indices are narrowed on upload if they fit in 16 bits
 		Triangle* triangles;
+		Triangle16* triangles16;
+		u32 submeshCount; // 0 means a single submesh with all the triangles
+		Submesh* submeshes;
+		u32 meshletCount; // 0 if the mesh isn't worth culling per cluster
+		Meshlet* meshlets;
+		VertexFormat vertexFormat; // Float streams are quantized on upload
+		// Streams already in vertexFormat, by binding. Cooked meshes set these instead of the float streams
+		const void* encodedStreams[vertexStreamCount];
+		VertexQuantizationData encodedQuantization; // Of the encoded positions
+	};
+
+	struct MeshBounds
+	{
+		glm::vec3 center;
+		r32 radius;
+	};
+
+	struct MeshMetadata
+	{
+		MeshBounds bounds;
+		u32 lodCount;
+		r32 lodErrors[maxLodCount]; // Worst simplification error of any submesh, in mesh units
+		u64 contentHash; // Of the vertex, index and submesh data, identical meshes share one handle
+		u64 contentCheck; // Same data with another seed, plus the counts below, must match too before a mesh is shared
+		u32 vertexCount;
+		u32 triangleCount;
+		u32 submeshCount;
+		u32 jointCount; // Palette size the vertices index into, 0 if the mesh isn't skinned
 	};
 
 	///////////////////////////////////////
@@ -103,15 +226,23 @@ namespace Rendering {
 		TEXCOMPRESSION_ASTC_12x12 = (12 << 4) | (12 << 8),
 	};
 
+	// Writes one tightly packed mip level (all layers and faces) to dst
+	typedef void (*TextureLevelReader)(void* userData, u32 level, u8* dst, u64 size);
+
 	struct TextureCreateInfo
 	{
 		u32 width, height;
+		u32 mipCount; // Number of mip levels packed in pixels, largest first. 0 is treated as 1
+		u32 layerCount; // Array layers, cubemap faces not included. 0 is treated as 1
 		TextureType type;
 		ColorSpace space;
 		TextureFilter filter;
 		TextureCompression compression;
 		bool generateMips;
+		bool stream; // Only keep the mip tail resident and stream in finer mips when they're needed
 		u8* pixels;
+		TextureLevelReader readLevel; // If set, levels are read through this instead of from pixels
+		void* readLevelUserData;
 	};
 
 	////////////////////////////////////////
@@ -145,4 +276,10 @@ namespace Rendering {
 		glm::mat4 model;
 	};
 
+	// Push constants after VertexQuantizationData, the palette of an instance starts at jointOffset + instance * jointCount
+	struct VertexSkinningData {
+		u32 jointOffset;
+		u32 jointCount;
+	};
+
 }
\ No newline at end of file
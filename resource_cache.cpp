@@ -0,0 +1,110 @@
+#include "resource_cache.h"
+#include "system.h"
+
+namespace Rendering {
+	ResourceCache::ResourceCache() {
+		lruOldest = nullptr;
+		lruNewest = nullptr;
+		unreferencedCount = 0;
+		memoryUsage = 0;
+	}
+
+	ResourceCache::Entry& ResourceCache::GetEntry(ResourceType type, u64 handle) {
+		auto it = entries[type].find(handle);
+		if (it == entries[type].end()) {
+			DEBUG_ERROR("Resource %llu of type %d isn't tracked", (unsigned long long)handle, type);
+		}
+		return it->second;
+	}
+
+	void ResourceCache::UnlinkLru(Entry& entry) {
+		if (entry.lruPrev != nullptr) {
+			entry.lruPrev->lruNext = entry.lruNext;
+		}
+		else {
+			lruOldest = entry.lruNext;
+		}
+		if (entry.lruNext != nullptr) {
+			entry.lruNext->lruPrev = entry.lruPrev;
+		}
+		else {
+			lruNewest = entry.lruPrev;
+		}
+		entry.lruPrev = nullptr;
+		entry.lruNext = nullptr;
+		unreferencedCount--;
+	}
+
+	void ResourceCache::Add(ResourceType type, u64 handle, u64 size) {
+		auto inserted = entries[type].emplace(handle, Entry{ handle, size, 1, type, nullptr, nullptr });
+		if (!inserted.second) {
+			DEBUG_ERROR("Resource %llu of type %d is already tracked", (unsigned long long)handle, type);
+		}
+		memoryUsage += size;
+	}
+
+	bool ResourceCache::Contains(ResourceType type, u64 handle) const {
+		return entries[type].find(handle) != entries[type].end();
+	}
+
+	void ResourceCache::AddReference(ResourceType type, u64 handle) {
+		Entry& entry = GetEntry(type, handle);
+		if (entry.refCount++ == 0) {
+			UnlinkLru(entry);
+		}
+	}
+
+	void ResourceCache::RemoveReference(ResourceType type, u64 handle) {
+		Entry& entry = GetEntry(type, handle);
+		if (entry.refCount == 0) {
+			DEBUG_ERROR("Resource %llu of type %d has no references to remove", (unsigned long long)handle, type);
+		}
+		if (--entry.refCount > 0) {
+			return;
+		}
+
+		entry.lruPrev = lruNewest;
+		entry.lruNext = nullptr;
+		if (lruNewest != nullptr) {
+			lruNewest->lruNext = &entry;
+		}
+		else {
+			lruOldest = &entry;
+		}
+		lruNewest = &entry;
+		unreferencedCount++;
+	}
+
+	u32 ResourceCache::GetReferenceCount(ResourceType type, u64 handle) const {
+		auto it = entries[type].find(handle);
+		return it != entries[type].end() ? it->second.refCount : 0;
+	}
+
+	void ResourceCache::SetSize(ResourceType type, u64 handle, u64 size) {
+		Entry& entry = GetEntry(type, handle);
+		memoryUsage = memoryUsage - entry.size + size;
+		entry.size = size;
+	}
+
+	bool ResourceCache::Evict(u64 budget, ResourceType& outType, u64& outHandle) {
+		if (memoryUsage <= budget || lruOldest == nullptr) {
+			return false;
+		}
+
+		Entry& entry = *lruOldest;
+		UnlinkLru(entry);
+		outType = entry.type;
+		outHandle = entry.handle;
+		memoryUsage -= entry.size;
+		entries[outType].erase(outHandle);
+		return true;
+	}
+
+	u64 ResourceCache::GetMemoryUsage() const {
+		return memoryUsage;
+	}
+
+	u32 ResourceCache::GetUnreferencedCount() const {
+		return unreferencedCount;
+	}
+}
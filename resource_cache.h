@@ -0,0 +1,58 @@
+#pragma once
+#include "typedef.h"
+#include <unordered_map>
+
+namespace Rendering {
+	enum ResourceType : u8
+	{
+		RESOURCE_MESH = 0,
+		RESOURCE_TEXTURE = 1,
+		RESOURCE_MATERIAL = 2,
+		RESOURCE_TYPE_COUNT
+	};
+
+	// Reference counts and memory use of renderer resources
+	// Unreferenced resources aren't destroyed right away, they wait on an LRU list so that reloading them is free
+	// Eviction takes the least recently released ones first, only while the total is over the budget
+	class ResourceCache {
+	public:
+		ResourceCache();
+
+		// Starts with one reference
+		void Add(ResourceType type, u64 handle, u64 size);
+		bool Contains(ResourceType type, u64 handle) const;
+		// Takes the resource off the LRU list if it was unreferenced
+		void AddReference(ResourceType type, u64 handle);
+		// The last reference puts the resource on the LRU list as the most recent one
+		void RemoveReference(ResourceType type, u64 handle);
+		u32 GetReferenceCount(ResourceType type, u64 handle) const;
+		void SetSize(ResourceType type, u64 handle, u64 size);
+
+		// Removes the least recently used unreferenced resource if the total size is over the budget
+		// Returns false when under the budget or nothing is left to evict
+		bool Evict(u64 budget, ResourceType& outType, u64& outHandle);
+
+		u64 GetMemoryUsage() const;
+		u32 GetUnreferencedCount() const;
+
+	private:
+		struct Entry {
+			u64 handle;
+			u64 size;
+			u32 refCount;
+			ResourceType type;
+			Entry* lruPrev; // Towards the least recently released
+			Entry* lruNext;
+		};
+
+		Entry& GetEntry(ResourceType type, u64 handle);
+		void UnlinkLru(Entry& entry);
+
+		// Map nodes don't move, so the LRU list links them directly
+		std::unordered_map<u64, Entry> entries[RESOURCE_TYPE_COUNT];
+		Entry* lruOldest;
+		Entry* lruNewest;
+		u32 unreferencedCount;
+		u64 memoryUsage;
+	};
+}
@@ -0,0 +1,36 @@
+#include "resource_id.h"
+#include "system.h"
+#ifdef NEKRO_DEBUG
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+static std::mutex resourceNameMutex;
+static std::unordered_map<ResourceId, std::string> resourceNames;
+#endif
+
+ResourceId RegisterResourceName(const char* name) {
+	const ResourceId id = HashResourceName(name);
+#ifdef NEKRO_DEBUG
+	std::lock_guard<std::mutex> lock(resourceNameMutex);
+	auto existing = resourceNames.find(id);
+	if (existing == resourceNames.end()) {
+		resourceNames.emplace(id, name);
+	}
+	else if (existing->second != name) {
+		DEBUG_ERROR("Resource names %s and %s have the same ID", existing->second.c_str(), name);
+	}
+#endif
+	return id;
+}
+
+const char* GetResourceName(ResourceId id) {
+#ifdef NEKRO_DEBUG
+	std::lock_guard<std::mutex> lock(resourceNameMutex);
+	auto existing = resourceNames.find(id);
+	if (existing != resourceNames.end()) {
+		return existing->second.c_str();
+	}
+#endif
+	return "unnamed";
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "typedef.h"
+#include <cstddef>
+
+// Resources are identified by the 64 bit FNV-1a hash of their name instead of the name itself
+// String literals hash at compile time: "Cube"_rid
+typedef u64 ResourceId;
+
+constexpr u64 resourceIdOffsetBasis = 0xcbf29ce484222325ull;
+constexpr u64 resourceIdPrime = 0x100000001b3ull;
+
+constexpr ResourceId HashResourceName(const char* name, u64 length) {
+	u64 hash = resourceIdOffsetBasis;
+	for (u64 i = 0; i < length; i++) {
+		hash = (hash ^ (u8)name[i]) * resourceIdPrime;
+	}
+	return hash;
+}
+
+constexpr ResourceId HashResourceName(const char* name) {
+	u64 hash = resourceIdOffsetBasis;
+	for (u64 i = 0; name[i] != '\0'; i++) {
+		hash = (hash ^ (u8)name[i]) * resourceIdPrime;
+	}
+	return hash;
+}
+
+constexpr ResourceId operator""_rid(const char* name, size_t length) {
+	return HashResourceName(name, length);
+}
+
+// Hashes the name and, in debug builds, remembers it for GetResourceName. Collisions are fatal in debug builds
+ResourceId RegisterResourceName(const char* name);
+// For logging, only registered names are known and release builds don't keep any
+const char* GetResourceName(ResourceId id);
@@ -0,0 +1,578 @@
+#include "scene.h"
+#include "renderer.h"
+#include "system.h"
+#include "job_system.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCENE_NEON
+typedef float32x4_t SceneVec;
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SCENE_SSE2
+typedef __m128 SceneVec;
+#else
+struct SceneVec {
+	r32 v[4];
+};
+#endif
+
+static constexpr u32 noParent = 0xffffffff;
+
+static const r32 identityMatrix[16] = {
+	1.0f, 0.0f, 0.0f, 0.0f,
+	0.0f, 1.0f, 0.0f, 0.0f,
+	0.0f, 0.0f, 1.0f, 0.0f,
+	0.0f, 0.0f, 0.0f, 1.0f
+};
+
+static inline SceneVec LoadVec(const r32* p) {
+#if defined(SCENE_NEON)
+	return vld1q_f32(p);
+#elif defined(SCENE_SSE2)
+	return _mm_loadu_ps(p);
+#else
+	SceneVec result;
+	memcpy(result.v, p, sizeof(r32) * 4);
+	return result;
+#endif
+}
+
+static inline void StoreVec(r32* p, SceneVec v) {
+#if defined(SCENE_NEON)
+	vst1q_f32(p, v);
+#elif defined(SCENE_SSE2)
+	_mm_storeu_ps(p, v);
+#else
+	memcpy(p, v.v, sizeof(r32) * 4);
+#endif
+}
+
+static inline SceneVec SplatVec(r32 value) {
+#if defined(SCENE_NEON)
+	return vdupq_n_f32(value);
+#elif defined(SCENE_SSE2)
+	return _mm_set1_ps(value);
+#else
+	return SceneVec{ { value, value, value, value } };
+#endif
+}
+
+// a + b * c
+static inline SceneVec MulAddVec(SceneVec a, SceneVec b, SceneVec c) {
+#if defined(SCENE_NEON)
+	return vmlaq_f32(a, b, c);
+#elif defined(SCENE_SSE2)
+	return _mm_add_ps(a, _mm_mul_ps(b, c));
+#else
+	SceneVec result;
+	for (u32 i = 0; i < 4; i++) {
+		result.v[i] = a.v[i] + b.v[i] * c.v[i];
+	}
+	return result;
+#endif
+}
+
+static inline SceneVec MulVec(SceneVec a, SceneVec b) {
+#if defined(SCENE_NEON)
+	return vmulq_f32(a, b);
+#elif defined(SCENE_SSE2)
+	return _mm_mul_ps(a, b);
+#else
+	SceneVec result;
+	for (u32 i = 0; i < 4; i++) {
+		result.v[i] = a.v[i] * b.v[i];
+	}
+	return result;
+#endif
+}
+
+static inline r32 Dot4(SceneVec a, SceneVec b) {
+#if defined(SCENE_NEON)
+	const float32x4_t product = vmulq_f32(a, b);
+	const float32x2_t pair = vadd_f32(vget_low_f32(product), vget_high_f32(product));
+	return vget_lane_f32(vpadd_f32(pair, pair), 0);
+#elif defined(SCENE_SSE2)
+	const __m128 product = _mm_mul_ps(a, b);
+	const __m128 pair = _mm_add_ps(product, _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(_mm_add_ss(pair, _mm_movehl_ps(pair, pair)));
+#else
+	return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2] + a.v[3] * b.v[3];
+#endif
+}
+
+// parent * translate * rotate * scale and the bounding sphere moved by it, a column at a time
+// The first three columns of an affine matrix have w = 0, so their lengths are plain 4 wide dot products
+static void ComposeWorldTransform(const r32* parent, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale,
+	const glm::vec4& localBounds, r32* outWorld, r32* outBounds) {
+	const SceneVec p0 = LoadVec(parent);
+	const SceneVec p1 = LoadVec(parent + 4);
+	const SceneVec p2 = LoadVec(parent + 8);
+	const SceneVec p3 = LoadVec(parent + 12);
+
+	const glm::mat3 r = glm::mat3_cast(rotation);
+	SceneVec columns[3];
+	for (u32 col = 0; col < 3; col++) {
+		SceneVec c = MulVec(p0, SplatVec(r[col][0]));
+		c = MulAddVec(c, p1, SplatVec(r[col][1]));
+		c = MulAddVec(c, p2, SplatVec(r[col][2]));
+		columns[col] = MulVec(c, SplatVec(scale[col]));
+		StoreVec(outWorld + col * 4, columns[col]);
+	}
+	SceneVec translation = MulAddVec(p3, p0, SplatVec(position.x));
+	translation = MulAddVec(translation, p1, SplatVec(position.y));
+	translation = MulAddVec(translation, p2, SplatVec(position.z));
+	StoreVec(outWorld + 12, translation);
+
+	SceneVec center = MulAddVec(translation, columns[0], SplatVec(localBounds.x));
+	center = MulAddVec(center, columns[1], SplatVec(localBounds.y));
+	center = MulAddVec(center, columns[2], SplatVec(localBounds.z));
+	StoreVec(outBounds, center);
+
+	// Bounds scale with the largest axis of the whole chain
+	const r32 maxAxisSquared = MAX(Dot4(columns[0], columns[0]), MAX(Dot4(columns[1], columns[1]), Dot4(columns[2], columns[2])));
+	outBounds[3] = localBounds.w * sqrtf(maxAxisSquared);
+}
+
+// Hands out consecutive cache line aligned arrays from one block
+static u8* TakeSceneArray(u8*& cursor, u64 size) {
+	u8* result = cursor;
+	cursor += (size + sceneArrayAlignment - 1) & ~(u64)(sceneArrayAlignment - 1);
+	return result;
+}
+
+Scene::Scene(Rendering::Renderer& renderer, u32 capacity) : renderer(renderer), capacity(capacity), indices(capacity, capacity) {
+	constexpr u64 align = sceneArrayAlignment;
+	const u64 arraySizes[] = {
+		sizeof(glm::vec3), sizeof(glm::quat), sizeof(glm::vec3), sizeof(glm::mat4), sizeof(glm::vec4), sizeof(glm::vec4),
+		sizeof(Rendering::MeshHandle), sizeof(Rendering::MaterialHandle), sizeof(u8), sizeof(u8), sizeof(u32), sizeof(u32),
+		sizeof(SceneObjectHandle), sizeof(SceneObjectHandle), sizeof(u32)
+	};
+	u64 totalSize = align;
+	for (u64 size : arraySizes) {
+		totalSize += (size * capacity + align - 1) & ~(align - 1);
+	}
+
+	memory = (u8*)malloc(totalSize);
+	if (memory == nullptr) {
+		DEBUG_ERROR("Failed to allocate scene");
+	}
+
+	u8* cursor = (u8*)(((u64)memory + align - 1) & ~(align - 1));
+	positions = (glm::vec3*)TakeSceneArray(cursor, sizeof(glm::vec3) * capacity);
+	rotations = (glm::quat*)TakeSceneArray(cursor, sizeof(glm::quat) * capacity);
+	scales = (glm::vec3*)TakeSceneArray(cursor, sizeof(glm::vec3) * capacity);
+	worldMatrices = (glm::mat4*)TakeSceneArray(cursor, sizeof(glm::mat4) * capacity);
+	localBounds = (glm::vec4*)TakeSceneArray(cursor, sizeof(glm::vec4) * capacity);
+	worldBounds = (glm::vec4*)TakeSceneArray(cursor, sizeof(glm::vec4) * capacity);
+	meshes = (Rendering::MeshHandle*)TakeSceneArray(cursor, sizeof(Rendering::MeshHandle) * capacity);
+	materials = (Rendering::MaterialHandle*)TakeSceneArray(cursor, sizeof(Rendering::MaterialHandle) * capacity);
+	flags = TakeSceneArray(cursor, sizeof(u8) * capacity);
+	drawn = TakeSceneArray(cursor, sizeof(u8) * capacity);
+	parents = (u32*)TakeSceneArray(cursor, sizeof(u32) * capacity);
+	subtreeSizes = (u32*)TakeSceneArray(cursor, sizeof(u32) * capacity);
+	objectHandles = (SceneObjectHandle*)TakeSceneArray(cursor, sizeof(SceneObjectHandle) * capacity);
+	parentHandles = (SceneObjectHandle*)TakeSceneArray(cursor, sizeof(SceneObjectHandle) * capacity);
+	bvhPrimitives = (u32*)TakeSceneArray(cursor, sizeof(u32) * capacity);
+
+	count = 0;
+	bvhNeedsRebuild = true;
+	bvhRefitCount = 0;
+}
+
+Scene::~Scene() {
+	for (u32 i = 0; i < count; i++) {
+		if (flags[i] & OBJECT_RENDERABLE) {
+			renderer.ReleaseMesh(meshes[i]);
+		}
+	}
+	free(memory);
+}
+
+template <typename F>
+void Scene::ForEachArray(const F& function) {
+	function(positions);
+	function(rotations);
+	function(scales);
+	function(worldMatrices);
+	function(localBounds);
+	function(worldBounds);
+	function(meshes);
+	function(materials);
+	function(flags);
+	function(drawn);
+	function(parents);
+	function(subtreeSizes);
+	function(objectHandles);
+	function(parentHandles);
+}
+
+u32 Scene::GetIndex(SceneObjectHandle handle) const {
+	const u32* index = indices.Get(handle);
+	if (index == nullptr) {
+		DEBUG_ERROR("Invalid scene object handle");
+	}
+	return *index;
+}
+
+void Scene::FixIndices(u32 first) {
+	for (u32 i = first; i < count; i++) {
+		*indices.Get(objectHandles[i]) = i;
+	}
+	for (u32 i = first; i < count; i++) {
+		parents[i] = parentHandles[i] == invalidSceneObjectHandle ? noParent : *indices.Get(parentHandles[i]);
+	}
+}
+
+void Scene::AddToAncestors(u32 index, s32 subtreeSizeDelta) {
+	for (u32 parent = parents[index]; parent != noParent; parent = parents[parent]) {
+		subtreeSizes[parent] += subtreeSizeDelta;
+	}
+}
+
+// Roots go to the end, children right after their parent's subtree
+SceneObjectHandle Scene::InsertObject(SceneObjectHandle parent) {
+	const u32* parentIndex = nullptr;
+	if (parent != invalidSceneObjectHandle) {
+		parentIndex = indices.Get(parent);
+		if (parentIndex == nullptr) {
+			DEBUG_LOG("Invalid parent for scene object");
+			return invalidSceneObjectHandle;
+		}
+	}
+
+	SceneObjectHandle handle;
+	u32* index = indices.Add(handle);
+	if (index == nullptr) {
+		DEBUG_LOG("Scene is full (%d objects)", capacity);
+		return invalidSceneObjectHandle;
+	}
+
+	const u32 position = parentIndex != nullptr ? *parentIndex + subtreeSizes[*parentIndex] : count;
+	const u32 moved = count - position;
+	ForEachArray([position, moved](auto* array) {
+		memmove(array + position + 1, array + position, sizeof(*array) * moved);
+	});
+	count++;
+
+	*index = position;
+	positions[position] = glm::vec3(0.0f);
+	rotations[position] = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	scales[position] = glm::vec3(1.0f);
+	worldMatrices[position] = glm::mat4(1.0f);
+	localBounds[position] = glm::vec4(0.0f);
+	worldBounds[position] = glm::vec4(0.0f);
+	meshes[position] = 0;
+	materials[position] = 0;
+	flags[position] = OBJECT_VISIBLE | OBJECT_DIRTY;
+	drawn[position] = 0;
+	subtreeSizes[position] = 1;
+	objectHandles[position] = handle;
+	parentHandles[position] = parent;
+
+	FixIndices(position);
+	AddToAncestors(position, 1);
+	bvhNeedsRebuild = true;
+	return handle;
+}
+
+SceneObjectHandle Scene::CreateObject(Rendering::MeshHandle mesh, Rendering::MaterialHandle material, const Rendering::MeshBounds& bounds, SceneObjectHandle parent) {
+	const SceneObjectHandle handle = InsertObject(parent);
+	if (handle == invalidSceneObjectHandle) {
+		return handle;
+	}
+
+	const u32 index = GetIndex(handle);
+	renderer.AcquireMesh(mesh);
+	meshes[index] = mesh;
+	materials[index] = material;
+	localBounds[index] = glm::vec4(bounds.center, bounds.radius);
+	flags[index] |= OBJECT_RENDERABLE;
+	return handle;
+}
+
+SceneObjectHandle Scene::CreateNode(SceneObjectHandle parent) {
+	return InsertObject(parent);
+}
+
+void Scene::DestroyObject(SceneObjectHandle handle) {
+	const u32* index = indices.Get(handle);
+	if (index == nullptr) {
+		return;
+	}
+
+	const u32 first = *index;
+	const u32 size = subtreeSizes[first];
+	AddToAncestors(first, -(s32)size);
+	for (u32 i = first; i < first + size; i++) {
+		indices.Remove(objectHandles[i]);
+		if (flags[i] & OBJECT_RENDERABLE) {
+			renderer.ReleaseMesh(meshes[i]);
+		}
+	}
+
+	// Shift the rest down to keep the order
+	const u32 moved = count - first - size;
+	ForEachArray([first, size, moved](auto* array) {
+		memmove(array + first, array + first + size, sizeof(*array) * moved);
+	});
+	count -= size;
+	FixIndices(first);
+	bvhNeedsRebuild = true;
+}
+
+bool Scene::IsValid(SceneObjectHandle handle) const {
+	return indices.Get(handle) != nullptr;
+}
+
+bool Scene::SetParent(SceneObjectHandle handle, SceneObjectHandle parent) {
+	const u32 first = GetIndex(handle);
+	const u32 size = subtreeSizes[first];
+	if (parent != invalidSceneObjectHandle) {
+		const u32 parentIndex = GetIndex(parent);
+		if (parentIndex >= first && parentIndex < first + size) {
+			DEBUG_LOG("Can't parent a scene object to its own subtree");
+			return false;
+		}
+	}
+
+	// Move the subtree to the end of the new parent's subtree, or to the end of the scene for roots
+	u32 target = count;
+	if (parent != invalidSceneObjectHandle) {
+		const u32 parentIndex = GetIndex(parent);
+		target = parentIndex + subtreeSizes[parentIndex];
+	}
+
+	AddToAncestors(first, -(s32)size);
+	parentHandles[first] = parent;
+
+	u32 fixFrom = first;
+	if (target > first + size) {
+		ForEachArray([first, size, target](auto* array) {
+			std::rotate(array + first, array + first + size, array + target);
+		});
+	}
+	else if (target < first) {
+		ForEachArray([first, size, target](auto* array) {
+			std::rotate(array + target, array + first, array + first + size);
+		});
+		fixFrom = target;
+	}
+	FixIndices(fixFrom);
+
+	const u32 index = GetIndex(handle);
+	AddToAncestors(index, (s32)size);
+	flags[index] |= OBJECT_DIRTY;
+	bvhNeedsRebuild = true;
+	return true;
+}
+
+void Scene::SetPosition(SceneObjectHandle handle, const glm::vec3& position) {
+	const u32 index = GetIndex(handle);
+	positions[index] = position;
+	flags[index] |= OBJECT_DIRTY;
+}
+
+void Scene::SetRotation(SceneObjectHandle handle, const glm::quat& rotation) {
+	const u32 index = GetIndex(handle);
+	rotations[index] = rotation;
+	flags[index] |= OBJECT_DIRTY;
+}
+
+void Scene::SetScale(SceneObjectHandle handle, const glm::vec3& scale) {
+	const u32 index = GetIndex(handle);
+	scales[index] = scale;
+	flags[index] |= OBJECT_DIRTY;
+}
+
+void Scene::SetTransform(SceneObjectHandle handle, const glm::mat4& transform) {
+	const u32 index = GetIndex(handle);
+	glm::vec3 scale = glm::vec3(glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])));
+	glm::mat3 rotation = glm::mat3(glm::vec3(transform[0]) / scale.x, glm::vec3(transform[1]) / scale.y, glm::vec3(transform[2]) / scale.z);
+	// Mirrored, put the flip in the x scale so the rest is a rotation
+	if (glm::determinant(rotation) < 0.0f) {
+		scale.x = -scale.x;
+		rotation[0] = -rotation[0];
+	}
+
+	positions[index] = glm::vec3(transform[3]);
+	rotations[index] = glm::quat_cast(rotation);
+	scales[index] = scale;
+	flags[index] |= OBJECT_DIRTY;
+}
+
+void Scene::SetMesh(SceneObjectHandle handle, Rendering::MeshHandle mesh, const Rendering::MeshBounds& bounds) {
+	const u32 index = GetIndex(handle);
+	const glm::vec4 newBounds = glm::vec4(bounds.center, bounds.radius);
+	if (meshes[index] == mesh && localBounds[index] == newBounds) {
+		return;
+	}
+
+	// Take the new reference first, the old mesh might be the same one
+	if (flags[index] & OBJECT_RENDERABLE) {
+		renderer.AcquireMesh(mesh);
+		renderer.ReleaseMesh(meshes[index]);
+	}
+	meshes[index] = mesh;
+	localBounds[index] = newBounds;
+	flags[index] |= OBJECT_DIRTY;
+}
+
+void Scene::SetMaterial(SceneObjectHandle handle, Rendering::MaterialHandle material) {
+	materials[GetIndex(handle)] = material;
+}
+
+void Scene::SetVisible(SceneObjectHandle handle, bool visible) {
+	const u32 index = GetIndex(handle);
+	const u8 visibleFlag = visible ? OBJECT_VISIBLE : 0;
+	if ((flags[index] & OBJECT_VISIBLE) != visibleFlag) {
+		flags[index] = (flags[index] & ~OBJECT_VISIBLE) | visibleFlag | OBJECT_DIRTY;
+	}
+}
+
+const glm::mat4& Scene::GetWorldMatrix(SceneObjectHandle handle) const {
+	return worldMatrices[GetIndex(handle)];
+}
+
+// Parents come first, so one pass in order sees every parent's final state before its children
+// Clean objects under clean parents are skipped with a single flag test
+void Scene::UpdateRange(u32 first, u32 end) {
+	for (u32 i = first; i < end; i++) {
+		const u32 parent = parents[i];
+		const bool parentChanged = parent != noParent && (flags[parent] & OBJECT_CHANGED);
+		if (!(flags[i] & OBJECT_DIRTY) && !parentChanged) {
+			flags[i] &= ~OBJECT_CHANGED;
+			continue;
+		}
+
+		const r32* parentMatrix = parent == noParent ? identityMatrix : &worldMatrices[parent][0][0];
+		ComposeWorldTransform(parentMatrix, positions[i], rotations[i], scales[i], localBounds[i], &worldMatrices[i][0][0], &worldBounds[i][0]);
+
+		const bool treeVisible = (flags[i] & OBJECT_VISIBLE) && (parent == noParent || (flags[parent] & OBJECT_TREE_VISIBLE));
+		u8 newFlags = (flags[i] & ~(OBJECT_DIRTY | OBJECT_TREE_VISIBLE)) | OBJECT_CHANGED;
+		if (treeVisible) {
+			newFlags |= OBJECT_TREE_VISIBLE;
+		}
+		flags[i] = newFlags;
+		drawn[i] = treeVisible && (newFlags & OBJECT_RENDERABLE) ? 1 : 0;
+	}
+}
+
+void Scene::UpdateRangeJobFunction(void* userData) {
+	const UpdateRangeJob* job = (const UpdateRangeJob*)userData;
+	job->scene->UpdateRange(job->first, job->end);
+}
+
+void Scene::UpdateWorldMatrices(JobSystem* jobSystem) {
+	if (jobSystem == nullptr || count < sceneParallelUpdateMinObjects) {
+		UpdateRange(0, count);
+		UpdateBVH();
+		return;
+	}
+
+	// Root subtrees don't depend on each other, so ranges of whole ones can be updated in any order
+	constexpr u32 maxJobCount = 16;
+	const u32 jobCount = MIN(jobSystem->GetWorkerCount() + 1, maxJobCount);
+	const u32 targetSize = (count + jobCount - 1) / jobCount;
+
+	UpdateRangeJob jobs[maxJobCount];
+	u32 rangeCount = 0;
+	u32 first = 0;
+	while (first < count) {
+		u32 end = first;
+		while (end < count && (end - first < targetSize || rangeCount == jobCount - 1)) {
+			end += subtreeSizes[end];
+		}
+		jobs[rangeCount++] = { this, first, end };
+		first = end;
+	}
+
+	JobCounter counter;
+	for (u32 i = 1; i < rangeCount; i++) {
+		jobSystem->Schedule(UpdateRangeJobFunction, &jobs[i], &counter);
+	}
+	UpdateRange(jobs[0].first, jobs[0].end);
+	jobSystem->Wait(counter);
+	UpdateBVH();
+}
+
+// Refitting is linear and keeps the tree, but the tree gets worse as objects move away from where it was built
+void Scene::UpdateBVH() {
+	if (!bvhNeedsRebuild && bvhRefitCount < sceneBvhRebuildInterval) {
+		bvh.Refit();
+		bvhRefitCount++;
+		return;
+	}
+
+	u32 primitiveCount = 0;
+	for (u32 i = 0; i < count; i++) {
+		if (flags[i] & OBJECT_RENDERABLE) {
+			bvhPrimitives[primitiveCount++] = i;
+		}
+	}
+	bvh.Build(worldBounds, bvhPrimitives, primitiveCount);
+	bvhNeedsRebuild = false;
+	bvhRefitCount = 0;
+}
+
+u32 Scene::QueryFrustums(const glm::vec4* planes, u32 frustumCount, u32 planesPerFrustum, u32* outIndices, u32 maxResults) const {
+	return bvh.QueryFrustums(planes, frustumCount, planesPerFrustum, outIndices, maxResults, drawn);
+}
+
+bool Scene::Raycast(const glm::vec3& origin, const glm::vec3& direction, r32 maxDistance, SceneObjectHandle& outHit, r32& outDistance) const {
+	BVHRayHit hit;
+	if (!bvh.Raycast(origin, direction, maxDistance, hit, drawn)) {
+		return false;
+	}
+
+	outHit = objectHandles[hit.primitive];
+	outDistance = hit.distance;
+	return true;
+}
+
+u32 Scene::QuerySphere(const glm::vec3& center, r32 radius, SceneObjectHandle* outHandles, u32 maxResults) const {
+	u32 found[sceneMaxSphereQueryResults];
+	const u32 foundCount = bvh.QuerySphere(center, radius, found, MIN(maxResults, sceneMaxSphereQueryResults), drawn);
+	for (u32 i = 0; i < foundCount; i++) {
+		outHandles[i] = objectHandles[found[i]];
+	}
+	return foundCount;
+}
+
+const BVHQueryStats& Scene::GetLastQueryStats() const {
+	return bvh.GetLastQueryStats();
+}
+
+u32 Scene::GetObjectCount() const {
+	return count;
+}
+
+u32 Scene::GetBatchCount() const {
+	return (count + sceneBatchSize - 1) / sceneBatchSize;
+}
+
+SceneBatch Scene::GetBatch(u32 batchIndex) const {
+	return GetRange(batchIndex * sceneBatchSize, sceneBatchSize);
+}
+
+SceneBatch Scene::GetRange(u32 first, u32 rangeCount) const {
+	SceneBatch batch{};
+	if (first >= count) {
+		return batch;
+	}
+
+	batch.count = MIN(count - first, rangeCount);
+	batch.positions = positions + first;
+	batch.rotations = rotations + first;
+	batch.scales = scales + first;
+	batch.worldMatrices = worldMatrices + first;
+	batch.worldBounds = worldBounds + first;
+	batch.meshes = meshes + first;
+	batch.materials = materials + first;
+	batch.visible = drawn + first;
+	return batch;
+}
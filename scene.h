@@ -0,0 +1,147 @@
+#pragma once
+#include "rendering.h"
+#include "memory_pool.h"
+#include "math.h"
+#include "bvh.h"
+
+class JobSystem;
+namespace Rendering {
+	class Renderer;
+}
+
+constexpr u32 defaultSceneCapacity = 4096; // Objects, see the Scene constructor
+constexpr u32 sceneArrayAlignment = 64; // Every array starts on its own cache line
+constexpr u32 sceneBatchSize = 256; // Objects per batch when iterating
+constexpr u32 sceneParallelUpdateMinObjects = 1024; // Below this world matrices are updated on the calling thread
+constexpr u32 sceneBvhRebuildInterval = 120; // Updates that only refit the BVH before it's rebuilt to fix its quality
+constexpr u32 sceneMaxSphereQueryResults = 256;
+
+struct SceneObject;
+typedef PoolHandle<SceneObject> SceneObjectHandle;
+const SceneObjectHandle invalidSceneObjectHandle = SceneObjectHandle(0xffffffffull);
+
+// One batch of tightly packed objects, index i of every array is the same object
+struct SceneBatch {
+	u32 count;
+	const glm::vec3* positions; // Local, relative to the parent
+	const glm::quat* rotations;
+	const glm::vec3* scales;
+	const glm::mat4* worldMatrices;
+	const glm::vec4* worldBounds; // xyz = center, w = radius
+	const Rendering::MeshHandle* meshes;
+	const Rendering::MaterialHandle* materials;
+	const u8* visible; // Renderable, and neither it nor any ancestor is hidden
+};
+
+// Renderable objects and transform nodes stored as a structure of arrays, so batch passes over one property read nothing else
+// Objects are kept packed in depth first order: parents come before their children and every subtree is a contiguous range
+// Structural changes (create, destroy, reparent) shift the arrays, handles stay valid but array indices don't
+// Every renderable object holds a reference to its mesh, so the renderer doesn't evict meshes the scene still draws
+class Scene {
+public:
+	// Every per object array is allocated for capacity objects up front, so iterating never chases reallocations
+	Scene(Rendering::Renderer& renderer, u32 capacity = defaultSceneCapacity);
+	~Scene();
+
+	// Returns an invalid handle if the scene is full. localBounds is the mesh's bounding sphere, see Renderer::GetMeshBounds
+	// Children are added after the parent's existing subtree
+	SceneObjectHandle CreateObject(Rendering::MeshHandle mesh, Rendering::MaterialHandle material, const Rendering::MeshBounds& localBounds, SceneObjectHandle parent = invalidSceneObjectHandle);
+	// Transform only node, for attachment points and grouping
+	SceneObjectHandle CreateNode(SceneObjectHandle parent = invalidSceneObjectHandle);
+	// Destroys the children too
+	void DestroyObject(SceneObjectHandle handle);
+	bool IsValid(SceneObjectHandle handle) const;
+	// Moves the object and its subtree under another parent, or to the root with an invalid handle
+	// The local transform is kept, so the world transform changes with the parent
+	bool SetParent(SceneObjectHandle handle, SceneObjectHandle parent);
+
+	// Local transform, relative to the parent
+	void SetPosition(SceneObjectHandle handle, const glm::vec3& position);
+	void SetRotation(SceneObjectHandle handle, const glm::quat& rotation);
+	void SetScale(SceneObjectHandle handle, const glm::vec3& scale);
+	// Splits the matrix into position, rotation and scale. It must not have shear
+	void SetTransform(SceneObjectHandle handle, const glm::mat4& transform);
+	void SetMesh(SceneObjectHandle handle, Rendering::MeshHandle mesh, const Rendering::MeshBounds& localBounds);
+	void SetMaterial(SceneObjectHandle handle, Rendering::MaterialHandle material);
+	// Hiding an object hides its subtree
+	void SetVisible(SceneObjectHandle handle, bool visible);
+	// As of the last UpdateWorldMatrices
+	const glm::mat4& GetWorldMatrix(SceneObjectHandle handle) const;
+
+	// Recomputes world matrices, bounds and visibility of changed objects and their subtrees in one linear pass
+	// With a job system, big scenes are split into ranges of whole root subtrees that are updated in parallel
+	// The BVH is refit afterwards, or rebuilt if objects were added, removed or reparented
+	void UpdateWorldMatrices(JobSystem* jobSystem = nullptr);
+
+	// Spatial queries only see drawn objects and use the bounds of the last UpdateWorldMatrices
+	// Array indices of the objects intersecting any of the frustums, in no particular order. See BVH::QueryFrustums
+	u32 QueryFrustums(const glm::vec4* planes, u32 frustumCount, u32 planesPerFrustum, u32* outIndices, u32 maxResults) const;
+	// Closest object whose bounding sphere the ray hits, direction must be normalized
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, r32 maxDistance, SceneObjectHandle& outHit, r32& outDistance) const;
+	// Objects whose bounding spheres overlap the sphere, at most sceneMaxSphereQueryResults
+	u32 QuerySphere(const glm::vec3& center, r32 radius, SceneObjectHandle* outHandles, u32 maxResults) const;
+	const BVHQueryStats& GetLastQueryStats() const;
+
+	u32 GetObjectCount() const;
+	u32 GetBatchCount() const;
+	// Batches cover the objects in order, all but the last one have sceneBatchSize objects
+	SceneBatch GetBatch(u32 batchIndex) const;
+	// Any range of objects, for going through query results by array index
+	SceneBatch GetRange(u32 first, u32 rangeCount) const;
+
+private:
+	enum ObjectFlags : u8 {
+		OBJECT_VISIBLE = 1 << 0,
+		OBJECT_RENDERABLE = 1 << 1,
+		OBJECT_DIRTY = 1 << 2, // Local transform, mesh or visibility changed since the last update
+		OBJECT_CHANGED = 1 << 3, // World matrix was recomputed in the current update, children follow
+		OBJECT_TREE_VISIBLE = 1 << 4,
+	};
+
+	struct UpdateRangeJob {
+		Scene* scene;
+		u32 first;
+		u32 end;
+	};
+
+	u32 GetIndex(SceneObjectHandle handle) const;
+	SceneObjectHandle InsertObject(SceneObjectHandle parent);
+	// Calls the function with every per object array
+	template <typename F>
+	void ForEachArray(const F& function);
+	// Points handles and parents at the current array indices from first on
+	void FixIndices(u32 first);
+	void AddToAncestors(u32 index, s32 subtreeSizeDelta);
+	void UpdateRange(u32 first, u32 end);
+	void UpdateBVH();
+	static void UpdateRangeJobFunction(void* userData);
+
+	Rendering::Renderer& renderer;
+	u8* memory;
+	u32 capacity;
+
+	glm::vec3* positions;
+	glm::quat* rotations;
+	glm::vec3* scales;
+	glm::mat4* worldMatrices;
+	glm::vec4* localBounds;
+	glm::vec4* worldBounds;
+	Rendering::MeshHandle* meshes;
+	Rendering::MaterialHandle* materials;
+	u8* flags;
+	u8* drawn;
+	u32* parents; // Array index of the parent, noParent for roots
+	u32* subtreeSizes; // Including the object itself
+	SceneObjectHandle* objectHandles; // Handle of the object at each index
+	SceneObjectHandle* parentHandles;
+
+	// Handles resolve to the object's current array index
+	Pool<u32, SceneObjectHandle> indices;
+	u32 count;
+
+	// Over the renderable objects, primitives are array indices so structural changes need a rebuild
+	BVH bvh;
+	u32* bvhPrimitives; // Build input
+	bool bvhNeedsRebuild;
+	u32 bvhRefitCount; // Since the last rebuild
+};
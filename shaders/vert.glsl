@@ -2,15 +2,32 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_EXT_multiview : enable
 
+// Set by the pipeline, see Rendering::VertexFormat
+layout(constant_id = 0) const bool quantizedVertices = false;
+// SKINNED is defined for the vert_skinned.spv variant. Inputs can't be compiled out with a specialization constant,
+// and pipelines without joint and weight streams must not have them in the interface
+
+// Quantized positions are snorm16 in the mesh bounds, scale and offset are 1 and 0 otherwise
+// The joint palette of an instance starts at jointOffset + gl_InstanceIndex * jointCount
+layout(push_constant) uniform VertexQuantization
+{
+	vec4 positionScale;
+	vec4 positionOffset;
+	uint jointOffset;
+	uint jointCount;
+} quantization;
+
+// Texcoords (half float) are converted by the vertex fetch
+// The shaders don't take normals, tangents or colors yet, so those are constants
 layout(location = 0) in vec3 app_pos;
 layout(location = 1) in vec2 app_uv;
-//vec2 app_uv = vec2(0.0);
-//layout(location = 2) in vec3 app_normal;
 vec3 app_normal = vec3(0.0);
-//layout(location = 3) in vec4 app_tangent;
 vec4 app_tangent = vec4(0.0);
-//layout(location = 4) in vec4 app_color;
 vec4 app_color = vec4(1.0);
+#ifdef SKINNED
+layout(location = 5) in uvec4 app_joints;
+layout(location = 6) in vec4 app_weights;
+#endif
 
 layout(binding = 0) uniform CameraData
 {
@@ -35,6 +52,22 @@ layout(binding = 2) uniform InstanceData
 	PerInstanceData data[1024];
 } instanceData;
 
+#ifdef SKINNED
+// Joint matrices in mesh space (joint world transform * inverse bind matrix)
+layout(std430, binding = 13) readonly buffer JointData
+{
+	mat4 joints[];
+} jointData;
+
+mat4 GetSkinMatrix() {
+	uint base = quantization.jointOffset + uint(gl_InstanceIndex) * quantization.jointCount;
+	return jointData.joints[base + app_joints.x] * app_weights.x +
+		jointData.joints[base + app_joints.y] * app_weights.y +
+		jointData.joints[base + app_joints.z] * app_weights.z +
+		jointData.joints[base + app_joints.w] * app_weights.w;
+}
+#endif
+
 layout(location = 0) out vec2 v_uv;
 layout(location = 1) out vec4 v_lightSpacePos;
 layout(location = 2) out vec3 v_normal;
@@ -45,7 +78,14 @@ layout(location = 6) out vec3 v_color;
 
 void main() {
 	PerInstanceData instance = instanceData.data[gl_InstanceIndex];
-	gl_Position = cameraData.proj[gl_ViewIndex] * cameraData.view[gl_ViewIndex] * instance.model * vec4(app_pos, 1.0);
+	vec3 pos = app_pos * quantization.positionScale.xyz + quantization.positionOffset.xyz;
+#ifdef SKINNED
+	mat4 skin = GetSkinMatrix();
+	pos = (skin * vec4(pos, 1.0)).xyz;
+	app_normal = mat3(skin) * app_normal;
+	app_tangent.xyz = mat3(skin) * app_tangent.xyz;
+#endif
+	gl_Position = cameraData.proj[gl_ViewIndex] * cameraData.view[gl_ViewIndex] * instance.model * vec4(pos, 1.0);
 	v_uv = app_uv;
 	
 	mat4 normalMatrix = transpose(inverse(instance.model));
@@ -53,7 +93,7 @@ void main() {
 	v_tangent = (normalMatrix * vec4(app_tangent.xyz, 0.0)).xyz;
 	vec3 bitangent = cross(app_normal, app_tangent.xyz) * app_tangent.w;
 	v_bitangent	= (normalMatrix * vec4(bitangent, 0.0)).xyz;
-	v_worldPos = (instance.model * vec4(app_pos, 1.0)).xyz;
+	v_worldPos = (instance.model * vec4(pos, 1.0)).xyz;
 	v_lightSpacePos = lightingData.mainLightProjMat * lightingData.mainLightMat * vec4(v_worldPos, 1.0);
 	v_color = app_color.rgb;
 }
\ No newline at end of file
@@ -3,6 +3,12 @@
 #include <stdarg.h>
 #include <iostream>
 #include <fstream>
+#ifndef __ANDROID__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 void Print(int prio, const char* fmt, ...) {
 	char s[1025];
@@ -10,17 +16,126 @@ void Print(int prio, const char* fmt, ...) {
 	va_start(args, fmt);
 	vsprintf(s, fmt, args);
 	va_end(args);
+#ifdef __ANDROID__
 	__android_log_write(prio, "vrengine", s);
+#else
+	fputs(s, prio >= ANDROID_LOG_FATAL ? stderr : stdout);
+#endif
 }
 
 // Memory is owned by caller
+#ifdef __ANDROID__
 char* AllocFileBytes(const char* fname, u32& outLength, AAssetManager *assetManager) {
 	AAsset *file = AAssetManager_open(assetManager, fname, AASSET_MODE_BUFFER);
+	if (file == nullptr) {
+		outLength = 0;
+		return nullptr;
+	}
+
 	auto fileSize = AAsset_getLength(file);
-	char* buffer = (char*)calloc(1, fileSize);
+	char* buffer = (char*)malloc(fileSize);
 	AAsset_read(file, (void*)buffer, fileSize);
 	AAsset_close(file);
 
 	outLength = (u32)fileSize;
 	return buffer;
-}
\ No newline at end of file
+}
+
+bool OpenFileView(const char* fname, FileView& outView, AAssetManager *assetManager) {
+	outView = {};
+	AAsset *file = AAssetManager_open(assetManager, fname, AASSET_MODE_BUFFER);
+	if (file == nullptr) {
+		return false;
+	}
+
+	outView.size = AAsset_getLength64(file);
+
+	// Only works for assets stored uncompressed in the APK, compressed ones have to be inflated into memory
+	const void* buffer = AAsset_getBuffer(file);
+	if (buffer != nullptr) {
+		outView.data = (const u8*)buffer;
+		outView.handle = file;
+		return true;
+	}
+
+	DEBUG_LOG("Asset %s is compressed, reading a copy", fname);
+	u8* copy = (u8*)malloc(outView.size);
+	AAsset_read(file, copy, outView.size);
+	AAsset_close(file);
+
+	outView.data = copy;
+	outView.copied = true;
+	return true;
+}
+
+void CloseFileView(FileView& view) {
+	if (view.copied) {
+		free((void*)view.data);
+	}
+	else if (view.handle != nullptr) {
+		AAsset_close((AAsset*)view.handle);
+	}
+
+	view = {};
+}
+#else
+char* AllocFileBytes(const char* fname, u32& outLength, AAssetManager *assetManager) {
+	std::ifstream file(fname, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		outLength = 0;
+		return nullptr;
+	}
+
+	auto fileSize = (size_t)file.tellg();
+	char* buffer = (char*)malloc(fileSize);
+	file.seekg(0);
+	file.read(buffer, fileSize);
+
+	outLength = (u32)fileSize;
+	return buffer;
+}
+
+bool OpenFileView(const char* fname, FileView& outView, AAssetManager *assetManager) {
+	outView = {};
+	const int fd = open(fname, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0) {
+		close(fd);
+		return false;
+	}
+	outView.size = fileStat.st_size;
+
+	// Can't map empty files
+	if (outView.size == 0) {
+		close(fd);
+		outView.copied = true;
+		return true;
+	}
+
+	void* mapping = mmap(nullptr, outView.size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		outView = {};
+		return false;
+	}
+
+	outView.data = (const u8*)mapping;
+	outView.handle = mapping;
+	return true;
+}
+
+void CloseFileView(FileView& view) {
+	if (view.copied) {
+		free((void*)view.data);
+	}
+	else if (view.handle != nullptr) {
+		munmap(view.handle, view.size);
+	}
+
+	view = {};
+}
+#endif
\ No newline at end of file
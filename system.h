@@ -1,8 +1,15 @@
 #pragma once
 #include "typedef.h"
 #include <stdlib.h>
+#ifdef __ANDROID__
 #include <android/log.h>
 #include <android/asset_manager.h>
+#else
+// Host tools (asset cooker) share the same code paths, files are read relative to the working directory
+struct AAssetManager;
+#define ANDROID_LOG_DEBUG 3
+#define ANDROID_LOG_FATAL 7
+#endif
 
 #undef DEBUG_PRINT
 #ifdef NEKRO_DEBUG
@@ -18,5 +25,16 @@
 #undef DEBUG_ERROR
 #define DEBUG_ERROR(fmt, ...) {DEBUG_PRINT(ANDROID_LOG_FATAL, fmt, ##__VA_ARGS__); abort();}
 
+// Read-only view of a whole file. Mapped directly when possible, otherwise the file is read into memory owned by the view
+struct FileView {
+	const u8* data;
+	u64 size;
+	void* handle; // AAsset on Android, mapping base on Linux
+	bool copied;
+};
+
 void Print(int prio, const char* fmt, ...);
-char* AllocFileBytes(const char* fname, u32& outLength, AAssetManager *assetManager);
\ No newline at end of file
+// Returns nullptr if the file doesn't exist
+char* AllocFileBytes(const char* fname, u32& outLength, AAssetManager *assetManager);
+bool OpenFileView(const char* fname, FileView& outView, AAssetManager *assetManager);
+void CloseFileView(FileView& view);
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include "system.h"
+#include "rendering.h"
+#include "math.h"
+#include "gltf.h"
+#include "astc.h"
+#include "ktx.h"
+#include "cooked.h"
+#include "vertex_quantize.h"
+#include "job_system.h"
+#include <cstdio>
+#include <cstring>
+
+static bool HasExtension(const char* fname, const char* extension) {
+	const u32 nameLength = strlen(fname);
+	const u32 extensionLength = strlen(extension);
+	return nameLength > extensionLength && strcmp(fname + nameLength - extensionLength, extension) == 0;
+}
+
+static u64 AlignCookedOffset(u64 offset) {
+	return (offset + cookedAssetAlignment - 1) & ~(u64)(cookedAssetAlignment - 1);
+}
+
+// Reserves an aligned block in the output and copies data into it. Returns 0 if there is no data
+static u64 AppendCookedBlock(u8* out, u64& size, const void* data, u64 dataSize) {
+	if (data == nullptr || dataSize == 0) {
+		return 0;
+	}
+
+	const u64 offset = AlignCookedOffset(size);
+	memset(out + size, 0, offset - size);
+	memcpy(out + offset, data, dataSize);
+	size = offset + dataSize;
+	return offset;
+}
+
+static bool WriteFileBytes(const char* fname, const u8* data, u64 size) {
+	FILE* file = fopen(fname, "wb");
+	if (file == nullptr) {
+		fprintf(stderr, "Failed to open %s for writing\n", fname);
+		return false;
+	}
+
+	const bool result = fwrite(data, 1, size, file) == size;
+	fclose(file);
+	return result;
+}
+
+// Encodes one stream in Rendering::VERTEX_FORMAT_QUANTIZED, null if the mesh doesn't have it
+static u8* QuantizeMeshStream(const Rendering::MeshCreateInfo& info, u32 stream, const glm::vec3& positionScale, const glm::vec3& positionOffset) {
+	const void* streams[Rendering::vertexStreamCount] = { info.position, info.texcoord0, info.normal, info.tangent, info.color, info.joints, info.weights };
+	if (streams[stream] == nullptr) {
+		return nullptr;
+	}
+
+	u8* out = (u8*)malloc((u64)info.vertexCount * Rendering::vertexStreamStrides[stream][Rendering::VERTEX_FORMAT_QUANTIZED]);
+	switch (stream) {
+		case 0:
+			QuantizePositions(info.position, info.vertexCount, positionScale, positionOffset, (s16*)out);
+			break;
+		case 1:
+			QuantizeTexcoords(info.texcoord0, info.vertexCount, (u16*)out);
+			break;
+		case 2:
+			QuantizeNormals(info.normal, info.vertexCount, (s16*)out);
+			break;
+		case 3:
+			QuantizeTangents(info.tangent, info.vertexCount, (s16*)out);
+			break;
+		case 4:
+			QuantizeColors(info.color, info.vertexCount, out);
+			break;
+		case 5:
+			memcpy(out, info.joints, sizeof(Rendering::VertexJoints) * info.vertexCount);
+			break;
+		case 6:
+			QuantizeWeights(info.weights, info.vertexCount, (u16*)out);
+			break;
+	}
+	return out;
+}
+
+static bool CookMesh(const char* input, const char* meshName, const char* output, JobSystem& jobSystem) {
+	char path[1024];
+	strncpy(path, input, sizeof(path) - 1);
+	path[sizeof(path) - 1] = 0;
+	const char* fname = input;
+	char* separator = strrchr(path, '/');
+	if (separator != nullptr) {
+		*separator = 0;
+		fname = separator + 1;
+	}
+	else {
+		strcpy(path, ".");
+	}
+
+	GLTFData gltf{};
+	if (!LoadGLTF(path, fname, gltf, nullptr)) {
+		fprintf(stderr, "Failed to load %s\n", input);
+		return false;
+	}
+
+	cgltf_mesh mesh;
+	Rendering::MeshCreateInfo info{};
+	if (!FindGLTFMeshByName(gltf.data, meshName, mesh) || !GetGLTFMeshInfo(gltf.data, mesh, info, &jobSystem)) {
+		fprintf(stderr, "Failed to get mesh %s from %s\n", meshName, input);
+		FreeGLTFData(gltf);
+		return false;
+	}
+	FreeGLTFData(gltf);
+
+	const u64 vertexCount = info.vertexCount;
+	const u64 maxSize = sizeof(CookedMeshHeader) + cookedAssetAlignment * 10 +
+		vertexCount * (sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(glm::vec3) + sizeof(glm::vec4) + sizeof(Rendering::Color) + sizeof(Rendering::VertexJoints) + sizeof(glm::vec4)) +
+		info.triangleCount * sizeof(Rendering::Triangle) + // Upper bound, might be 16 bit
+		info.submeshCount * sizeof(Rendering::Submesh) +
+		info.meshletCount * sizeof(Rendering::Meshlet);
+	u8* out = (u8*)calloc(1, maxSize);
+	u64 size = sizeof(CookedMeshHeader);
+
+	CookedMeshHeader header{};
+	header.magic = cookedMeshMagic;
+	header.version = cookedAssetVersion;
+	header.vertexCount = info.vertexCount;
+	header.triangleCount = info.triangleCount;
+	header.submeshCount = info.submeshCount;
+	header.meshletCount = info.meshletCount;
+
+	// Quantized once here, the runtime uploads the streams as they are. The encoded streams are never bigger than the float ones
+	header.vertexFormat = Rendering::VERTEX_FORMAT_QUANTIZED;
+	glm::vec3 positionScale, positionOffset;
+	GetPositionQuantization(info.position, info.vertexCount, positionScale, positionOffset);
+	header.quantization.positionScale = glm::vec4(positionScale, 1.0f);
+	header.quantization.positionOffset = glm::vec4(positionOffset, 0.0f);
+	u64* streamOffsets[Rendering::vertexStreamCount] = { &header.positionOffset, &header.texcoord0Offset, &header.normalOffset, &header.tangentOffset, &header.colorOffset, &header.jointsOffset, &header.weightsOffset };
+	for (u32 i = 0; i < Rendering::vertexStreamCount; i++) {
+		u8* encoded = QuantizeMeshStream(info, i, positionScale, positionOffset);
+		*streamOffsets[i] = AppendCookedBlock(out, size, encoded, vertexCount * Rendering::vertexStreamStrides[i][Rendering::VERTEX_FORMAT_QUANTIZED]);
+		free(encoded);
+	}
+	if (info.triangles16 != nullptr) {
+		header.indexSize = sizeof(u16);
+		header.trianglesOffset = AppendCookedBlock(out, size, info.triangles16, info.triangleCount * sizeof(Rendering::Triangle16));
+	}
+	else {
+		header.indexSize = sizeof(u32);
+		header.trianglesOffset = AppendCookedBlock(out, size, info.triangles, info.triangleCount * sizeof(Rendering::Triangle));
+	}
+	header.submeshesOffset = AppendCookedBlock(out, size, info.submeshes, info.submeshCount * sizeof(Rendering::Submesh));
+	header.meshletsOffset = AppendCookedBlock(out, size, info.meshlets, info.meshletCount * sizeof(Rendering::Meshlet));
+	memcpy(out, &header, sizeof(CookedMeshHeader));
+
+	const bool result = WriteFileBytes(output, out, size);
+	printf("%s (%s): %d vertices, %d triangles, %d submeshes, %d meshlets, %llu bytes\n", output, meshName, info.vertexCount, info.triangleCount, info.submeshCount, info.meshletCount, (unsigned long long)size);
+
+	free(out);
+	FreeGLTFMeshInfo(info);
+
+	return result;
+}
+
+// ASTC input is a single level in the given color space. KTX2 input brings its own mips, layers and color space,
+// supercompressed levels are decoded here so the runtime can stream them straight from the file
+static bool CookTexture(const char* input, Rendering::ColorSpace space, const char* output) {
+	u32 inputSize;
+	u8* buffer = (u8*)AllocFileBytes(input, inputSize, nullptr);
+	if (buffer == nullptr) {
+		fprintf(stderr, "Failed to open %s\n", input);
+		return false;
+	}
+
+	CookedTextureHeader header{};
+	header.magic = cookedTextureMagic;
+	header.version = cookedAssetVersion;
+
+	u8* payload;
+	u64 payloadSize;
+	u8* decoded = nullptr;
+	if (HasExtension(input, ".ktx2")) {
+		Rendering::TextureCreateInfo info{};
+		if (!GetKTX2Info(buffer, inputSize, info)) {
+			fprintf(stderr, "%s is not a supported KTX2 file\n", input);
+			free(buffer);
+			return false;
+		}
+		if (info.generateMips) {
+			fprintf(stderr, "Warning: %s has no mip chain, the cooked texture won't have mips either\n", input);
+		}
+
+		header.width = info.width;
+		header.height = info.height;
+		header.mipCount = info.mipCount;
+		header.layerCount = MAX(info.layerCount, 1u);
+		header.type = info.type;
+		header.space = info.space;
+		header.compression = info.compression;
+
+		decoded = AllocKTX2Levels(buffer, payloadSize);
+		payload = decoded;
+	}
+	else {
+		Rendering::TextureCompression compression;
+		if (!GetAstcInfo(buffer, header.width, header.height, compression) || !GetAstcPayload(buffer, &payload)) {
+			fprintf(stderr, "%s is not a valid ASTC file\n", input);
+			free(buffer);
+			return false;
+		}
+
+		header.mipCount = 1;
+		header.layerCount = 1;
+		header.type = Rendering::TEXTURE_2D;
+		header.space = space;
+		header.compression = compression;
+		payloadSize = inputSize - (payload - buffer);
+	}
+
+	u8* out = (u8*)calloc(1, sizeof(CookedTextureHeader) + cookedAssetAlignment + payloadSize);
+	u64 size = sizeof(CookedTextureHeader);
+	header.dataSize = payloadSize;
+	header.dataOffset = AppendCookedBlock(out, size, payload, payloadSize);
+	memcpy(out, &header, sizeof(CookedTextureHeader));
+
+	const bool result = WriteFileBytes(output, out, size);
+	printf("%s: %dx%d, %d mips, %d layers, %llu bytes\n", output, header.width, header.height, header.mipCount, header.layerCount, (unsigned long long)size);
+
+	free(out);
+	free(decoded);
+	free(buffer);
+
+	return result;
+}
+
+int main(int argc, char** argv) {
+	if (argc == 5 && strcmp(argv[1], "mesh") == 0) {
+		JobSystem jobSystem;
+		return CookMesh(argv[2], argv[3], argv[4], jobSystem) ? 0 : 1;
+	}
+	if (argc == 5 && strcmp(argv[1], "texture") == 0) {
+		const Rendering::ColorSpace space = strcmp(argv[3], "linear") == 0 ? Rendering::COLORSPACE_LINEAR : Rendering::COLORSPACE_SRGB;
+		return CookTexture(argv[2], space, argv[4]) ? 0 : 1;
+	}
+
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "  %s mesh <input.gltf|.glb> <mesh name> <output.nmesh>\n", argv[0]);
+	fprintf(stderr, "  %s texture <input.astc|.ktx2> <srgb|linear> <output.ntex>\n", argv[0]);
+	fprintf(stderr, "    The color space only applies to ASTC input, KTX2 files carry their own\n");
+	return 1;
+}
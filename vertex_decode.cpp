@@ -0,0 +1,435 @@
+#include "vertex_decode.h"
+#include "job_system.h"
+#include "system.h"
+#include <cstring>
+#include <cstdlib>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VERTEX_DECODE_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VERTEX_DECODE_SSE2
+#endif
+
+u64 GetVertexComponentSize(VertexComponentType type) {
+	switch (type) {
+		case VERTEX_COMPONENT_S8:
+		case VERTEX_COMPONENT_U8:
+			return 1;
+		case VERTEX_COMPONENT_S16:
+		case VERTEX_COMPONENT_U16:
+			return 2;
+		case VERTEX_COMPONENT_U32:
+		case VERTEX_COMPONENT_FLOAT:
+			return 4;
+	}
+	return 0;
+}
+
+// Normalized signed values have two representations of -1, hence the clamp
+static r32 GetNormalizedScale(VertexComponentType type) {
+	switch (type) {
+		case VERTEX_COMPONENT_S8:
+			return 1.0f / 127.0f;
+		case VERTEX_COMPONENT_U8:
+			return 1.0f / 255.0f;
+		case VERTEX_COMPONENT_S16:
+			return 1.0f / 32767.0f;
+		case VERTEX_COMPONENT_U16:
+			return 1.0f / 65535.0f;
+		default:
+			return 1.0f;
+	}
+}
+
+static inline r32 ReadComponent(const u8* p, VertexComponentType type, r32 scale, r32 min) {
+	r32 value = 0.0f;
+	switch (type) {
+		case VERTEX_COMPONENT_S8:
+			value = (r32)*(const s8*)p;
+			break;
+		case VERTEX_COMPONENT_U8:
+			value = (r32)*p;
+			break;
+		case VERTEX_COMPONENT_S16: {
+			s16 v;
+			memcpy(&v, p, sizeof(s16));
+			value = (r32)v;
+			break;
+		}
+		case VERTEX_COMPONENT_U16: {
+			u16 v;
+			memcpy(&v, p, sizeof(u16));
+			value = (r32)v;
+			break;
+		}
+		case VERTEX_COMPONENT_U32: {
+			u32 v;
+			memcpy(&v, p, sizeof(u32));
+			value = (r32)v;
+			break;
+		}
+		case VERTEX_COMPONENT_FLOAT:
+			memcpy(&value, p, sizeof(r32));
+			return value;
+	}
+
+	value *= scale;
+	return value < min ? min : value;
+}
+
+// Flat arrays of integer components -> floats, 8 at a time. Returns how many components were converted
+static u64 ConvertComponentsWide(const u8* src, VertexComponentType type, r32 scale, r32 min, r32* dst, u64 count) {
+	u64 i = 0;
+#if defined(VERTEX_DECODE_NEON)
+	const float32x4_t vScale = vdupq_n_f32(scale);
+	const float32x4_t vMin = vdupq_n_f32(min);
+	for (; i + 8 <= count; i += 8) {
+		float32x4_t lo, hi;
+		switch (type) {
+			case VERTEX_COMPONENT_S8: {
+				const int16x8_t v = vmovl_s8(vld1_s8((const int8_t*)src + i));
+				lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+				hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+				break;
+			}
+			case VERTEX_COMPONENT_U8: {
+				const uint16x8_t v = vmovl_u8(vld1_u8(src + i));
+				lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(v)));
+				hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(v)));
+				break;
+			}
+			case VERTEX_COMPONENT_S16: {
+				const int16x8_t v = vld1q_s16((const int16_t*)(src + i * 2));
+				lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+				hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+				break;
+			}
+			case VERTEX_COMPONENT_U16: {
+				const uint16x8_t v = vld1q_u16((const uint16_t*)(src + i * 2));
+				lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(v)));
+				hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(v)));
+				break;
+			}
+			default:
+				return i;
+		}
+		vst1q_f32(dst + i, vmaxq_f32(vmulq_f32(lo, vScale), vMin));
+		vst1q_f32(dst + i + 4, vmaxq_f32(vmulq_f32(hi, vScale), vMin));
+	}
+#elif defined(VERTEX_DECODE_SSE2)
+	const __m128 vScale = _mm_set1_ps(scale);
+	const __m128 vMin = _mm_set1_ps(min);
+	for (; i + 8 <= count; i += 8) {
+		__m128i lo, hi;
+		switch (type) {
+			case VERTEX_COMPONENT_S8: {
+				const __m128i b = _mm_loadl_epi64((const __m128i*)(src + i));
+				// Duplicate into the high byte and shift back down to sign extend
+				const __m128i w = _mm_srai_epi16(_mm_unpacklo_epi8(b, b), 8);
+				lo = _mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16);
+				hi = _mm_srai_epi32(_mm_unpackhi_epi16(w, w), 16);
+				break;
+			}
+			case VERTEX_COMPONENT_U8: {
+				const __m128i zero = _mm_setzero_si128();
+				const __m128i w = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src + i)), zero);
+				lo = _mm_unpacklo_epi16(w, zero);
+				hi = _mm_unpackhi_epi16(w, zero);
+				break;
+			}
+			case VERTEX_COMPONENT_S16: {
+				const __m128i w = _mm_loadu_si128((const __m128i*)(src + i * 2));
+				lo = _mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16);
+				hi = _mm_srai_epi32(_mm_unpackhi_epi16(w, w), 16);
+				break;
+			}
+			case VERTEX_COMPONENT_U16: {
+				const __m128i zero = _mm_setzero_si128();
+				const __m128i w = _mm_loadu_si128((const __m128i*)(src + i * 2));
+				lo = _mm_unpacklo_epi16(w, zero);
+				hi = _mm_unpackhi_epi16(w, zero);
+				break;
+			}
+			default:
+				return i;
+		}
+		_mm_storeu_ps(dst + i, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), vScale), vMin));
+		_mm_storeu_ps(dst + i + 4, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), vScale), vMin));
+	}
+#endif
+	return i;
+}
+
+// Copies 4 floats per element, the extra one gets overwritten by the next element
+// Only safe when another element follows, so the last one is left for the caller
+static u64 CopyFloatElementsWide(const u8* src, u64 stride, r32* dst, u32 dstComponentCount, u64 begin, u64 end) {
+	u64 i = begin;
+#if defined(VERTEX_DECODE_NEON)
+	for (; i + 1 < end; i++) {
+		vst1q_f32(dst + i * dstComponentCount, vld1q_f32((const float*)(src + i * stride)));
+	}
+#elif defined(VERTEX_DECODE_SSE2)
+	for (; i + 1 < end; i++) {
+		_mm_storeu_ps(dst + i * dstComponentCount, _mm_loadu_ps((const float*)(src + i * stride)));
+	}
+#endif
+	return i;
+}
+
+void DecodeVertexStream(const VertexStreamDesc& src, r32* dst, u32 dstComponentCount, u64 begin, u64 end) {
+	if (begin >= end) {
+		return;
+	}
+
+	const u64 componentSize = GetVertexComponentSize(src.componentType);
+	const u64 elementSize = componentSize * src.componentCount;
+	const u64 stride = src.stride == 0 ? elementSize : src.stride;
+	const u32 copyCount = src.componentCount < dstComponentCount ? src.componentCount : dstComponentCount;
+	const bool packed = stride == elementSize && src.componentCount == dstComponentCount;
+
+	if (src.componentType == VERTEX_COMPONENT_FLOAT) {
+		if (packed) {
+			memcpy(dst + begin * dstComponentCount, src.data + begin * stride, (end - begin) * elementSize);
+			return;
+		}
+
+		// Interleaved vec3/vec4 streams, or vec4 source into a vec3 destination
+		u64 i = begin;
+		if ((copyCount == 3 || copyCount == 4) && dstComponentCount >= 3 && stride >= sizeof(r32) * 4) {
+			i = CopyFloatElementsWide(src.data, stride, dst, dstComponentCount, begin, end);
+		}
+
+		for (; i < end; i++) {
+			memcpy(dst + i * dstComponentCount, src.data + i * stride, copyCount * sizeof(r32));
+		}
+	}
+	else {
+		const r32 scale = src.normalized ? GetNormalizedScale(src.componentType) : 1.0f;
+		const bool signedType = src.componentType == VERTEX_COMPONENT_S8 || src.componentType == VERTEX_COMPONENT_S16;
+		const r32 min = src.normalized && signedType ? -1.0f : -3.4e38f;
+
+		if (packed) {
+			// Same layout on both sides, so it's just one flat array of components
+			const u64 first = begin * dstComponentCount;
+			const u64 count = (end - begin) * dstComponentCount;
+			const u8* pSrc = src.data + first * componentSize;
+			r32* pDst = dst + first;
+
+			const u64 converted = ConvertComponentsWide(pSrc, src.componentType, scale, min, pDst, count);
+			for (u64 i = converted; i < count; i++) {
+				pDst[i] = ReadComponent(pSrc + i * componentSize, src.componentType, scale, min);
+			}
+		}
+		else {
+			for (u64 i = begin; i < end; i++) {
+				const u8* pSrc = src.data + i * stride;
+				r32* pDst = dst + i * dstComponentCount;
+				for (u32 c = 0; c < copyCount; c++) {
+					pDst[c] = ReadComponent(pSrc + c * componentSize, src.componentType, scale, min);
+				}
+			}
+		}
+	}
+
+	if (copyCount < dstComponentCount) {
+		for (u64 i = begin; i < end; i++) {
+			r32* pDst = dst + i * dstComponentCount;
+			for (u32 c = copyCount; c < dstComponentCount; c++) {
+				pDst[c] = c == 3 ? 1.0f : 0.0f;
+			}
+		}
+	}
+}
+
+void DecodeIndexStream(const u8* src, u64 indexSize, u32* dst, u64 begin, u64 end) {
+	if (begin >= end) {
+		return;
+	}
+
+	if (indexSize == sizeof(u32)) {
+		memcpy(dst + begin, src + begin * sizeof(u32), (end - begin) * sizeof(u32));
+		return;
+	}
+
+	u64 i = begin;
+	if (indexSize == sizeof(u8)) {
+#if defined(VERTEX_DECODE_NEON)
+		for (; i + 16 <= end; i += 16) {
+			const uint8x16_t b = vld1q_u8(src + i);
+			const uint16x8_t lo = vmovl_u8(vget_low_u8(b));
+			const uint16x8_t hi = vmovl_u8(vget_high_u8(b));
+			vst1q_u32(dst + i, vmovl_u16(vget_low_u16(lo)));
+			vst1q_u32(dst + i + 4, vmovl_u16(vget_high_u16(lo)));
+			vst1q_u32(dst + i + 8, vmovl_u16(vget_low_u16(hi)));
+			vst1q_u32(dst + i + 12, vmovl_u16(vget_high_u16(hi)));
+		}
+#elif defined(VERTEX_DECODE_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= end; i += 16) {
+			const __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+			const __m128i lo = _mm_unpacklo_epi8(b, zero);
+			const __m128i hi = _mm_unpackhi_epi8(b, zero);
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(lo, zero));
+			_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(lo, zero));
+			_mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpacklo_epi16(hi, zero));
+			_mm_storeu_si128((__m128i*)(dst + i + 12), _mm_unpackhi_epi16(hi, zero));
+		}
+#endif
+		for (; i < end; i++) {
+			dst[i] = src[i];
+		}
+	}
+	else if (indexSize == sizeof(u16)) {
+#if defined(VERTEX_DECODE_NEON)
+		for (; i + 8 <= end; i += 8) {
+			const uint16x8_t w = vld1q_u16((const uint16_t*)(src + i * 2));
+			vst1q_u32(dst + i, vmovl_u16(vget_low_u16(w)));
+			vst1q_u32(dst + i + 4, vmovl_u16(vget_high_u16(w)));
+		}
+#elif defined(VERTEX_DECODE_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 8 <= end; i += 8) {
+			const __m128i w = _mm_loadu_si128((const __m128i*)(src + i * 2));
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(w, zero));
+			_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(w, zero));
+		}
+#endif
+		for (; i < end; i++) {
+			u16 index;
+			memcpy(&index, src + i * 2, sizeof(u16));
+			dst[i] = index;
+		}
+	}
+	else {
+		DEBUG_ERROR("Invalid index size %d", (u32)indexSize);
+	}
+}
+
+void DecodeIndexStream(const u8* src, u64 indexSize, u16* dst, u64 begin, u64 end) {
+	if (begin >= end) {
+		return;
+	}
+
+	if (indexSize == sizeof(u16)) {
+		memcpy(dst + begin, src + begin * sizeof(u16), (end - begin) * sizeof(u16));
+		return;
+	}
+
+	u64 i = begin;
+	if (indexSize == sizeof(u8)) {
+#if defined(VERTEX_DECODE_NEON)
+		for (; i + 16 <= end; i += 16) {
+			const uint8x16_t b = vld1q_u8(src + i);
+			vst1q_u16(dst + i, vmovl_u8(vget_low_u8(b)));
+			vst1q_u16(dst + i + 8, vmovl_u8(vget_high_u8(b)));
+		}
+#elif defined(VERTEX_DECODE_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= end; i += 16) {
+			const __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi8(b, zero));
+			_mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpackhi_epi8(b, zero));
+		}
+#endif
+		for (; i < end; i++) {
+			dst[i] = src[i];
+		}
+	}
+	else if (indexSize == sizeof(u32)) {
+		for (; i < end; i++) {
+			u32 index;
+			memcpy(&index, src + i * 4, sizeof(u32));
+			dst[i] = (u16)index;
+		}
+	}
+	else {
+		DEBUG_ERROR("Invalid index size %d", (u32)indexSize);
+	}
+}
+
+struct DecodeChunk {
+	const VertexStreamDesc* vertexSrc;
+	r32* vertexDst;
+	u32 dstComponentCount;
+
+	const u8* indexSrc;
+	u64 indexSize;
+	u32* indexDst;
+	u16* indexDst16;
+
+	u64 begin;
+	u64 end;
+};
+
+static void DecodeVertexChunkJob(void* userData) {
+	const DecodeChunk& chunk = *(DecodeChunk*)userData;
+	DecodeVertexStream(*chunk.vertexSrc, chunk.vertexDst, chunk.dstComponentCount, chunk.begin, chunk.end);
+}
+
+static void DecodeIndexChunkJob(void* userData) {
+	const DecodeChunk& chunk = *(DecodeChunk*)userData;
+	if (chunk.indexDst16 != nullptr) {
+		DecodeIndexStream(chunk.indexSrc, chunk.indexSize, chunk.indexDst16, chunk.begin, chunk.end);
+	}
+	else {
+		DecodeIndexStream(chunk.indexSrc, chunk.indexSize, chunk.indexDst, chunk.begin, chunk.end);
+	}
+}
+
+// The calling thread helps out while waiting, so this works from inside jobs too
+static void RunDecodeChunks(DecodeChunk& base, u64 count, JobFunction function, JobSystem* jobSystem) {
+	const u64 chunkCount = (count + vertexDecodeChunkSize - 1) / vertexDecodeChunkSize;
+	DecodeChunk* chunks = (DecodeChunk*)calloc(chunkCount, sizeof(DecodeChunk));
+
+	JobCounter counter;
+	for (u64 i = 0; i < chunkCount; i++) {
+		chunks[i] = base;
+		chunks[i].begin = i * vertexDecodeChunkSize;
+		chunks[i].end = (i + 1) * vertexDecodeChunkSize < count ? (i + 1) * vertexDecodeChunkSize : count;
+		jobSystem->Schedule(function, &chunks[i], &counter);
+	}
+	jobSystem->Wait(counter);
+
+	free(chunks);
+}
+
+void DecodeVertexStream(const VertexStreamDesc& src, r32* dst, u32 dstComponentCount, u64 count, JobSystem* jobSystem) {
+	if (jobSystem == nullptr || count < vertexDecodeChunkSize * 2) {
+		DecodeVertexStream(src, dst, dstComponentCount, 0, count);
+		return;
+	}
+
+	DecodeChunk base{};
+	base.vertexSrc = &src;
+	base.vertexDst = dst;
+	base.dstComponentCount = dstComponentCount;
+	RunDecodeChunks(base, count, DecodeVertexChunkJob, jobSystem);
+}
+
+void DecodeIndexStream(const u8* src, u64 indexSize, u32* dst, u64 count, JobSystem* jobSystem) {
+	if (jobSystem == nullptr || count < vertexDecodeChunkSize * 2) {
+		DecodeIndexStream(src, indexSize, dst, 0, count);
+		return;
+	}
+
+	DecodeChunk base{};
+	base.indexSrc = src;
+	base.indexSize = indexSize;
+	base.indexDst = dst;
+	RunDecodeChunks(base, count, DecodeIndexChunkJob, jobSystem);
+}
+
+void DecodeIndexStream(const u8* src, u64 indexSize, u16* dst, u64 count, JobSystem* jobSystem) {
+	if (jobSystem == nullptr || count < vertexDecodeChunkSize * 2) {
+		DecodeIndexStream(src, indexSize, dst, 0, count);
+		return;
+	}
+
+	DecodeChunk base{};
+	base.indexSrc = src;
+	base.indexSize = indexSize;
+	base.indexDst16 = dst;
+	RunDecodeChunks(base, count, DecodeIndexChunkJob, jobSystem);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "typedef.h"
+
+class JobSystem;
+
+// Conversion kernels for vertex and index data coming from asset files (glTF accessors etc.)
+// Uses NEON or SSE2 when available, otherwise plain scalar loops
+
+enum VertexComponentType {
+	VERTEX_COMPONENT_S8,
+	VERTEX_COMPONENT_U8,
+	VERTEX_COMPONENT_S16,
+	VERTEX_COMPONENT_U16,
+	VERTEX_COMPONENT_U32,
+	VERTEX_COMPONENT_FLOAT
+};
+
+struct VertexStreamDesc {
+	const u8* data;
+	u64 stride; // 0 = tightly packed
+	u32 componentCount;
+	VertexComponentType componentType;
+	bool normalized; // Integers map to [0, 1] or [-1, 1] instead of their value
+};
+
+// Accessors bigger than this get split into jobs
+constexpr u64 vertexDecodeChunkSize = 0x10000;
+
+u64 GetVertexComponentSize(VertexComponentType type);
+
+// Converts elements [begin, end) to floats. If the destination has more components than the source,
+// the rest are zero, except a fourth component which is one (so colors get full alpha)
+void DecodeVertexStream(const VertexStreamDesc& src, r32* dst, u32 dstComponentCount, u64 begin, u64 end);
+// Widens u8/u16/u32 indices in [begin, end) to u32
+void DecodeIndexStream(const u8* src, u64 indexSize, u32* dst, u64 begin, u64 end);
+// Same for u16, u32 indices have to fit
+void DecodeIndexStream(const u8* src, u64 indexSize, u16* dst, u64 begin, u64 end);
+
+// Splits the work into chunks on the job system and waits for them. jobSystem can be null
+void DecodeVertexStream(const VertexStreamDesc& src, r32* dst, u32 dstComponentCount, u64 count, JobSystem* jobSystem);
+void DecodeIndexStream(const u8* src, u64 indexSize, u32* dst, u64 count, JobSystem* jobSystem);
+void DecodeIndexStream(const u8* src, u64 indexSize, u16* dst, u64 count, JobSystem* jobSystem);
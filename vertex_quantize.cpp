@@ -0,0 +1,151 @@
+#include "vertex_quantize.h"
+#include <cstring>
+#include <cmath>
+
+static s16 FloatToSnorm16(r32 value) {
+	value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+	return (s16)roundf(value * 32767.0f);
+}
+
+static u8 FloatToUnorm8(r32 value) {
+	value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+	return (u8)roundf(value * 255.0f);
+}
+
+static u16 FloatToUnorm16(r32 value) {
+	value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+	return (u16)roundf(value * 65535.0f);
+}
+
+void GetPositionQuantization(const glm::vec3* positions, u32 count, glm::vec3& outScale, glm::vec3& outOffset) {
+	if (count == 0) {
+		outScale = glm::vec3(1.0f);
+		outOffset = glm::vec3(0.0f);
+		return;
+	}
+
+	glm::vec3 min = positions[0];
+	glm::vec3 max = positions[0];
+	for (u32 i = 1; i < count; i++) {
+		min = glm::min(min, positions[i]);
+		max = glm::max(max, positions[i]);
+	}
+
+	outOffset = (min + max) * 0.5f;
+	outScale = (max - min) * 0.5f;
+	// Flat meshes would divide by zero
+	for (u32 i = 0; i < 3; i++) {
+		if (outScale[i] <= 0.0f) {
+			outScale[i] = 1.0f;
+		}
+	}
+}
+
+void QuantizePositions(const glm::vec3* positions, u32 count, const glm::vec3& scale, const glm::vec3& offset, s16* out) {
+	for (u32 i = 0; i < count; i++) {
+		const glm::vec3 normalized = (positions[i] - offset) / scale;
+		out[i * 4 + 0] = FloatToSnorm16(normalized.x);
+		out[i * 4 + 1] = FloatToSnorm16(normalized.y);
+		out[i * 4 + 2] = FloatToSnorm16(normalized.z);
+		out[i * 4 + 3] = 0;
+	}
+}
+
+glm::vec2 OctahedralEncode(const glm::vec3& n) {
+	const r32 sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if (sum <= 0.0f) {
+		return glm::vec2(0.0f);
+	}
+
+	glm::vec2 result = glm::vec2(n.x, n.y) / sum;
+	if (n.z < 0.0f) {
+		// Fold the lower hemisphere over the diagonals
+		const glm::vec2 folded = glm::vec2(1.0f - fabsf(result.y), 1.0f - fabsf(result.x));
+		result.x = result.x >= 0.0f ? folded.x : -folded.x;
+		result.y = result.y >= 0.0f ? folded.y : -folded.y;
+	}
+	return result;
+}
+
+void QuantizeNormals(const glm::vec3* normals, u32 count, s16* out) {
+	for (u32 i = 0; i < count; i++) {
+		const glm::vec2 encoded = OctahedralEncode(normals[i]);
+		out[i * 2 + 0] = FloatToSnorm16(encoded.x);
+		out[i * 2 + 1] = FloatToSnorm16(encoded.y);
+	}
+}
+
+void QuantizeTangents(const glm::vec4* tangents, u32 count, s16* out) {
+	for (u32 i = 0; i < count; i++) {
+		const glm::vec2 encoded = OctahedralEncode(glm::vec3(tangents[i]));
+		// Remap y to [0, 1] so the sign is free. Never exactly 0, that would lose the sign
+		r32 y = encoded.y * 0.5f + 0.5f;
+		y = y < 1.0f / 32767.0f ? 1.0f / 32767.0f : y;
+		out[i * 2 + 0] = FloatToSnorm16(encoded.x);
+		out[i * 2 + 1] = FloatToSnorm16(tangents[i].w < 0.0f ? -y : y);
+	}
+}
+
+// Round to nearest even, overflow goes to infinity and tiny values to zero or denormals
+u16 FloatToHalf(r32 value) {
+	u32 bits;
+	memcpy(&bits, &value, sizeof(u32));
+
+	const u16 sign = (bits >> 16) & 0x8000;
+	const s32 exponent = (s32)((bits >> 23) & 0xff) - 127 + 15;
+	u32 mantissa = bits & 0x7fffff;
+
+	if (((bits >> 23) & 0xff) == 0xff) {
+		// Inf or NaN
+		return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+	}
+	if (exponent >= 0x1f) {
+		return sign | 0x7c00;
+	}
+	if (exponent <= 0) {
+		if (exponent < -10) {
+			return sign;
+		}
+
+		mantissa |= 0x800000;
+		const u32 shift = 14 - exponent;
+		u32 half = mantissa >> shift;
+		const u32 remainder = mantissa & ((1u << shift) - 1);
+		const u32 halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1))) {
+			half++;
+		}
+		return sign | (u16)half;
+	}
+
+	u32 half = ((u32)exponent << 10) | (mantissa >> 13);
+	const u32 remainder = mantissa & 0x1fff;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+		// Carries into the exponent correctly, and up to infinity at the top
+		half++;
+	}
+	return sign | (u16)half;
+}
+
+void QuantizeTexcoords(const glm::vec2* texcoords, u32 count, u16* out) {
+	for (u32 i = 0; i < count; i++) {
+		out[i * 2 + 0] = FloatToHalf(texcoords[i].x);
+		out[i * 2 + 1] = FloatToHalf(texcoords[i].y);
+	}
+}
+
+void QuantizeColors(const Rendering::Color* colors, u32 count, u8* out) {
+	for (u32 i = 0; i < count; i++) {
+		for (u32 c = 0; c < 4; c++) {
+			out[i * 4 + c] = FloatToUnorm8(colors[i][c]);
+		}
+	}
+}
+
+void QuantizeWeights(const glm::vec4* weights, u32 count, u16* out) {
+	for (u32 i = 0; i < count; i++) {
+		for (u32 c = 0; c < 4; c++) {
+			out[i * 4 + c] = FloatToUnorm16(weights[i][c]);
+		}
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "rendering.h"
+
+// Encoders for Rendering::VERTEX_FORMAT_QUANTIZED streams, the vertex shader does the decoding
+
+// Maps the bounding box of the positions to [-1, 1]
+void GetPositionQuantization(const glm::vec3* positions, u32 count, glm::vec3& outScale, glm::vec3& outOffset);
+// 4 components per vertex, w is 0
+void QuantizePositions(const glm::vec3* positions, u32 count, const glm::vec3& scale, const glm::vec3& offset, s16* out);
+
+glm::vec2 OctahedralEncode(const glm::vec3& n);
+// 2 components per vertex
+void QuantizeNormals(const glm::vec3* normals, u32 count, s16* out);
+// 2 components per vertex. The bitangent sign goes in the sign of y, which costs y one bit of precision
+void QuantizeTangents(const glm::vec4* tangents, u32 count, s16* out);
+
+u16 FloatToHalf(r32 value);
+// 2 components per vertex
+void QuantizeTexcoords(const glm::vec2* texcoords, u32 count, u16* out);
+// 4 components per vertex
+void QuantizeColors(const Rendering::Color* colors, u32 count, u8* out);
+// 4 components per vertex, unorm16
+void QuantizeWeights(const glm::vec4* weights, u32 count, u16* out);
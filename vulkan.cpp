@@ -1,9 +1,28 @@
 #include "vulkan.h"
 #include "system.h"
 #include "math.h"
+#include "vertex_quantize.h"
 #include <cstring>
 
 namespace Rendering {
+	// Vertex buffer bindings, the binding is also the attribute location in the shader
+	struct VertexStreamLayout {
+		u32 binding;
+		VertexAttribFlags attribute;
+		VkFormat format[VERTEX_FORMAT_COUNT];
+	};
+
+	// Strides are in vertexStreamStrides
+	static const VertexStreamLayout vertexStreamLayouts[vertexStreamCount] = {
+		{ 0, VERTEX_POSITION_BIT, { VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R16G16B16A16_SNORM } },
+		{ 1, VERTEX_TEXCOORD_0_BIT, { VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R16G16_SFLOAT } },
+		{ 2, VERTEX_NORMAL_BIT, { VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R16G16_SNORM } },
+		{ 3, VERTEX_TANGENT_BIT, { VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R16G16_SNORM } },
+		{ 4, VERTEX_COLOR_BIT, { VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R8G8B8A8_UNORM } },
+		{ 5, VERTEX_JOINTS_BIT, { VK_FORMAT_R16G16B16A16_UINT, VK_FORMAT_R16G16B16A16_UINT } },
+		{ 6, VERTEX_WEIGHTS_BIT, { VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R16G16B16A16_UNORM } },
+	};
+
 	Vulkan::Vulkan(const XR::XRInstance* const xrInstance) {
 		DEBUG_LOG("Initializing vulkan...");
 
@@ -102,17 +121,18 @@ namespace Rendering {
 
 		CreateRenderPasses();
 
-		// Likely overkill pool sizes
+		// Every material has a set per frame in flight, the rest is likely overkill
+		constexpr u32 materialSetCount = maxMaterialCount * maxFramesInFlight;
 		VkDescriptorPoolSize poolSizes[] = {
 			{ VK_DESCRIPTOR_TYPE_SAMPLER, 1000 },
-			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000 },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, materialSetCount * (maxSamplerCount + 1) },
 			{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000 },
 			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000 },
 			{ VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000 },
 			{ VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000 },
-			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000 },
-			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000 },
-			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000 },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, materialSetCount * 3 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, materialSetCount },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, materialSetCount },
 			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000 },
 			{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000 }
 		};
@@ -122,12 +142,13 @@ namespace Rendering {
 		descriptorPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 		descriptorPoolInfo.poolSizeCount = 11;
 		descriptorPoolInfo.pPoolSizes = poolSizes;
-		descriptorPoolInfo.maxSets = 1000;
+		descriptorPoolInfo.maxSets = MAX(materialSetCount, 1000u);
 
 		vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool);
 
 		CreateUniformBuffers();
 		CreatePerInstanceBuffers();
+		CreateJointBuffers();
 		CreateFrameData();
 
 		VkCommandPoolCreateInfo poolInfo{};
@@ -149,13 +170,17 @@ namespace Rendering {
 
 		// Free all user-created resources
 		PoolHandle<Texture> texHandle;
-		while (textures.GetHandle(0, texHandle)) {
-			FreeTexture((TextureHandle)texHandle.Raw());
+		for (u32 i = 0; i < textures.SlotCount(); i++) {
+			if (textures.GetSlotHandle(i, texHandle)) {
+				FreeTexture((TextureHandle)texHandle.Raw());
+			}
 		}
 
 		PoolHandle<Mesh> meshHandle;
-		while (meshes.GetHandle(0, meshHandle)) {
-			FreeMesh((MeshHandle)meshHandle.Raw());
+		for (u32 i = 0; i < meshes.SlotCount(); i++) {
+			if (meshes.GetSlotHandle(i, meshHandle)) {
+				FreeMesh((MeshHandle)meshHandle.Raw());
+			}
 		}
 
 		PoolHandle<Shader> shaderHandle;
@@ -171,6 +196,7 @@ namespace Rendering {
 		FreeFramebuffer();
 
 		FreeFrameData();
+		FreeJointBuffers();
 		FreePerInstanceBuffers();
 		FreeUniformBuffers();
 
@@ -643,9 +669,20 @@ namespace Rendering {
 		}
 	}
 	void Vulkan::FreeFrameData() {
+		// Uploads that were never recorded
+		for (const PendingBufferUpload& upload : pendingBufferUploads) {
+			FreeBuffer(upload.staging);
+		}
+		pendingBufferUploads.clear();
+		for (const PendingTextureUpload& upload : pendingTextureUploads) {
+			FreeBuffer(upload.staging);
+		}
+		pendingTextureUploads.clear();
+
 		for (int i = 0; i < maxFramesInFlight; i++) {
-			const FrameData& frame = frames[i];
+			FrameData& frame = frames[i];
 
+			DestroyRetiredFrameResources(frame);
 			vkDestroyFence(device, frame.cmdFence, nullptr);
 			vkFreeCommandBuffers(device, frame.cmdPool, 1, &frame.cmdBuffer);
 
@@ -700,6 +737,20 @@ namespace Rendering {
 	void Vulkan::FreePerInstanceBuffers() {
 
 	}
+	void Vulkan::CreateJointBuffers() {
+		jointDataSize = sizeof(glm::mat4) * maxJointCount;
+
+		AllocateBuffer(jointDataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, jointHostBuffer);
+		AllocateBuffer(jointDataSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, jointDeviceBuffer);
+
+		vkMapMemory(device, jointHostBuffer.memory, 0, jointDataSize, 0, (void**)&pHostVisibleJointData);
+	}
+	void Vulkan::FreeJointBuffers() {
+		vkUnmapMemory(device, jointHostBuffer.memory);
+
+		FreeBuffer(jointDeviceBuffer);
+		FreeBuffer(jointHostBuffer);
+	}
 
 	s32 Vulkan::GetDeviceMemoryTypeIndex(u32 typeFilter, VkMemoryPropertyFlags propertyFlags) {
 		VkPhysicalDeviceMemoryProperties memProperties;
@@ -727,6 +778,31 @@ namespace Rendering {
 		return commandBuffer;
 	}
 
+	VkCommandBuffer Vulkan::BeginTemporaryCommands() {
+		VkCommandBuffer commandBuffer = GetTemporaryCommandBuffer();
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		return commandBuffer;
+	}
+
+	void Vulkan::EndTemporaryCommands(VkCommandBuffer commandBuffer) {
+		vkEndCommandBuffer(commandBuffer);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+
+		vkQueueSubmit(primaryQueue, 1, &submitInfo, VK_NULL_HANDLE);
+		vkQueueWaitIdle(primaryQueue);
+
+		vkFreeCommandBuffers(device, tempCommandPool, 1, &commandBuffer);
+	}
+
 	void Vulkan::AllocateMemory(VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, VkDeviceMemory& outMemory) {
 		VkMemoryAllocateInfo memAllocInfo{};
 		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
@@ -803,35 +879,9 @@ namespace Rendering {
         return memRequirements.memoryRequirements.size;
 	}
 
-	void Vulkan::CopyBuffer(const VkBuffer& src, const VkBuffer& dst, VkDeviceSize size) {
-		VkCommandBuffer temp = GetTemporaryCommandBuffer();
-
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-		vkBeginCommandBuffer(temp, &beginInfo);
-
-		VkBufferCopy copyRegion{};
-		copyRegion.srcOffset = 0; // Optional
-		copyRegion.dstOffset = 0; // Optional
-		copyRegion.size = size;
-		vkCmdCopyBuffer(temp, src, dst, 1, &copyRegion);
-
-		vkEndCommandBuffer(temp);
-
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &temp;
-
-		vkQueueSubmit(primaryQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(primaryQueue); // Bad?
-
-		vkFreeCommandBuffers(device, tempCommandPool, 1, &temp);
-	}
-
-	void Vulkan::CopyRawDataToBuffer(void* src, const VkBuffer& dst, VkDeviceSize size) {
+	// The copy is recorded into the next frame's commands, so the render thread doesn't wait for the queue
+	// The owning mesh is checked then, in case it was freed before the copy was recorded
+	void Vulkan::CopyRawDataToBuffer(MeshHandle owner, const void* src, const VkBuffer& dst, VkDeviceSize size) {
 		Buffer stagingBuffer{};
 		AllocateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer);
 
@@ -840,9 +890,39 @@ namespace Rendering {
 		memcpy(data, src, size);
 		vkUnmapMemory(device, stagingBuffer.memory);
 
-		CopyBuffer(stagingBuffer.buffer, dst, size);
+		pendingBufferUploads.push_back({ stagingBuffer, owner, dst, size });
+	}
+
+	// Staging buffers go to the frame's retire list, they're freed after its fence like the streaming ones
+	void Vulkan::RecordPendingUploads(FrameData& frame) {
+		if (!pendingBufferUploads.empty()) {
+			for (const PendingBufferUpload& upload : pendingBufferUploads) {
+				if (meshes[upload.mesh] != nullptr) {
+					VkBufferCopy copyRegion{};
+					copyRegion.size = upload.size;
+					vkCmdCopyBuffer(frame.cmdBuffer, upload.staging.buffer, upload.dst, 1, &copyRegion);
+				}
+				frame.retiredBuffers.push_back(upload.staging);
+			}
+			pendingBufferUploads.clear();
+
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.pNext = nullptr;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+			vkCmdPipelineBarrier(frame.cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
 
-		FreeBuffer(stagingBuffer);
+		for (const PendingTextureUpload& upload : pendingTextureUploads) {
+			const Texture* texture = textures[upload.texture];
+			if (texture != nullptr) {
+				RecordTextureUpload(frame.cmdBuffer, *texture, upload.staging.buffer, upload.firstMip, upload.generateMips);
+			}
+			frame.retiredBuffers.push_back(upload.staging);
+		}
+		pendingTextureUploads.clear();
 	}
 
 	void Vulkan::FreeBuffer(const Buffer& buffer) {
@@ -911,6 +991,18 @@ namespace Rendering {
 			bindingIndex++;
 		}
 
+		// Joint palettes
+		if ((info.flags & DSF_JOINTDATA) == DSF_JOINTDATA)
+		{
+			bindings[bindingIndex].binding = jointDataBinding;
+			bindings[bindingIndex].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[bindingIndex].descriptorCount = 1;
+			bindings[bindingIndex].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+			bindings[bindingIndex].pImmutableSamplers = nullptr;
+
+			bindingIndex++;
+		}
+
 		// Material data
 		if ((info.flags & DSF_SHADERDATA) == DSF_SHADERDATA)
 		{
@@ -956,7 +1048,7 @@ namespace Rendering {
 		vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout);
 	}
 
-	void Vulkan::CreateShaderRenderPipeline(VkPipelineLayout& outLayout, VkPipeline& outPipeline, const VkDescriptorSetLayout &descSetLayout, VertexAttribFlags vertexInputs, const char* vert, u32 vertSize, const char* frag, u32 fragSize) {
+	void Vulkan::CreateShaderRenderPipeline(VkPipelineLayout& outLayout, VkPipeline* outPipelines, const VkDescriptorSetLayout &descSetLayout, VertexAttribFlags vertexInputs, const char* vert, u32 vertSize, const char* frag, u32 fragSize) {
 		// Create shader modules
 		VkShaderModule vertShader = CreateShaderModule(vert, vertSize);
 
@@ -980,83 +1072,64 @@ namespace Rendering {
 		fragShaderStageInfo.pName = "main";
 		fragShaderStageInfo.pSpecializationInfo = nullptr;
 
-		VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-		// Vertex input
-		VkVertexInputBindingDescription vertDescriptions[10];
-		VkVertexInputAttributeDescription attributeDescriptions[10];
+		// Vertex input, one set of descriptions per vertex format
+		VkVertexInputBindingDescription vertDescriptions[VERTEX_FORMAT_COUNT][vertexStreamCount];
+		VkVertexInputAttributeDescription attributeDescriptions[VERTEX_FORMAT_COUNT][vertexStreamCount];
 		u32 vertexInputCount = 0;
 
-		if (vertexInputs & VERTEX_POSITION_BIT) {
-			vertDescriptions[vertexInputCount].binding = 0;
-			vertDescriptions[vertexInputCount].stride = sizeof(glm::vec3);
-			vertDescriptions[vertexInputCount].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-			attributeDescriptions[vertexInputCount].binding = 0;
-			attributeDescriptions[vertexInputCount].location = 0;
-			attributeDescriptions[vertexInputCount].format = VK_FORMAT_R32G32B32_SFLOAT;
-			attributeDescriptions[vertexInputCount].offset = 0;
+		for (u32 i = 0; i < vertexStreamCount; i++) {
+			const VertexStreamLayout& stream = vertexStreamLayouts[i];
+			if ((vertexInputs & stream.attribute) == 0) {
+				continue;
+			}
 
-			vertexInputCount++;
-		}
-		if (vertexInputs & VERTEX_TEXCOORD_0_BIT) {
-			vertDescriptions[vertexInputCount].binding = 1;
-			vertDescriptions[vertexInputCount].stride = sizeof(glm::vec2);
-			vertDescriptions[vertexInputCount].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+			for (u32 format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+				vertDescriptions[format][vertexInputCount].binding = stream.binding;
+				vertDescriptions[format][vertexInputCount].stride = vertexStreamStrides[i][format];
+				vertDescriptions[format][vertexInputCount].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-			attributeDescriptions[vertexInputCount].binding = 1;
-			attributeDescriptions[vertexInputCount].location = 1;
-			attributeDescriptions[vertexInputCount].format = VK_FORMAT_R32G32_SFLOAT;
-			attributeDescriptions[vertexInputCount].offset = 0;
+				attributeDescriptions[format][vertexInputCount].binding = stream.binding;
+				attributeDescriptions[format][vertexInputCount].location = stream.binding;
+				attributeDescriptions[format][vertexInputCount].format = stream.format[format];
+				attributeDescriptions[format][vertexInputCount].offset = 0;
+			}
 
 			vertexInputCount++;
 		}
-		if (vertexInputs & VERTEX_NORMAL_BIT) {
-			vertDescriptions[vertexInputCount].binding = 2;
-			vertDescriptions[vertexInputCount].stride = sizeof(glm::vec3);
-			vertDescriptions[vertexInputCount].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-			attributeDescriptions[vertexInputCount].binding = 2;
-			attributeDescriptions[vertexInputCount].location = 2;
-			attributeDescriptions[vertexInputCount].format = VK_FORMAT_R32G32B32_SFLOAT;
-			attributeDescriptions[vertexInputCount].offset = 0;
 
-			vertexInputCount++;
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo[VERTEX_FORMAT_COUNT];
+		for (u32 format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+			vertexInputInfo[format].sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+			vertexInputInfo[format].pNext = nullptr;
+			vertexInputInfo[format].flags = 0;
+			vertexInputInfo[format].vertexBindingDescriptionCount = vertexInputCount;
+			vertexInputInfo[format].pVertexBindingDescriptions = vertDescriptions[format];
+			vertexInputInfo[format].vertexAttributeDescriptionCount = vertexInputCount;
+			vertexInputInfo[format].pVertexAttributeDescriptions = attributeDescriptions[format];
 		}
-		if (vertexInputs & VERTEX_TANGENT_BIT) {
-			vertDescriptions[vertexInputCount].binding = 3;
-			vertDescriptions[vertexInputCount].stride = sizeof(glm::vec4);
-			vertDescriptions[vertexInputCount].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-			attributeDescriptions[vertexInputCount].binding = 3;
-			attributeDescriptions[vertexInputCount].location = 3;
-			attributeDescriptions[vertexInputCount].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-			attributeDescriptions[vertexInputCount].offset = 0;
+		// The vertex shader picks the decoding with a specialization constant (constant_id 0 = quantized)
+		// Skinned shaders are a separate module (vert_skinned.spv) whose joint and weight inputs match vertexInputs
+		VkSpecializationMapEntry specializationEntry;
+		specializationEntry.constantID = 0;
+		specializationEntry.offset = 0;
+		specializationEntry.size = sizeof(VkBool32);
 
-			vertexInputCount++;
-		}
-		if (vertexInputs & VERTEX_COLOR_BIT) {
-			vertDescriptions[vertexInputCount].binding = 4;
-			vertDescriptions[vertexInputCount].stride = sizeof(glm::vec4);
-			vertDescriptions[vertexInputCount].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		VkBool32 specializationData[VERTEX_FORMAT_COUNT];
+		VkSpecializationInfo specializationInfo[VERTEX_FORMAT_COUNT];
+		VkPipelineShaderStageCreateInfo shaderStages[VERTEX_FORMAT_COUNT][2];
+		for (u32 format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+			specializationData[format] = format == VERTEX_FORMAT_QUANTIZED ? VK_TRUE : VK_FALSE;
+			specializationInfo[format].mapEntryCount = 1;
+			specializationInfo[format].pMapEntries = &specializationEntry;
+			specializationInfo[format].dataSize = sizeof(VkBool32);
+			specializationInfo[format].pData = &specializationData[format];
 
-			attributeDescriptions[vertexInputCount].binding = 4;
-			attributeDescriptions[vertexInputCount].location = 4;
-			attributeDescriptions[vertexInputCount].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-			attributeDescriptions[vertexInputCount].offset = 0;
-
-			vertexInputCount++;
+			shaderStages[format][0] = vertShaderStageInfo;
+			shaderStages[format][0].pSpecializationInfo = &specializationInfo[format];
+			shaderStages[format][1] = fragShaderStageInfo;
 		}
 
-		VkPipelineVertexInputStateCreateInfo vertexInputInfo;
-		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.pNext = nullptr;
-		vertexInputInfo.flags = 0;
-		vertexInputInfo.vertexBindingDescriptionCount = vertexInputCount;
-		vertexInputInfo.pVertexBindingDescriptions = vertDescriptions;
-		vertexInputInfo.vertexAttributeDescriptionCount = vertexInputCount;
-		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
-
 		VkPipelineInputAssemblyStateCreateInfo inputAssembly;
 		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 		inputAssembly.pNext = nullptr;
@@ -1150,8 +1223,13 @@ namespace Rendering {
 		pipelineLayoutInfo.flags = 0;
 		pipelineLayoutInfo.setLayoutCount = 1;
 		pipelineLayoutInfo.pSetLayouts = &descSetLayout;
-		pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-		pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+
+		VkPushConstantRange pushConstantRange;
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(VertexQuantizationData) + sizeof(VertexSkinningData);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
 		vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &outLayout);
 
@@ -1169,27 +1247,29 @@ namespace Rendering {
 		dynamicStateInfo.dynamicStateCount = 2;
 		dynamicStateInfo.pDynamicStates = dynamicStates;
 
-		VkGraphicsPipelineCreateInfo pipelineInfo;
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.pNext = nullptr;
-		pipelineInfo.flags = 0;
-		pipelineInfo.stageCount = 2;
-		pipelineInfo.pStages = shaderStages;
-		pipelineInfo.pVertexInputState = &vertexInputInfo;
-		pipelineInfo.pInputAssemblyState = &inputAssembly;
-		pipelineInfo.pViewportState = &viewportState;
-		pipelineInfo.pRasterizationState = &rasterizer;
-		pipelineInfo.pMultisampleState = &multisampling;
-		pipelineInfo.pDepthStencilState = &depthStencil;
-		pipelineInfo.pColorBlendState = &colorBlending;
-		pipelineInfo.pDynamicState = &dynamicStateInfo;
-		pipelineInfo.layout = outLayout;
-		pipelineInfo.renderPass = forwardRenderPass;
-		pipelineInfo.subpass = 0;
-		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-		pipelineInfo.basePipelineIndex = -1; // Optional
-
-		vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &outPipeline);
+		VkGraphicsPipelineCreateInfo pipelineInfo[VERTEX_FORMAT_COUNT];
+		for (u32 format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+			pipelineInfo[format].sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+			pipelineInfo[format].pNext = nullptr;
+			pipelineInfo[format].flags = 0;
+			pipelineInfo[format].stageCount = 2;
+			pipelineInfo[format].pStages = shaderStages[format];
+			pipelineInfo[format].pVertexInputState = &vertexInputInfo[format];
+			pipelineInfo[format].pInputAssemblyState = &inputAssembly;
+			pipelineInfo[format].pViewportState = &viewportState;
+			pipelineInfo[format].pRasterizationState = &rasterizer;
+			pipelineInfo[format].pMultisampleState = &multisampling;
+			pipelineInfo[format].pDepthStencilState = &depthStencil;
+			pipelineInfo[format].pColorBlendState = &colorBlending;
+			pipelineInfo[format].pDynamicState = &dynamicStateInfo;
+			pipelineInfo[format].layout = outLayout;
+			pipelineInfo[format].renderPass = forwardRenderPass;
+			pipelineInfo[format].subpass = 0;
+			pipelineInfo[format].basePipelineHandle = VK_NULL_HANDLE; // Optional
+			pipelineInfo[format].basePipelineIndex = -1; // Optional
+		}
+
+		vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, VERTEX_FORMAT_COUNT, pipelineInfo, nullptr, outPipelines);
 
 		vkDestroyShaderModule(device, vertShader, nullptr);
 		vkDestroyShaderModule(device, fragShader, nullptr);
@@ -1226,6 +1306,16 @@ namespace Rendering {
 			UpdateDescriptorSetBuffer(descriptorSet, perInstanceDataBinding, bufferInfo, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
 		}
 
+		if ((info.flags & DSF_JOINTDATA) == DSF_JOINTDATA)
+		{
+			VkDescriptorBufferInfo bufferInfo{};
+			bufferInfo.buffer = jointDeviceBuffer.buffer;
+			bufferInfo.offset = 0;
+			bufferInfo.range = jointDataSize;
+
+			UpdateDescriptorSetBuffer(descriptorSet, jointDataBinding, bufferInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		}
+
 		if ((info.flags & DSF_SHADERDATA) == DSF_SHADERDATA)
 		{
 			if (matHandle < 0) {
@@ -1303,108 +1393,317 @@ namespace Rendering {
 		vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
 	}
 
-	TextureHandle Vulkan::CreateTexture(const TextureCreateInfo& info) {
-		VkFormat format = VK_FORMAT_UNDEFINED;
-		u32 layerCount = info.type == TEXTURE_CUBEMAP ? 6 : 1;
+	static u32 GetMipDimension(u32 dimension, u32 mip) {
+		return MAX(dimension >> mip, 1u);
+	}
+
+	// Size of mips [firstMip, lastMip) for all layers, tightly packed like the source data
+	static VkDeviceSize GetTextureChainSize(TextureCompression compression, u32 width, u32 height, u32 layerCount, u32 firstMip, u32 lastMip) {
+		u32 blockWidth = 1;
+		u32 blockHeight = 1;
+		u32 blockBytes = 4;
+		if (compression != TEXCOMPRESSION_NONE) {
+			blockWidth = ((u32)compression >> 4) & 0xf;
+			blockHeight = ((u32)compression >> 8) & 0xf;
+			blockBytes = 16;
+		}
+
+		VkDeviceSize result = 0;
+		for (u32 mip = firstMip; mip < lastMip; mip++) {
+			const u32 blocksX = (GetMipDimension(width, mip) + blockWidth - 1) / blockWidth;
+			const u32 blocksY = (GetMipDimension(height, mip) + blockHeight - 1) / blockHeight;
+			result += (VkDeviceSize)blocksX * blocksY * blockBytes * layerCount;
+		}
+		return result;
+	}
+
+	static VkDeviceSize GetTextureChainSize(const TextureCompression compression, const u32 width, const u32 height, const u32 layerCount, const u32 lastMip) {
+		return GetTextureChainSize(compression, width, height, layerCount, 0, lastMip);
+	}
+
+	// Coarsest mip that is always kept resident for streamed textures
+	static u32 GetStreamingTailMip(u32 width, u32 height, u32 mipCount) {
+		u32 mip = 0;
+		while (mip < mipCount - 1 && MAX(GetMipDimension(width, mip), GetMipDimension(height, mip)) > textureStreamingTailSize) {
+			mip++;
+		}
+		return mip;
+	}
+
+	static void CmdTextureBarrier(VkCommandBuffer commandBuffer, VkImage image, u32 baseMip, u32 mipCount, u32 layerCount, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.pNext = nullptr;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = baseMip;
+		barrier.subresourceRange.levelCount = mipCount;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = layerCount;
+
+		vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	// Creates an image, memory and view for mips [baseMip, mipCount) of the texture
+	void Vulkan::CreateTextureImage(const Texture& texture, u32 baseMip, VkImage& outImage, VkDeviceMemory& outMemory, VkImageView& outView, VkDeviceSize& outBytes) {
+		const u32 levelCount = texture.mipCount - baseMip;
 
-		switch (info.compression) {
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.flags = (texture.viewType == VK_IMAGE_VIEW_TYPE_CUBE || texture.viewType == VK_IMAGE_VIEW_TYPE_CUBE_ARRAY) ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = GetMipDimension(texture.width, baseMip);
+		imageInfo.extent.height = GetMipDimension(texture.height, baseMip);
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = levelCount;
+		imageInfo.arrayLayers = texture.layerCount;
+		imageInfo.format = texture.format;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+
+		vkCreateImage(device, &imageInfo, nullptr, &outImage);
+
+		outBytes = AllocateImage(outImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, outMemory);
+
+		// The view only covers the resident mips, so sampling is clamped to what's actually in memory
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = outImage;
+		viewInfo.viewType = texture.viewType;
+		viewInfo.format = texture.format;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = levelCount;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = texture.layerCount;
+
+		vkCreateImageView(device, &viewInfo, nullptr, &outView);
+	}
+
+	// Records copies of mips [firstMip, lastMip) from a tightly packed buffer into an image whose first level is baseMip
+	void Vulkan::CopyTextureLevels(VkCommandBuffer commandBuffer, const VkBuffer& src, const Texture& texture, VkImage dst, u32 baseMip, u32 firstMip, u32 lastMip) {
+		VkDeviceSize bufferOffset = 0;
+
+		for (u32 mip = firstMip; mip < lastMip; mip++) {
+			VkBufferImageCopy region{};
+			region.bufferOffset = bufferOffset;
+			region.bufferRowLength = 0;
+			region.bufferImageHeight = 0;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = mip - baseMip;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = texture.layerCount;
+			region.imageOffset = { 0,0,0 };
+			region.imageExtent = { GetMipDimension(texture.width, mip), GetMipDimension(texture.height, mip), 1 };
+
+			vkCmdCopyBufferToImage(commandBuffer, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+			bufferOffset += GetTextureChainSize(texture.compression, texture.width, texture.height, texture.layerCount, mip, mip + 1);
+		}
+	}
+
+	static VkFormat GetTextureFormat(TextureCompression compression, ColorSpace space) {
+		const bool srgb = space == COLORSPACE_SRGB;
+		switch (compression) {
 			case TEXCOMPRESSION_NONE:
-				format = VK_FORMAT_R8G8B8A8_SRGB;
-				break;
+				return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
 			case TEXCOMPRESSION_ASTC_4x4:
-				format = VK_FORMAT_ASTC_4x4_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_4x4_SRGB_BLOCK : VK_FORMAT_ASTC_4x4_UNORM_BLOCK;
 			case TEXCOMPRESSION_ASTC_5x4:
-				format = VK_FORMAT_ASTC_5x4_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_5x4_SRGB_BLOCK : VK_FORMAT_ASTC_5x4_UNORM_BLOCK;
 			case TEXCOMPRESSION_ASTC_5x5:
-				format = VK_FORMAT_ASTC_5x5_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_5x5_SRGB_BLOCK : VK_FORMAT_ASTC_5x5_UNORM_BLOCK;
 			case TEXCOMPRESSION_ASTC_6x5:
-				format = VK_FORMAT_ASTC_6x5_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_6x5_SRGB_BLOCK : VK_FORMAT_ASTC_6x5_UNORM_BLOCK;
 			case TEXCOMPRESSION_ASTC_6x6:
-				format = VK_FORMAT_ASTC_6x6_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_6x6_SRGB_BLOCK : VK_FORMAT_ASTC_6x6_UNORM_BLOCK;
 			case TEXCOMPRESSION_ASTC_8x5:
-				format = VK_FORMAT_ASTC_8x5_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_8x5_SRGB_BLOCK : VK_FORMAT_ASTC_8x5_UNORM_BLOCK;
 			case TEXCOMPRESSION_ASTC_8x6:
-				format = VK_FORMAT_ASTC_8x6_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_8x6_SRGB_BLOCK : VK_FORMAT_ASTC_8x6_UNORM_BLOCK;
 			case TEXCOMPRESSION_ASTC_8x8:
-				format = VK_FORMAT_ASTC_8x8_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_8x8_SRGB_BLOCK : VK_FORMAT_ASTC_8x8_UNORM_BLOCK;
 			case TEXCOMPRESSION_ASTC_10x5:
-				format = VK_FORMAT_ASTC_10x5_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_10x5_SRGB_BLOCK : VK_FORMAT_ASTC_10x5_UNORM_BLOCK;
 			case TEXCOMPRESSION_ASTC_10x6:
-				format = VK_FORMAT_ASTC_10x6_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_10x6_SRGB_BLOCK : VK_FORMAT_ASTC_10x6_UNORM_BLOCK;
 			case TEXCOMPRESSION_ASTC_10x8:
-				format = VK_FORMAT_ASTC_10x8_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_10x8_SRGB_BLOCK : VK_FORMAT_ASTC_10x8_UNORM_BLOCK;
 			case TEXCOMPRESSION_ASTC_10x10:
-				format = VK_FORMAT_ASTC_10x10_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_10x10_SRGB_BLOCK : VK_FORMAT_ASTC_10x10_UNORM_BLOCK;
 			case TEXCOMPRESSION_ASTC_12x10:
-				format = VK_FORMAT_ASTC_12x10_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_12x10_SRGB_BLOCK : VK_FORMAT_ASTC_12x10_UNORM_BLOCK;
 			case TEXCOMPRESSION_ASTC_12x12:
-				format = VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
-				break;
+				return srgb ? VK_FORMAT_ASTC_12x12_SRGB_BLOCK : VK_FORMAT_ASTC_12x12_UNORM_BLOCK;
 			default:
-				break;
+				return VK_FORMAT_UNDEFINED;
 		}
+	}
 
-		if (info.space == COLORSPACE_LINEAR) {
-			// Stupid hack...
-			(*((int*)(&format)))++;
+	// Writes mips [firstMip, lastMip) of the source data tightly packed to dst
+	static void ReadTextureLevels(const TextureCreateInfo& info, u32 layerCount, u32 firstMip, u32 lastMip, u8* dst) {
+		const VkDeviceSize offset = GetTextureChainSize(info.compression, info.width, info.height, layerCount, firstMip);
+		if (info.readLevel == nullptr) {
+			memcpy(dst, info.pixels + offset, GetTextureChainSize(info.compression, info.width, info.height, layerCount, firstMip, lastMip));
+			return;
 		}
 
-		u32 mipCount = 1;
-		if (info.generateMips) {
-			mipCount += (u32)std::floor(std::log2(MAX(info.width, info.height)));
+		for (u32 mip = firstMip; mip < lastMip; mip++) {
+			const VkDeviceSize levelBytes = GetTextureChainSize(info.compression, info.width, info.height, layerCount, mip, mip + 1);
+			info.readLevel(info.readLevelUserData, mip, dst, levelBytes);
+			dst += levelBytes;
 		}
+	}
 
+	// Mips [firstMip, mipCount) from the tightly packed staging buffer, or only firstMip if the rest are generated by blitting
+	void Vulkan::RecordTextureUpload(VkCommandBuffer cmd, const Texture& texture, const VkBuffer& staging, u32 firstMip, bool generateMips) {
+		CmdTextureBarrier(cmd, texture.image, 0, texture.mipCount - firstMip, texture.layerCount, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+		CopyTextureLevels(cmd, staging, texture, texture.image, firstMip, firstMip, generateMips ? firstMip + 1 : texture.mipCount);
+
+		if (!generateMips) {
+			CmdTextureBarrier(cmd, texture.image, 0, texture.mipCount - firstMip, texture.layerCount, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		}
+		else {
+			// Generate mipmaps
+			VkImageMemoryBarrier mipBarrier{};
+			mipBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			mipBarrier.pNext = nullptr;
+			mipBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			mipBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			mipBarrier.image = texture.image;
+			mipBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			mipBarrier.subresourceRange.levelCount = 1;
+			mipBarrier.subresourceRange.baseArrayLayer = 0;
+			mipBarrier.subresourceRange.layerCount = texture.layerCount;
+
+			s32 mipWidth = texture.width;
+			s32 mipHeight = texture.height;
+
+			for (u32 i = 1; i < texture.mipCount; i++)
+			{
+				mipBarrier.subresourceRange.baseMipLevel = i - 1;
+				mipBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				mipBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				mipBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				mipBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+				vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
+
+				VkImageBlit blit{};
+				blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				blit.srcSubresource.mipLevel = i - 1;
+				blit.srcSubresource.baseArrayLayer = 0;
+				blit.srcSubresource.layerCount = texture.layerCount;
+				blit.srcOffsets[0] = { 0, 0, 0 };
+				blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+				blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				blit.dstSubresource.mipLevel = i;
+				blit.dstSubresource.baseArrayLayer = 0;
+				blit.dstSubresource.layerCount = texture.layerCount;
+				blit.dstOffsets[0] = { 0, 0, 0 };
+				blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
+
+				vkCmdBlitImage(cmd, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+				mipBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+				mipBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				mipBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				mipBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+				vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
+
+				if (mipWidth > 1)
+					mipWidth /= 2;
+				if (mipHeight > 1)
+					mipHeight /= 2;
+			}
+
+			mipBarrier.subresourceRange.baseMipLevel = texture.mipCount - 1;
+			mipBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			mipBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			mipBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			mipBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
+		}
+	}
+
+	TextureHandle Vulkan::ReserveTexture() {
 		PoolHandle<Texture> handle;
-		Texture* texture = textures.Add(handle);
-		if (texture == nullptr) {
-			DEBUG_ERROR("Error creating texture");
+		if (!textures.ReserveHandle(handle)) {
+			DEBUG_ERROR("Error reserving texture");
 		}
+		return (TextureHandle)handle.Raw();
+	}
+	void Vulkan::CancelTexture(TextureHandle reserved) {
+		textures.CancelReservation(reserved);
+	}
 
-		VkImageCreateInfo imageInfo{};
-		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageInfo.flags = info.type == TEXTURE_CUBEMAP ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
-		imageInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageInfo.extent.width = info.width;
-		imageInfo.extent.height = info.height;
-		imageInfo.extent.depth = 1;
-		imageInfo.mipLevels = mipCount;
-		imageInfo.arrayLayers = layerCount;
-		imageInfo.format = format;
-		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	TextureHandle Vulkan::CreateTexture(const TextureCreateInfo& info, TextureHandle reserved) {
+		const VkFormat format = GetTextureFormat(info.compression, info.space);
+		if (format == VK_FORMAT_UNDEFINED) {
+			DEBUG_ERROR("Unsupported texture compression %d", info.compression);
+		}
 
-		vkCreateImage(device, &imageInfo, nullptr, &texture->image);
+		const u32 arrayLayerCount = MAX(info.layerCount, 1u);
+		const u32 layerCount = info.type == TEXTURE_CUBEMAP ? 6 * arrayLayerCount : arrayLayerCount;
+		VkImageViewType viewType = arrayLayerCount > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+		if (info.type == TEXTURE_CUBEMAP) {
+			viewType = arrayLayerCount > 1 ? VK_IMAGE_VIEW_TYPE_CUBE_ARRAY : VK_IMAGE_VIEW_TYPE_CUBE;
+		}
 
-		VkDeviceSize imageBytes = AllocateImage(texture->image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture->memory);
+		const u32 sourceMipCount = MAX(info.mipCount, 1u);
+		// Blitting isn't supported for block compressed formats, those need to come with their mips precomputed
+		const bool generateMips = info.generateMips && sourceMipCount == 1 && info.compression == TEXCOMPRESSION_NONE;
+		if (info.generateMips && info.compression != TEXCOMPRESSION_NONE) {
+			DEBUG_LOG("Cannot generate mips for compressed textures");
+		}
 
-		VkImageViewCreateInfo viewInfo{};
-		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		viewInfo.image = texture->image;
-		viewInfo.viewType = info.type == TEXTURE_CUBEMAP ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_2D;
-		viewInfo.format = format;
-		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		viewInfo.subresourceRange.baseMipLevel = 0;
-		viewInfo.subresourceRange.levelCount = mipCount;
-		viewInfo.subresourceRange.baseArrayLayer = 0;
-		viewInfo.subresourceRange.layerCount = layerCount;
+		u32 mipCount = sourceMipCount;
+		if (generateMips) {
+			mipCount += (u32)std::floor(std::log2(MAX(info.width, info.height)));
+		}
+
+		const PoolHandle<Texture> handle = reserved;
+		Texture* texture = textures.GetReserved(handle);
+		if (texture == nullptr) {
+			DEBUG_ERROR("Error creating texture, the handle isn't reserved");
+		}
 
-		vkCreateImageView(device, &viewInfo, nullptr, &texture->view);
+		texture->format = format;
+		texture->viewType = viewType;
+		texture->compression = info.compression;
+		texture->width = info.width;
+		texture->height = info.height;
+		texture->layerCount = layerCount;
+		texture->mipCount = mipCount;
+		texture->streamSource = nullptr;
+		texture->residentMip = 0;
+		texture->requestedMip = mipCount;
+		texture->framesUnused = 0;
+		texture->viewVersion = 0;
+
+		const VkDeviceSize sourceBytes = GetTextureChainSize(info.compression, info.width, info.height, layerCount, sourceMipCount);
+
+		// Streamed textures start out with only the mip tail in video memory
+		if (info.stream && sourceMipCount > 1) {
+			texture->streamSource = (u8*)malloc(sourceBytes);
+			ReadTextureLevels(info, layerCount, 0, sourceMipCount, texture->streamSource);
+			texture->residentMip = GetStreamingTailMip(info.width, info.height, mipCount);
+		}
+
+		CreateTextureImage(*texture, texture->residentMip, texture->image, texture->memory, texture->view, texture->residentBytes);
+		textureMemoryUsage += texture->residentBytes;
 
 		VkSamplerCreateInfo samplerInfo;
 		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -1429,188 +1728,395 @@ namespace Rendering {
 		vkCreateSampler(device, &samplerInfo, nullptr, &texture->sampler);
 
 		// Copy data
+		const u32 residentMip = texture->residentMip;
+		const VkDeviceSize uploadOffset = GetTextureChainSize(info.compression, info.width, info.height, layerCount, residentMip);
+		const VkDeviceSize uploadBytes = sourceBytes - uploadOffset;
+
 		Buffer stagingBuffer;
-		AllocateBuffer(imageBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer);
+		AllocateBuffer(uploadBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer);
 
 		void* data;
-		vkMapMemory(device, stagingBuffer.memory, 0, imageBytes, 0, &data);
-		memcpy(data, info.pixels, imageBytes);
+		vkMapMemory(device, stagingBuffer.memory, 0, uploadBytes, 0, &data);
+		if (texture->streamSource != nullptr) {
+			memcpy(data, texture->streamSource + uploadOffset, uploadBytes);
+		}
+		else {
+			ReadTextureLevels(info, layerCount, residentMip, sourceMipCount, (u8*)data);
+		}
 		vkUnmapMemory(device, stagingBuffer.memory);
 
-		VkCommandBuffer temp = GetTemporaryCommandBuffer();
+		// Recorded into the next frame's commands, the staging buffer is freed after that frame's fence
+		pendingTextureUploads.push_back({ stagingBuffer, (TextureHandle)handle.Raw(), residentMip, generateMips });
 
-		VkCommandBufferBeginInfo beginInfo;
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.pNext = nullptr;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-		beginInfo.pInheritanceInfo = nullptr;
+		textures.Commit(handle);
+		return (TextureHandle)handle.Raw();
+	}
+	void Vulkan::FreeTexture(TextureHandle handle) {
+		const Texture* texture = textures[handle];
+		if (texture != nullptr) {
+			vkDestroySampler(device, texture->sampler, nullptr);
+			vkDestroyImageView(device, texture->view, nullptr);
+			vkDestroyImage(device, texture->image, nullptr);
+			vkFreeMemory(device, texture->memory, nullptr);
+			textureMemoryUsage -= texture->residentBytes;
+			free(texture->streamSource);
+		}
 
-		vkBeginCommandBuffer(temp, &beginInfo);
+		textures.Remove(handle);
+	}
 
-		//cmds
-		VkImageMemoryBarrier barrier;
-		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		barrier.pNext = nullptr;
-		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		barrier.image = texture->image;
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		barrier.subresourceRange.baseMipLevel = 0;
-		barrier.subresourceRange.levelCount = mipCount;
-		barrier.subresourceRange.baseArrayLayer = 0;
-		barrier.subresourceRange.layerCount = layerCount;
+	void Vulkan::SetTextureMemoryBudget(u64 bytes) {
+		textureMemoryBudget = bytes;
+	}
 
-		vkCmdPipelineBarrier(temp, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-		VkBufferImageCopy region;
-		region.bufferOffset = 0;
-		region.bufferRowLength = 0;
-		region.bufferImageHeight = 0;
-		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		region.imageSubresource.mipLevel = 0;
-		region.imageSubresource.baseArrayLayer = 0;
-		region.imageSubresource.layerCount = layerCount;
-		region.imageOffset = { 0,0,0 };
-		region.imageExtent = { info.width,info.height,1 };
-
-		vkCmdCopyBufferToImage(temp, stagingBuffer.buffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-		// Generate mipmaps
-		// This needs to be done even if there are no mipmaps, to convert the texture into the correct format
-		VkImageMemoryBarrier mipBarrier{};
-		mipBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		mipBarrier.pNext = nullptr;
-		mipBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		mipBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		mipBarrier.image = texture->image;
-		mipBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		mipBarrier.subresourceRange.levelCount = 1;
-		mipBarrier.subresourceRange.baseArrayLayer = 0;
-		mipBarrier.subresourceRange.layerCount = layerCount;
-
-		s32 mipWidth = info.width;
-		s32 mipHeight = info.height;
-
-		for (u32 i = 1; i < mipCount; i++)
-		{
-			mipBarrier.subresourceRange.baseMipLevel = i - 1;
-			mipBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			mipBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-			mipBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			mipBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-
-			vkCmdPipelineBarrier(temp, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
-
-			VkImageBlit blit{};
-			blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			blit.srcSubresource.mipLevel = i - 1;
-			blit.srcSubresource.baseArrayLayer = 0;
-			blit.srcSubresource.layerCount = layerCount;
-			blit.srcOffsets[0] = { 0, 0, 0 };
-			blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
-			blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			blit.dstSubresource.mipLevel = i;
-			blit.dstSubresource.baseArrayLayer = 0;
-			blit.dstSubresource.layerCount = layerCount;
-			blit.dstOffsets[0] = { 0, 0, 0 };
-			blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
-
-			vkCmdBlitImage(temp, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
-
-			mipBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-			mipBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			mipBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-			mipBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	void Vulkan::RequestMaterialTextureResolution(MaterialHandle handle, r32 screenPixels) {
+		const Material* material = materials[handle];
+		if (material == nullptr) {
+			return;
+		}
+
+		for (u32 i = 0; i < material->textureCount; i++) {
+			Texture* texture = textures[material->textures[i]];
+			if (texture == nullptr || texture->streamSource == nullptr) {
+				continue;
+			}
 
-			vkCmdPipelineBarrier(temp, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
+			// Assumes the texture is mapped roughly once across the object
+			const r32 texels = (r32)MAX(texture->width, texture->height);
+			u32 mip = 0;
+			if (screenPixels < texels) {
+				mip = (u32)std::floor(std::log2(texels / MAX(screenPixels, 1.0f)));
+			}
+			mip = MIN(mip, texture->mipCount - 1);
 
-			if (mipWidth > 1)
-				mipWidth /= 2;
-			if (mipHeight > 1)
-				mipHeight /= 2;
+			texture->requestedMip = MIN(texture->requestedMip, mip);
 		}
+	}
 
-		mipBarrier.subresourceRange.baseMipLevel = mipCount - 1;
-		mipBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		mipBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		mipBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		mipBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	void Vulkan::UpdateTextureStreaming(TextureResidencyCallback onResidencyChanged, void* userData) {
+		// Drop mips that haven't been needed for a while, or right away if something else is waiting for memory
+		for (u32 i = 0; i < textures.SlotCount(); i++) {
+			PoolHandle<Texture> handle;
+			if (!textures.GetSlotHandle(i, handle)) {
+				continue;
+			}
+			Texture* texture = textures[handle];
+			if (texture->streamSource == nullptr) {
+				continue;
+			}
 
-		vkCmdPipelineBarrier(temp, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
+			const u32 tailMip = GetStreamingTailMip(texture->width, texture->height, texture->mipCount);
+			if (texture->residentMip >= tailMip || texture->requestedMip <= texture->residentMip) {
+				texture->framesUnused = 0;
+				continue;
+			}
 
-		vkEndCommandBuffer(temp);
+			texture->framesUnused++;
+			if (texture->framesUnused >= textureEvictionDelayFrames || textureStreamingStarved || textureMemoryUsage > textureMemoryBudget) {
+				if (SetTextureResidentMip((TextureHandle)handle.Raw(), texture->residentMip + 1)) {
+					onResidencyChanged(userData, (TextureHandle)handle.Raw(), texture->residentBytes);
+				}
+				texture->framesUnused = 0;
+			}
+		}
 
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &temp;
+		// Stream in one mip at a time for the textures that are missing the most detail
+		textureStreamingStarved = false;
+		for (u32 upload = 0; upload < maxTextureStreamingUploadsPerFrame; upload++) {
+			PoolHandle<Texture> bestHandle;
+			u32 bestDeficit = 0;
+			for (u32 i = 0; i < textures.SlotCount(); i++) {
+				PoolHandle<Texture> handle;
+				if (!textures.GetSlotHandle(i, handle)) {
+					continue;
+				}
+				const Texture* texture = textures[handle];
+				if (texture->streamSource == nullptr || texture->requestedMip >= texture->residentMip) {
+					continue;
+				}
+
+				const u32 deficit = texture->residentMip - texture->requestedMip;
+				if (deficit > bestDeficit) {
+					bestDeficit = deficit;
+					bestHandle = handle;
+				}
+			}
 
-		vkQueueSubmit(primaryQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(primaryQueue);
+			if (bestDeficit == 0) {
+				break;
+			}
 
-		vkFreeCommandBuffers(device, tempCommandPool, 1, &temp);
+			Texture* texture = textures[bestHandle];
+			const u32 mip = texture->residentMip - 1;
+			const VkDeviceSize bytes = GetTextureChainSize(texture->compression, texture->width, texture->height, texture->layerCount, mip, texture->mipCount);
+			if (textureMemoryUsage - texture->residentBytes + bytes > textureMemoryBudget) {
+				textureStreamingStarved = true;
+				break;
+			}
 
-		FreeBuffer(stagingBuffer);
-		
-		return (TextureHandle)handle.Raw();
+			if (SetTextureResidentMip((TextureHandle)bestHandle.Raw(), mip)) {
+				onResidencyChanged(userData, (TextureHandle)bestHandle.Raw(), texture->residentBytes);
+			}
+		}
+
+		// Reset requests for the next frame
+		for (u32 i = 0; i < textures.SlotCount(); i++) {
+			PoolHandle<Texture> handle;
+			if (!textures.GetSlotHandle(i, handle)) {
+				continue;
+			}
+			Texture* texture = textures[handle];
+			texture->requestedMip = texture->mipCount;
+		}
 	}
-	void Vulkan::FreeTexture(TextureHandle handle) {
-		const Texture* texture = textures[handle];
-		if (texture != nullptr) {
-			vkDestroySampler(device, texture->sampler, nullptr);
-			vkDestroyImageView(device, texture->view, nullptr);
-			vkDestroyImage(device, texture->image, nullptr);
-			vkFreeMemory(device, texture->memory, nullptr);
+
+	// Reallocates the texture so that mips [mip, mipCount) are resident. Mips that stay resident are copied over on the GPU
+	// The copies go into the frame's commands, ahead of the draws, and the old image lives until the frame is done
+	bool Vulkan::SetTextureResidentMip(TextureHandle handle, u32 mip) {
+		FrameData& frame = frames[currentFrameIndex];
+		Texture* texture = textures[handle];
+		const u32 oldMip = texture->residentMip;
+		if (texture->streamSource == nullptr || mip == oldMip || mip >= texture->mipCount) {
+			return false;
 		}
 
-		textures.Remove(handle);
+		VkImage image;
+		VkDeviceMemory memory;
+		VkImageView view;
+		VkDeviceSize bytes;
+		CreateTextureImage(*texture, mip, image, memory, view, bytes);
+
+		// New finer mips come from the host copy
+		const bool upload = mip < oldMip;
+		Buffer stagingBuffer{};
+		if (upload) {
+			const VkDeviceSize uploadOffset = GetTextureChainSize(texture->compression, texture->width, texture->height, texture->layerCount, mip);
+			const VkDeviceSize uploadBytes = GetTextureChainSize(texture->compression, texture->width, texture->height, texture->layerCount, mip, oldMip);
+			AllocateBuffer(uploadBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer);
+
+			void* data;
+			vkMapMemory(device, stagingBuffer.memory, 0, uploadBytes, 0, &data);
+			memcpy(data, texture->streamSource + uploadOffset, uploadBytes);
+			vkUnmapMemory(device, stagingBuffer.memory);
+		}
+
+		const VkCommandBuffer cmd = frame.cmdBuffer;
+
+		const u32 keptMip = MAX(mip, oldMip);
+		const u32 keptCount = texture->mipCount - keptMip;
+
+		CmdTextureBarrier(cmd, image, 0, texture->mipCount - mip, texture->layerCount, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		CmdTextureBarrier(cmd, texture->image, keptMip - oldMip, keptCount, texture->layerCount, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+		VkImageCopy regions[32];
+		for (u32 i = 0; i < keptCount; i++) {
+			const u32 level = keptMip + i;
+			VkImageCopy& region = regions[i];
+			region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.srcSubresource.mipLevel = level - oldMip;
+			region.srcSubresource.baseArrayLayer = 0;
+			region.srcSubresource.layerCount = texture->layerCount;
+			region.srcOffset = { 0, 0, 0 };
+			region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.dstSubresource.mipLevel = level - mip;
+			region.dstSubresource.baseArrayLayer = 0;
+			region.dstSubresource.layerCount = texture->layerCount;
+			region.dstOffset = { 0, 0, 0 };
+			region.extent = { GetMipDimension(texture->width, level), GetMipDimension(texture->height, level), 1 };
+		}
+		vkCmdCopyImage(cmd, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, keptCount, regions);
+
+		if (upload) {
+			CopyTextureLevels(cmd, stagingBuffer.buffer, *texture, image, mip, mip, oldMip);
+		}
+
+		CmdTextureBarrier(cmd, image, 0, texture->mipCount - mip, texture->layerCount, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+		if (upload) {
+			frame.retiredBuffers.push_back(stagingBuffer);
+		}
+		frame.retiredImages.push_back({ texture->image, texture->view, texture->memory });
+
+		textureMemoryUsage = textureMemoryUsage - texture->residentBytes + bytes;
+
+		texture->image = image;
+		texture->memory = memory;
+		texture->view = view;
+		texture->residentBytes = bytes;
+		texture->residentMip = mip;
+		texture->viewVersion++;
+		return true;
+	}
+
+	void Vulkan::DestroyRetiredFrameResources(FrameData& frame) {
+		for (const RetiredImage& image : frame.retiredImages) {
+			vkDestroyImageView(device, image.view, nullptr);
+			vkDestroyImage(device, image.image, nullptr);
+			vkFreeMemory(device, image.memory, nullptr);
+		}
+		frame.retiredImages.clear();
+
+		for (const Buffer& buffer : frame.retiredBuffers) {
+			FreeBuffer(buffer);
+		}
+		frame.retiredBuffers.clear();
+	}
+
+	void Vulkan::GetRenderResolution(u32& outWidth, u32& outHeight) const {
+		outWidth = xrEyeImageWidth;
+		outHeight = xrEyeImageHeight;
 	}
 
-	MeshHandle Vulkan::CreateMesh(const MeshCreateInfo& data) {
+	static bool FitsInU16Indices(const Triangle* triangles, u32 triangleCount) {
+		if (triangles == nullptr) {
+			return false;
+		}
+
+		for (u32 i = 0; i < triangleCount; i++) {
+			const Triangle& tri = triangles[i];
+			if (tri.index[0] > 0xffff || tri.index[1] > 0xffff || tri.index[2] > 0xffff) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	MeshHandle Vulkan::ReserveMesh() {
 		PoolHandle<Mesh> handle;
-		Mesh* mesh = meshes.Add(handle);
+		if (!meshes.ReserveHandle(handle)) {
+			DEBUG_ERROR("Error reserving mesh");
+		}
+		return (MeshHandle)handle.Raw();
+	}
+	void Vulkan::CancelMesh(MeshHandle reserved) {
+		meshes.CancelReservation(reserved);
+	}
 
-		if (data.position != nullptr) {
-			const VkDeviceSize posBytes = sizeof(glm::vec3) * data.vertexCount;
-			AllocateBuffer(posBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mesh->vertexPositionBuffer);
-			CopyRawDataToBuffer(data.position, mesh->vertexPositionBuffer.buffer, posBytes);
+	MeshHandle Vulkan::CreateMesh(const MeshCreateInfo& data, MeshHandle reserved) {
+		const PoolHandle<Mesh> handle = reserved;
+		Mesh* mesh = meshes.GetReserved(handle);
+		if (mesh == nullptr) {
+			DEBUG_ERROR("Error creating mesh, the handle isn't reserved");
 		}
 
-		if (data.texcoord0 != nullptr) {
-			const VkDeviceSize uvBytes = sizeof(glm::vec2) * data.vertexCount;
-			AllocateBuffer(uvBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mesh->vertexTexcoord0Buffer);
-			CopyRawDataToBuffer(data.texcoord0, mesh->vertexTexcoord0Buffer.buffer, uvBytes);
+		mesh->vertexFormat = data.vertexFormat;
+		mesh->quantization.positionScale = glm::vec4(1.0f);
+		mesh->quantization.positionOffset = glm::vec4(0.0f);
+		if (data.encodedStreams[0] != nullptr) {
+			mesh->quantization = data.encodedQuantization;
 		}
 
-		if (data.normal != nullptr) {
-			const VkDeviceSize normalBytes = sizeof(glm::vec3) * data.vertexCount;
-			AllocateBuffer(normalBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mesh->vertexNormalBuffer);
-			CopyRawDataToBuffer(data.normal, mesh->vertexNormalBuffer.buffer, normalBytes);
+		// Float and already encoded streams are uploaded as is, the rest are quantized into a temporary buffer first
+		const void* streams[vertexStreamCount] = { data.position, data.texcoord0, data.normal, data.tangent, data.color, data.joints, data.weights };
+		Buffer* buffers[vertexStreamCount] = { &mesh->vertexPositionBuffer, &mesh->vertexTexcoord0Buffer, &mesh->vertexNormalBuffer, &mesh->vertexTangentBuffer, &mesh->vertexColorBuffer, &mesh->vertexJointsBuffer, &mesh->vertexWeightsBuffer };
+		for (u32 i = 0; i < vertexStreamCount; i++) {
+			if (data.encodedStreams[i] != nullptr) {
+				streams[i] = data.encodedStreams[i];
+			}
+		}
+		mesh->skinned = streams[5] != nullptr && streams[6] != nullptr;
+		u8* quantized = nullptr;
+		if (data.vertexFormat == VERTEX_FORMAT_QUANTIZED) {
+			// Positions have the biggest quantized stride
+			quantized = (u8*)malloc((u64)data.vertexCount * vertexStreamStrides[0][VERTEX_FORMAT_QUANTIZED]);
 		}
 
-		if (data.tangent != nullptr) {
-			const VkDeviceSize tangentBytes = sizeof(glm::vec4) * data.vertexCount;
-			AllocateBuffer(tangentBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mesh->vertexTangentBuffer);
-			CopyRawDataToBuffer(data.tangent, mesh->vertexTangentBuffer.buffer, tangentBytes);
+		mesh->memorySize = 0;
+		for (u32 i = 0; i < vertexStreamCount; i++) {
+			// Pool slots are reused, so stale buffers must not be left behind for FreeMesh
+			*buffers[i] = {};
+			if (streams[i] == nullptr) {
+				continue;
+			}
+
+			const VertexStreamLayout& stream = vertexStreamLayouts[i];
+			const VkDeviceSize bytes = (VkDeviceSize)vertexStreamStrides[i][data.vertexFormat] * data.vertexCount;
+			const void* src = streams[i];
+			if (data.vertexFormat == VERTEX_FORMAT_QUANTIZED && data.encodedStreams[i] == nullptr) {
+				switch (stream.attribute) {
+					case VERTEX_POSITION_BIT: {
+						glm::vec3 scale, offset;
+						GetPositionQuantization(data.position, data.vertexCount, scale, offset);
+						QuantizePositions(data.position, data.vertexCount, scale, offset, (s16*)quantized);
+						mesh->quantization.positionScale = glm::vec4(scale, 1.0f);
+						mesh->quantization.positionOffset = glm::vec4(offset, 0.0f);
+						break;
+					}
+					case VERTEX_TEXCOORD_0_BIT:
+						QuantizeTexcoords(data.texcoord0, data.vertexCount, (u16*)quantized);
+						break;
+					case VERTEX_NORMAL_BIT:
+						QuantizeNormals(data.normal, data.vertexCount, (s16*)quantized);
+						break;
+					case VERTEX_TANGENT_BIT:
+						QuantizeTangents(data.tangent, data.vertexCount, (s16*)quantized);
+						break;
+					case VERTEX_COLOR_BIT:
+						QuantizeColors(data.color, data.vertexCount, quantized);
+						break;
+					case VERTEX_JOINTS_BIT:
+						memcpy(quantized, data.joints, bytes);
+						break;
+					case VERTEX_WEIGHTS_BIT:
+						QuantizeWeights(data.weights, data.vertexCount, (u16*)quantized);
+						break;
+					default:
+						break;
+				}
+				src = quantized;
+			}
+
+			mesh->memorySize += AllocateBuffer(bytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *buffers[i]);
+			CopyRawDataToBuffer(handle.Raw(), src, buffers[i]->buffer, bytes);
 		}
+		free(quantized);
 
-		if (data.color != nullptr) {
-			const VkDeviceSize colorBytes = sizeof(Color) * data.vertexCount;
-			AllocateBuffer(colorBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mesh->vertexColorBuffer);
-			CopyRawDataToBuffer(data.color, mesh->vertexColorBuffer.buffer, colorBytes);
+		// Submesh vertex offsets are added after the index is fetched, so only the index values matter
+		const Triangle16* triangles16 = data.triangles16;
+		Triangle16* narrowed = nullptr;
+		if (triangles16 == nullptr && FitsInU16Indices(data.triangles, data.triangleCount)) {
+			narrowed = (Triangle16*)calloc(data.triangleCount, sizeof(Triangle16));
+			for (u32 i = 0; i < data.triangleCount; i++) {
+				const Triangle& tri = data.triangles[i];
+				narrowed[i] = Triangle16(tri.index[0], tri.index[1], tri.index[2]);
+			}
+			triangles16 = narrowed;
 		}
 
-		const VkDeviceSize indexBytes = sizeof(Triangle) * data.triangleCount;
-		AllocateBuffer(indexBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mesh->indexBuffer);
-		CopyRawDataToBuffer(data.triangles, mesh->indexBuffer.buffer, indexBytes);
+		const void* indexData = triangles16 != nullptr ? (const void*)triangles16 : (const void*)data.triangles;
+		const VkDeviceSize indexBytes = (triangles16 != nullptr ? sizeof(Triangle16) : sizeof(Triangle)) * data.triangleCount;
+		mesh->memorySize += AllocateBuffer(indexBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mesh->indexBuffer);
+		CopyRawDataToBuffer(handle.Raw(), indexData, mesh->indexBuffer.buffer, indexBytes);
+		mesh->indexType = triangles16 != nullptr ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+		free(narrowed);
 
 		mesh->vertexCount = data.vertexCount;
 		mesh->indexCount = data.triangleCount * 3;
 
+		if (data.submeshCount > maxSubmeshCount) {
+			DEBUG_ERROR("Too many submeshes (%d)", data.submeshCount);
+		}
+
+		if (data.submeshCount == 0 || data.submeshes == nullptr) {
+			mesh->submeshCount = 1;
+			mesh->submeshes[0] = {};
+			mesh->submeshes[0].lodCount = 1;
+			mesh->submeshes[0].lods[0] = { 0, data.triangleCount, 0.0f };
+		}
+		else {
+			mesh->submeshCount = data.submeshCount;
+			memcpy(mesh->submeshes, data.submeshes, sizeof(Submesh) * data.submeshCount);
+		}
+
+		mesh->meshletCount = 0;
+		mesh->meshlets = nullptr;
+		if (data.meshletCount > 0 && data.meshlets != nullptr && data.submeshes != nullptr) {
+			mesh->meshletCount = data.meshletCount;
+			mesh->meshlets = (Meshlet*)malloc(sizeof(Meshlet) * data.meshletCount);
+			memcpy(mesh->meshlets, data.meshlets, sizeof(Meshlet) * data.meshletCount);
+		}
+
+		meshes.Commit(handle);
 		return (MeshHandle)handle.Raw();
 	}
 	void Vulkan::FreeMesh(MeshHandle handle) {
@@ -1621,7 +2127,10 @@ namespace Rendering {
 		FreeBuffer(mesh->vertexNormalBuffer);
 		FreeBuffer(mesh->vertexTangentBuffer);
 		FreeBuffer(mesh->vertexColorBuffer);
+		FreeBuffer(mesh->vertexJointsBuffer);
+		FreeBuffer(mesh->vertexWeightsBuffer);
 		FreeBuffer(mesh->indexBuffer);
+		free(mesh->meshlets);
 
 		meshes.Remove(handle);
 	}
@@ -1629,14 +2138,17 @@ namespace Rendering {
 	ShaderHandle Vulkan::CreateShader(const ShaderCreateInfo& info) {
 		PoolHandle<Shader> handle;
 		Shader* shader = shaders.Add(handle);
+		if (shader == nullptr) {
+			DEBUG_ERROR("Error creating shader");
+		}
 
-		shader->layoutInfo.flags = (DescriptorSetLayoutFlags)(DSF_CAMERADATA | DSF_LIGHTINGDATA | DSF_INSTANCEDATA | DSF_SHADERDATA | DSF_CUBEMAP);
+		shader->layoutInfo.flags = (DescriptorSetLayoutFlags)(DSF_CAMERADATA | DSF_LIGHTINGDATA | DSF_INSTANCEDATA | DSF_JOINTDATA | DSF_SHADERDATA | DSF_CUBEMAP);
 		shader->layoutInfo.samplerCount = info.samplerCount;
-		shader->layoutInfo.bindingCount = 5 + info.samplerCount;
+		shader->layoutInfo.bindingCount = 6 + info.samplerCount;
 		shader->vertexInputs = info.vertexInputs;
 
 		CreateDescriptorSetLayout(shader->descriptorSetLayout, shader->layoutInfo);
-		CreateShaderRenderPipeline(shader->pipelineLayout, shader->pipeline, shader->descriptorSetLayout, shader->vertexInputs, info.vertShader, info.vertShaderLength, info.fragShader, info.fragShaderLength);
+		CreateShaderRenderPipeline(shader->pipelineLayout, shader->pipelines, shader->descriptorSetLayout, shader->vertexInputs, info.vertShader, info.vertShaderLength, info.fragShader, info.fragShaderLength);
 
 		return (ShaderHandle)handle.Raw();
 	}
@@ -1644,7 +2156,9 @@ namespace Rendering {
 		const Shader* shader = shaders[handle];
 
 		vkDestroyPipelineLayout(device, shader->pipelineLayout, nullptr);
-		vkDestroyPipeline(device, shader->pipeline, nullptr);
+		for (u32 i = 0; i < VERTEX_FORMAT_COUNT; i++) {
+			vkDestroyPipeline(device, shader->pipelines[i], nullptr);
+		}
 		vkDestroyDescriptorSetLayout(device, shader->descriptorSetLayout, nullptr);
 
 		shaders.Remove(handle);
@@ -1653,23 +2167,42 @@ namespace Rendering {
 	MaterialHandle Vulkan::CreateMaterial(const MaterialCreateInfo& info) {
 		PoolHandle<Material> handle;
 		Material *material = materials.Add(handle);
+		if (material == nullptr) {
+			DEBUG_ERROR("Error creating material, max material count is %d", maxMaterialCount);
+		}
 		const Shader* shader = shaders[info.metadata.shader];
 
+		VkDescriptorSetLayout setLayouts[maxFramesInFlight];
+		for (u32 i = 0; i < maxFramesInFlight; i++) {
+			setLayouts[i] = shader->descriptorSetLayout;
+		}
+
 		VkDescriptorSetAllocateInfo allocInfo;
 		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 		allocInfo.pNext = nullptr;
 		allocInfo.descriptorPool = descriptorPool;
-		allocInfo.descriptorSetCount = 1;
-		allocInfo.pSetLayouts = &shader->descriptorSetLayout;
+		allocInfo.descriptorSetCount = maxFramesInFlight;
+		allocInfo.pSetLayouts = setLayouts;
 
-		VkResult res = vkAllocateDescriptorSets(device, &allocInfo, &material->descriptorSet);
+		VkResult res = vkAllocateDescriptorSets(device, &allocInfo, material->descriptorSets);
 		if (res != VK_SUCCESS) {
 			DEBUG_ERROR("Oh noes... (%d)", res);
 		}
 
 		MaterialHandle matHandle = (MaterialHandle)handle.Raw();
 
-		InitializeDescriptorSet(material->descriptorSet, shader->layoutInfo, matHandle, info.data.textures);
+		material->textureCount = shader->layoutInfo.samplerCount;
+		for (u32 i = 0; i < material->textureCount; i++) {
+			material->textures[i] = info.data.textures[i];
+		}
+
+		for (u32 frame = 0; frame < maxFramesInFlight; frame++) {
+			InitializeDescriptorSet(material->descriptorSets[frame], shader->layoutInfo, matHandle, info.data.textures);
+			for (u32 i = 0; i < material->textureCount; i++) {
+				material->boundTextures[frame][i] = info.data.textures[i];
+				material->boundViewVersions[frame][i] = textures[info.data.textures[i]]->viewVersion;
+			}
+		}
 		UpdateMaterialData(matHandle, (void*)info.data.data, 0, maxShaderDataBlockSize);
 
 		return matHandle;
@@ -1691,20 +2224,14 @@ namespace Rendering {
 			DEBUG_ERROR("Invalid sampler index %d", index);
 		}
 
-		const Material* material = materials[handle];
-		const Texture* texture = textures[texHandle];
-
-		VkDescriptorImageInfo imageInfo{};
-		imageInfo.sampler = texture->sampler;
-		imageInfo.imageView = texture->view;
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		UpdateDescriptorSetSampler(material->descriptorSet, samplerBinding + index, imageInfo);
+		// Frames in flight may still read the descriptor sets, each one gets rewritten when it's next bound
+		Material* material = materials[handle];
+		material->textures[index] = texHandle;
 	}
 	void Vulkan::FreeMaterial(MaterialHandle handle) {
 		const Material* material = materials[handle];
 
-		vkFreeDescriptorSets(device, descriptorPool, 1, &material->descriptorSet);
+		vkFreeDescriptorSets(device, descriptorPool, maxFramesInFlight, material->descriptorSets);
 		materials.Remove(handle);
 	}
 
@@ -1712,6 +2239,9 @@ namespace Rendering {
 		outStride = instanceDataElementSize;
 		return pHostVisibleInstanceData;
 	}
+	glm::mat4* const Vulkan::GetJointDataPtr() {
+		return pHostVisibleJointData;
+	}
 	u8* const Vulkan::GetCameraDataPtr() {
 		return pHostVisibleUniformData + cameraDataOffset;
 	}
@@ -1720,10 +2250,13 @@ namespace Rendering {
 	}
 
 	void Vulkan::BeginRenderCommands() {
-		const FrameData& frame = frames[currentFrameIndex];
+		FrameData& frame = frames[currentFrameIndex];
 
 		// Wait for drawing to finish if it hasn't
 		vkWaitForFences(device, 1, &frame.cmdFence, VK_TRUE, UINT64_MAX);
+		meshes.Reclaim();
+		textures.Reclaim();
+		DestroyRetiredFrameResources(frame);
 
 		vkResetFences(device, 1, &frame.cmdFence);
 		vkResetCommandPool(device, frame.cmdPool, 0);
@@ -1737,6 +2270,9 @@ namespace Rendering {
 			DEBUG_ERROR("failed to begin recording command buffer!");
 		}
 
+		// Resources created since the last frame are uploaded ahead of everything that uses them
+		RecordPendingUploads(frame);
+
 		// Should be ready to draw now!
 	}
 	void Vulkan::TransferUniformBufferData() {
@@ -1789,6 +2325,36 @@ namespace Rendering {
 
 		vkCmdPipelineBarrier(frame.cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 	}
+	void Vulkan::TransferJointBufferData(u32 count) {
+		if (count > maxJointCount) {
+			DEBUG_ERROR("Buffer copy size too large");
+		}
+		if (count == 0) {
+			return;
+		}
+
+		const FrameData& frame = frames[currentFrameIndex];
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.pNext = nullptr;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(frame.cmdBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = 0;
+		copyRegion.dstOffset = 0;
+		copyRegion.size = sizeof(glm::mat4) * count;
+
+		vkCmdCopyBuffer(frame.cmdBuffer, jointHostBuffer.buffer, jointDeviceBuffer.buffer, 1, &copyRegion);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(frame.cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
 	// This could be just generic...
 	void Vulkan::BeginForwardRenderPass(const u32 xrSwapchainImageIndex) {
 		const FrameData& frame = frames[currentFrameIndex];
@@ -1836,22 +2402,46 @@ namespace Rendering {
 		scissor.extent = extent;
 		vkCmdSetScissor(frame.cmdBuffer, 0, 1, &scissor);
 	}
-	void Vulkan::BindMaterial(MaterialHandle matHandle, ShaderHandle shaderHandle, u16 instanceOffset) {
+	void Vulkan::BindMaterial(MaterialHandle matHandle, ShaderHandle shaderHandle, u32 instanceOffset) {
 		const FrameData& frame = frames[currentFrameIndex];
 		const Shader* shader = shaders[shaderHandle];
-		const Material* material = materials[matHandle];
+		Material* material = materials[matHandle];
+		const VkDescriptorSet descriptorSet = material->descriptorSets[currentFrameIndex];
+
+		// This frame's set is no longer read by the GPU after the fence wait, and isn't bound yet if it's out of date,
+		// since textures only change before the draws are recorded
+		for (u32 i = 0; i < material->textureCount; i++) {
+			const Texture* texture = textures[material->textures[i]];
+			if (texture == nullptr) {
+				continue;
+			}
+			if (material->boundTextures[currentFrameIndex][i] == material->textures[i] && material->boundViewVersions[currentFrameIndex][i] == texture->viewVersion) {
+				continue;
+			}
+
+			VkDescriptorImageInfo imageInfo{};
+			imageInfo.sampler = texture->sampler;
+			imageInfo.imageView = texture->view;
+			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		// TODO: Bind only once when rendering many things with same shader
-		vkCmdBindPipeline(frame.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shader->pipeline);
+			UpdateDescriptorSetSampler(descriptorSet, samplerBinding + i, imageInfo);
+			material->boundTextures[currentFrameIndex][i] = material->textures[i];
+			material->boundViewVersions[currentFrameIndex][i] = texture->viewVersion;
+		}
 
+		// The pipeline depends on the vertex format, so BindMesh binds it
 		u32 dynamicOffset = instanceDataElementSize * instanceOffset;
-		vkCmdBindDescriptorSets(frame.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shader->pipelineLayout, 0, 1, &material->descriptorSet, 1, &dynamicOffset);
+		vkCmdBindDescriptorSets(frame.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shader->pipelineLayout, 0, 1, &descriptorSet, 1, &dynamicOffset);
 	}
 	void Vulkan::BindMesh(MeshHandle meshHandle, ShaderHandle shaderHandle) {
 		const FrameData& frame = frames[currentFrameIndex];
 		const Mesh* mesh = meshes[meshHandle];
 		const Shader* shader = shaders[shaderHandle];
 
+		// All variants share the pipeline layout, so the material's descriptor set stays bound
+		vkCmdBindPipeline(frame.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shader->pipelines[mesh->vertexFormat]);
+		vkCmdPushConstants(frame.cmdBuffer, shader->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VertexQuantizationData), &mesh->quantization);
+
 		VkDeviceSize offset = 0;
 		if (shader->vertexInputs & VERTEX_POSITION_BIT)
 			vkCmdBindVertexBuffers(frame.cmdBuffer, 0, 1, &mesh->vertexPositionBuffer.buffer, &offset);
@@ -1863,14 +2453,62 @@ namespace Rendering {
 			vkCmdBindVertexBuffers(frame.cmdBuffer, 3, 1, &mesh->vertexTangentBuffer.buffer, &offset);
 		if (shader->vertexInputs & VERTEX_COLOR_BIT)
 			vkCmdBindVertexBuffers(frame.cmdBuffer, 4, 1, &mesh->vertexColorBuffer.buffer, &offset);
+		if (shader->vertexInputs & VERTEX_JOINTS_BIT)
+			vkCmdBindVertexBuffers(frame.cmdBuffer, 5, 1, &mesh->vertexJointsBuffer.buffer, &offset);
+		if (shader->vertexInputs & VERTEX_WEIGHTS_BIT)
+			vkCmdBindVertexBuffers(frame.cmdBuffer, 6, 1, &mesh->vertexWeightsBuffer.buffer, &offset);
+
+		vkCmdBindIndexBuffer(frame.cmdBuffer, mesh->indexBuffer.buffer, 0, mesh->indexType);
+	}
+	void Vulkan::BindJoints(ShaderHandle shaderHandle, u32 jointOffset, u32 jointCount) {
+		const FrameData& frame = frames[currentFrameIndex];
+		const Shader* shader = shaders[shaderHandle];
+
+		const VertexSkinningData skinning = { jointOffset, jointCount };
+		vkCmdPushConstants(frame.cmdBuffer, shader->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, sizeof(VertexQuantizationData), sizeof(VertexSkinningData), &skinning);
+	}
+	void Vulkan::Draw(MeshHandle meshHandle, u32 submeshIndex, u32 lod, u32 instanceOffset, u32 instanceCount) {
+		const FrameData& frame = frames[currentFrameIndex];
+		const Mesh* mesh = meshes[meshHandle];
+		const Submesh& submesh = mesh->submeshes[submeshIndex];
+		const SubmeshLod& range = submesh.lods[lod];
 
-		vkCmdBindIndexBuffer(frame.cmdBuffer, mesh->indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdDrawIndexed(frame.cmdBuffer, range.triangleCount * 3, instanceCount, range.firstTriangle * 3, submesh.vertexOffset, 0);
 	}
-	void Vulkan::Draw(MeshHandle meshHandle, u16 instanceOffset, u16 instanceCount) {
+	void Vulkan::DrawRanges(MeshHandle meshHandle, u32 submeshIndex, const SubmeshLod* ranges, u32 rangeCount, u32 instanceCount) {
 		const FrameData& frame = frames[currentFrameIndex];
 		const Mesh* mesh = meshes[meshHandle];
+		const Submesh& submesh = mesh->submeshes[submeshIndex];
 
-		vkCmdDrawIndexed(frame.cmdBuffer, mesh->indexCount, instanceCount, 0, 0, 0);
+		for (u32 i = 0; i < rangeCount; i++) {
+			vkCmdDrawIndexed(frame.cmdBuffer, ranges[i].triangleCount * 3, instanceCount, ranges[i].firstTriangle * 3, submesh.vertexOffset, 0);
+		}
+	}
+	u32 Vulkan::GetSubmeshCount(MeshHandle meshHandle) {
+		const Mesh* mesh = meshes[meshHandle];
+		return mesh->submeshCount;
+	}
+	const Submesh& Vulkan::GetSubmesh(MeshHandle meshHandle, u32 submeshIndex) {
+		const Mesh* mesh = meshes[meshHandle];
+		return mesh->submeshes[submeshIndex];
+	}
+	const Meshlet* Vulkan::GetMeshlets(MeshHandle meshHandle, u32& outCount) {
+		const Mesh* mesh = meshes[meshHandle];
+		outCount = mesh->meshletCount;
+		return mesh->meshlets;
+	}
+	VkDeviceSize Vulkan::GetMeshMemorySize(MeshHandle meshHandle) {
+		const Mesh* mesh = meshes[meshHandle];
+		return mesh->memorySize;
+	}
+	VkDeviceSize Vulkan::GetTextureMemorySize(TextureHandle textureHandle) {
+		const Texture* texture = textures[textureHandle];
+		return texture->residentBytes;
+	}
+	const TextureHandle* Vulkan::GetMaterialTextures(MaterialHandle matHandle, u32& outCount) {
+		const Material* material = materials[matHandle];
+		outCount = material->textureCount;
+		return material->textures;
 	}
 	void Vulkan::EndRenderPass() {
 		const FrameData& frame = frames[currentFrameIndex];
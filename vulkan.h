@@ -9,6 +9,9 @@
 #define SWAPCHAIN_MIN_IMAGE_COUNT 3
 
 namespace Rendering {
+	// Called when streaming changes how much of a texture is in video memory
+	typedef void (*TextureResidencyCallback)(void* userData, TextureHandle texture, u64 residentBytes);
+
 	class Vulkan {
 	public:
 		Vulkan(const XR::XRInstance* const xrInstance);
@@ -16,10 +19,16 @@ namespace Rendering {
 
 		void CreateXRSwapchain(const XR::XRInstance* const xrInstance);
 		void WaitForAllCommands();
-		TextureHandle CreateTexture(const TextureCreateInfo& info);
 		void FreeTexture(TextureHandle handle);
-		MeshHandle CreateMesh(const MeshCreateInfo& info);
 		void FreeMesh(MeshHandle handle);
+		// Thread safe, so loader threads can hand out handles before the data is uploaded
+		// A reserved handle is passed to CreateTexture or CreateMesh, or given back with CancelTexture or CancelMesh
+		TextureHandle ReserveTexture();
+		TextureHandle CreateTexture(const TextureCreateInfo& info, TextureHandle reserved);
+		void CancelTexture(TextureHandle reserved);
+		MeshHandle ReserveMesh();
+		MeshHandle CreateMesh(const MeshCreateInfo& info, MeshHandle reserved);
+		void CancelMesh(MeshHandle reserved);
 		ShaderHandle CreateShader(const ShaderCreateInfo& info);
 		void FreeShader(ShaderHandle handle);
 		MaterialHandle CreateMaterial(const MaterialCreateInfo& info);
@@ -27,16 +36,36 @@ namespace Rendering {
 		void UpdateMaterialTexture(MaterialHandle handle, u32 index, TextureHandle texture);
 		void FreeMaterial(MaterialHandle handle);
 
+		void SetTextureMemoryBudget(u64 bytes);
+		void RequestMaterialTextureResolution(MaterialHandle handle, r32 screenPixels);
+		// Records mip copies into the frame's commands, call after BeginRenderCommands and before the render pass
+		void UpdateTextureStreaming(TextureResidencyCallback onResidencyChanged, void* userData);
+		void GetRenderResolution(u32& outWidth, u32& outHeight) const;
+
 		u8* const GetInstanceDataPtr(u32& outStride);
+		// maxJointCount matrices, uploaded at the start of the frame
+		glm::mat4* const GetJointDataPtr();
 		u8* const GetCameraDataPtr();
 		u8* const GetLightingDataPtr();
 		void BeginRenderCommands();
 		void TransferUniformBufferData();
 		void TransferInstanceBufferData(u32 offset, u32 size);
+		void TransferJointBufferData(u32 count);
 		void BeginForwardRenderPass(const u32 xrSwapchainImageIndex);
-		void BindMaterial(MaterialHandle matHandle, ShaderHandle shaderHandle, u16 instanceOffset);
+		void BindMaterial(MaterialHandle matHandle, ShaderHandle shaderHandle, u32 instanceOffset);
 		void BindMesh(MeshHandle meshHandle, ShaderHandle shaderHandle);
-		void Draw(MeshHandle meshHandle, u16 instanceOffset, u16 instanceCount);
+		// Only read by skinned shaders
+		void BindJoints(ShaderHandle shaderHandle, u32 jointOffset, u32 jointCount);
+		void Draw(MeshHandle meshHandle, u32 submeshIndex, u32 lod, u32 instanceOffset, u32 instanceCount);
+		// Draws only the given triangle ranges of the submesh, error of the ranges is ignored
+		void DrawRanges(MeshHandle meshHandle, u32 submeshIndex, const SubmeshLod* ranges, u32 rangeCount, u32 instanceCount);
+		u32 GetSubmeshCount(MeshHandle meshHandle);
+		VkDeviceSize GetMeshMemorySize(MeshHandle meshHandle);
+		// Only the resident mips of streamed textures
+		VkDeviceSize GetTextureMemorySize(TextureHandle textureHandle);
+		const TextureHandle* GetMaterialTextures(MaterialHandle matHandle, u32& outCount);
+		const Submesh& GetSubmesh(MeshHandle meshHandle, u32 submeshIndex);
+		const Meshlet* GetMeshlets(MeshHandle meshHandle, u32& outCount);
 		void EndRenderPass();
 		void EndRenderCommands();
 
@@ -58,9 +87,24 @@ namespace Rendering {
 
 		struct Texture {
 			VkImage image;
-			VkImageView view;
+			VkImageView view; // Only covers the resident mips
 			VkDeviceMemory memory;
 			VkSampler sampler;
+
+			VkFormat format;
+			VkImageViewType viewType;
+			TextureCompression compression;
+			u32 width, height; // Full resolution
+			u32 layerCount;
+			u32 mipCount; // Full mip chain
+
+			// Streaming
+			u8* streamSource; // Host copy of the full mip chain, null if the texture isn't streamed
+			u32 residentMip; // Most detailed mip in video memory
+			u32 requestedMip; // Most detailed mip requested this frame, mipCount if none
+			u32 framesUnused; // Frames the most detailed resident mip hasn't been needed
+			VkDeviceSize residentBytes;
+			u32 viewVersion; // Bumped whenever streaming replaces the image and view
 		};
 
 		struct Mesh {
@@ -70,9 +114,23 @@ namespace Rendering {
 			Buffer vertexNormalBuffer;
 			Buffer vertexTangentBuffer;
 			Buffer vertexColorBuffer;
+			Buffer vertexJointsBuffer;
+			Buffer vertexWeightsBuffer;
+			bool skinned;
+			VertexFormat vertexFormat;
+			VertexQuantizationData quantization;
 
 			u32 indexCount;
 			Buffer indexBuffer;
+			VkIndexType indexType;
+
+			u32 submeshCount;
+			Submesh submeshes[maxSubmeshCount];
+
+			u32 meshletCount;
+			Meshlet* meshlets; // Host copy for culling
+
+			VkDeviceSize memorySize; // Of all buffers
 		};
 
 		enum DescriptorSetLayoutFlags
@@ -83,6 +141,7 @@ namespace Rendering {
 			DSF_INSTANCEDATA = 1 << 2,
 			DSF_SHADERDATA = 1 << 3,
 			DSF_CUBEMAP = 1 << 4,
+			DSF_JOINTDATA = 1 << 5,
 		};
 
 		struct DescriptorSetLayoutInfo
@@ -94,14 +153,20 @@ namespace Rendering {
 
 		struct Shader {
 			VkPipelineLayout pipelineLayout;
-			VkPipeline pipeline;
+			VkPipeline pipelines[VERTEX_FORMAT_COUNT];
 			VkDescriptorSetLayout descriptorSetLayout;
 			DescriptorSetLayoutInfo layoutInfo;
 			VertexAttribFlags vertexInputs;
 		};
 
+		// One descriptor set per frame in flight, so a frame's set can be rewritten while the GPU still reads the other
 		struct Material {
-			VkDescriptorSet descriptorSet;
+			VkDescriptorSet descriptorSets[maxFramesInFlight];
+			u32 textureCount;
+			TextureHandle textures[maxSamplerCount];
+			// What each frame's set was last written with, BindMaterial rewrites samplers that are out of date
+			TextureHandle boundTextures[maxFramesInFlight][maxSamplerCount];
+			u32 boundViewVersions[maxFramesInFlight][maxSamplerCount];
 		};
 
 		struct FramebufferAttachemnt {
@@ -115,10 +180,34 @@ namespace Rendering {
 			VkImageView view;
 		};
 
+		struct RetiredImage {
+			VkImage image;
+			VkImageView view;
+			VkDeviceMemory memory;
+		};
+
+		// Uploads of resources created between frames, recorded at the start of the next frame's commands
+		struct PendingBufferUpload {
+			Buffer staging;
+			MeshHandle mesh;
+			VkBuffer dst;
+			VkDeviceSize size;
+		};
+		struct PendingTextureUpload {
+			Buffer staging;
+			TextureHandle texture;
+			u32 firstMip;
+			bool generateMips;
+		};
+
 		struct FrameData {
 			VkCommandPool cmdPool;
 			VkCommandBuffer cmdBuffer; // Recorded each frame
 			VkFence cmdFence; // Used to wait for previous frame to complete rendering before recording new commands
+
+			// Replaced by texture streaming while recording, destroyed after the fence wait
+			std::vector<RetiredImage> retiredImages;
+			std::vector<Buffer> retiredBuffers;
 		};
 
 		bool IsPhysicalDeviceSuitable(VkPhysicalDevice physicalDevice, u32& outQueueFamilyIndex);
@@ -137,21 +226,31 @@ namespace Rendering {
 		void FreeUniformBuffers();
 		void CreatePerInstanceBuffers();
 		void FreePerInstanceBuffers();
+		void CreateJointBuffers();
+		void FreeJointBuffers();
 
 		s32 GetDeviceMemoryTypeIndex(u32 typeFilter, VkMemoryPropertyFlags propertyFlags);
 		VkCommandBuffer GetTemporaryCommandBuffer();
+		VkCommandBuffer BeginTemporaryCommands();
+		void EndTemporaryCommands(VkCommandBuffer commandBuffer);
         void AllocateMemory(VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, VkDeviceMemory& outMemory);
         VkDeviceSize AllocateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memProps, Buffer& outBuffer);
         VkDeviceSize AllocateImage(VkImage image, VkMemoryPropertyFlags memProps, VkDeviceMemory& outMemory);
-		void CopyBuffer(const VkBuffer& src, const VkBuffer& dst, VkDeviceSize size);
-		void CopyRawDataToBuffer(void* src, const VkBuffer& dst, VkDeviceSize size);
+		void CopyRawDataToBuffer(MeshHandle owner, const void* src, const VkBuffer& dst, VkDeviceSize size);
+		void RecordTextureUpload(VkCommandBuffer cmd, const Texture& texture, const VkBuffer& staging, u32 firstMip, bool generateMips);
+		void RecordPendingUploads(FrameData& frame);
 		void FreeBuffer(const Buffer& buffer);
 		VkShaderModule CreateShaderModule(const char* code, const u32 size);
 		void CreateDescriptorSetLayout(VkDescriptorSetLayout& layout, const DescriptorSetLayoutInfo& info);
-		void CreateShaderRenderPipeline(VkPipelineLayout& outLayout, VkPipeline &outPipeline, const VkDescriptorSetLayout &descSetLayout, VertexAttribFlags vertexInputs, const char* vert, u32 vertSize, const char* frag, u32 fragSize);
+		void CreateShaderRenderPipeline(VkPipelineLayout& outLayout, VkPipeline* outPipelines, const VkDescriptorSetLayout &descSetLayout, VertexAttribFlags vertexInputs, const char* vert, u32 vertSize, const char* frag, u32 fragSize);
 		void InitializeDescriptorSet(VkDescriptorSet descriptorSet, const DescriptorSetLayoutInfo& info, const MaterialHandle matHandle, const TextureHandle* textures);
 		void UpdateDescriptorSetSampler(VkDescriptorSet descriptorSet, u32 binding, VkDescriptorImageInfo info);
 		void UpdateDescriptorSetBuffer(VkDescriptorSet descriptorSet, u32 binding, VkDescriptorBufferInfo info, VkDescriptorType type);
+		void CreateTextureImage(const Texture& texture, u32 baseMip, VkImage& outImage, VkDeviceMemory& outMemory, VkImageView& outView, VkDeviceSize& outBytes);
+		void CopyTextureLevels(VkCommandBuffer commandBuffer, const VkBuffer& src, const Texture& texture, VkImage dst, u32 baseMip, u32 firstMip, u32 lastMip);
+		// False if nothing changed
+		bool SetTextureResidentMip(TextureHandle handle, u32 mip);
+		void DestroyRetiredFrameResources(FrameData& frame);
 
 		VkInstance vkInstance;
 
@@ -171,8 +270,9 @@ namespace Rendering {
 		u32 primaryQueueFamilyIndex = 0;
 		VkQueue primaryQueue;
 		
-		static constexpr u32 maxFramesInFlight = 2;
 		FrameData frames[maxFramesInFlight];
+		std::vector<PendingBufferUpload> pendingBufferUploads;
+		std::vector<PendingTextureUpload> pendingTextureUploads;
 		u32 currentFrameIndex = 0;
 
 		VkCommandPool tempCommandPool; // Used for allocating temporary cmd buffers
@@ -208,6 +308,13 @@ namespace Rendering {
 		Buffer instanceHostBuffer;
 		Buffer instanceDeviceBuffer;
 
+		// Joint matrices of skinned instances in a storage buffer
+		VkDeviceSize jointDataSize = 0;
+		glm::mat4* pHostVisibleJointData = nullptr;
+
+		Buffer jointHostBuffer;
+		Buffer jointDeviceBuffer;
+
 		// Uniform shader bindings
 		static constexpr u32 cameraDataBinding = 0;
 		static constexpr u32 lightingDataBinding = 1;
@@ -215,13 +322,20 @@ namespace Rendering {
 		static constexpr u32 shaderDataBinding = 3;
 
 		static constexpr u32 samplerBinding = 4; // 4 - 11 reserved for generic samplers
-		Pool<Texture> textures = Pool<Texture>(maxTextureCount);
-
-		Pool<Mesh> meshes = Pool<Mesh>(maxVertexBufferCount);
+		// Loader threads can reserve texture handles, freed slots are reclaimed once the frame that may use them is done
+		ConcurrentPool<Texture> textures = ConcurrentPool<Texture>(maxTextureCount); // Grows past the reserved count as needed
+		VkDeviceSize textureMemoryUsage = 0;
+		VkDeviceSize textureMemoryBudget = defaultTextureMemoryBudget;
+		bool textureStreamingStarved = false; // A stream-in was refused last frame because of the budget
+
+		// Loader threads can reserve mesh handles, freed slots are reclaimed once the frame that may use them is done
+		ConcurrentPool<Mesh> meshes = ConcurrentPool<Mesh>(maxVertexBufferCount);
 		Pool<Shader> shaders = Pool<Shader>(maxShaderCount);
-		Pool<Material> materials = Pool<Material>(maxMaterialCount);
+		// Material indices address the shader data buffer, so this one can't grow
+		Pool<Material> materials = Pool<Material>(maxMaterialCount, maxMaterialCount);
 
 		static constexpr u32 envMapBinding = 12;
+		static constexpr u32 jointDataBinding = 13;
 
 		FramebufferAttachemnt colorAttachment;
 		FramebufferAttachemnt depthAttachment;
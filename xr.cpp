@@ -53,19 +53,27 @@ namespace XR {
 		// createInfo.enabledApiLayerNames = &validationLayerName;
 
 		// TODO: Actually check if these are in the list of supported extensions
-		const char* const extensionNames[] = {
+		std::vector<const char*> extensionNames = {
 		"XR_KHR_vulkan_enable",
 		"XR_KHR_vulkan_enable2",
 		"XR_FB_render_model",
 #ifdef NEKRO_DEBUG
 		"XR_EXT_debug_utils"
+#endif
 		};
-		createInfo.enabledExtensionCount = 4;
-#else
-		};
-		createInfo.enabledExtensionCount = 3;
+
+		// Optional
+		bool locateSpacesAvailable = false;
+#ifdef XR_KHR_locate_spaces
+		for (auto& extension : availableExtensions) {
+			if (strcmp(extension.extensionName, XR_KHR_LOCATE_SPACES_EXTENSION_NAME) == 0) {
+				extensionNames.push_back(XR_KHR_LOCATE_SPACES_EXTENSION_NAME);
+				locateSpacesAvailable = true;
+			}
+		}
 #endif
-		createInfo.enabledExtensionNames = extensionNames;
+		createInfo.enabledExtensionCount = (u32)extensionNames.size();
+		createInfo.enabledExtensionNames = extensionNames.data();
 
 		XrResult result = xrCreateInstance(&createInfo, &instance);
 		if (result != XR_SUCCESS) {
@@ -73,6 +81,12 @@ namespace XR {
 			DEBUG_ERROR("XR instance creation failed with error code %d", result);
 		}
 
+#ifdef XR_KHR_locate_spaces
+		if (locateSpacesAvailable) {
+			xrGetInstanceProcAddr(instance, "xrLocateSpacesKHR", (PFN_xrVoidFunction*)&xrLocateSpacesKHR);
+		}
+#endif
+
 #ifdef NEKRO_DEBUG
 		SetupDebugLogging();
 #endif
@@ -503,9 +517,99 @@ namespace XR {
 
 		xrSyncActions(session, &syncInfo);
 
+		LocateFrame(frameState.predictedDisplayTime);
+
 		return frameState.shouldRender;
 	}
 
+	static TrackedPose GetTrackedPose(XrSpaceLocationFlags locationFlags, const XrPosef& pose, XrSpaceVelocityFlags velocityFlags, const XrVector3f& linearVelocity, const XrVector3f& angularVelocity) {
+		TrackedPose result{};
+		result.valid = (locationFlags & XR_SPACE_LOCATION_POSITION_VALID_BIT) && (locationFlags & XR_SPACE_LOCATION_ORIENTATION_VALID_BIT);
+		result.velocityValid = (velocityFlags & XR_SPACE_VELOCITY_LINEAR_VALID_BIT) && (velocityFlags & XR_SPACE_VELOCITY_ANGULAR_VALID_BIT);
+
+		const glm::vec3 pos = glm::vec3(pose.position.x, pose.position.y, pose.position.z);
+		const glm::quat rot = glm::quat(pose.orientation.w, pose.orientation.x, pose.orientation.y, pose.orientation.z);
+		result.transform = result.valid ? glm::translate(glm::mat4x4(1.0f), pos) * glm::mat4_cast(rot) : glm::mat4(1.0f);
+		result.linearVelocity = result.velocityValid ? glm::vec3(linearVelocity.x, linearVelocity.y, linearVelocity.z) : glm::vec3(0.0f);
+		result.angularVelocity = result.velocityValid ? glm::vec3(angularVelocity.x, angularVelocity.y, angularVelocity.z) : glm::vec3(0.0f);
+		return result;
+	}
+
+	void XRInstance::LocateFrame(s64 displayTime) {
+		frame.displayTime = displayTime;
+
+		XrViewLocateInfo viewLocateInfo{};
+		viewLocateInfo.type = XR_TYPE_VIEW_LOCATE_INFO;
+		viewLocateInfo.viewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
+		viewLocateInfo.displayTime = displayTime;
+		viewLocateInfo.space = space;
+
+		XrViewState viewState{};
+		viewState.type = XR_TYPE_VIEW_STATE;
+
+		frame.viewCount = 2;
+		frame.views[0] = { XR_TYPE_VIEW };
+		frame.views[1] = { XR_TYPE_VIEW };
+		if (xrLocateViews(session, &viewLocateInfo, &viewState, 2, &frame.viewCount, frame.views) != XR_SUCCESS) {
+			frame.viewCount = 0;
+		}
+
+		const XrSpace handSpaces[2] = { leftHandSpace, rightHandSpace };
+
+#ifdef XR_KHR_locate_spaces
+		if (xrLocateSpacesKHR != nullptr) {
+			XrSpaceVelocityDataKHR velocities[2]{};
+			XrSpaceVelocitiesKHR velocityList{};
+			velocityList.type = XR_TYPE_SPACE_VELOCITIES_KHR;
+			velocityList.velocityCount = 2;
+			velocityList.velocities = velocities;
+
+			XrSpaceLocationDataKHR locations[2]{};
+			XrSpaceLocationsKHR locationList{};
+			locationList.type = XR_TYPE_SPACE_LOCATIONS_KHR;
+			locationList.next = &velocityList;
+			locationList.locationCount = 2;
+			locationList.locations = locations;
+
+			XrSpacesLocateInfoKHR locateInfo{};
+			locateInfo.type = XR_TYPE_SPACES_LOCATE_INFO_KHR;
+			locateInfo.baseSpace = space;
+			locateInfo.time = displayTime;
+			locateInfo.spaceCount = 2;
+			locateInfo.spaces = handSpaces;
+
+			if (xrLocateSpacesKHR(session, &locateInfo, &locationList) == XR_SUCCESS) {
+				for (u32 hand = 0; hand < 2; hand++) {
+					frame.hands[hand] = GetTrackedPose(locations[hand].locationFlags, locations[hand].pose, velocities[hand].velocityFlags, velocities[hand].linearVelocity, velocities[hand].angularVelocity);
+				}
+			}
+			else {
+				frame.hands[0] = {};
+				frame.hands[1] = {};
+			}
+			return;
+		}
+#endif
+
+		for (u32 hand = 0; hand < 2; hand++) {
+			XrSpaceVelocity velocity{};
+			velocity.type = XR_TYPE_SPACE_VELOCITY;
+
+			XrSpaceLocation location{};
+			location.type = XR_TYPE_SPACE_LOCATION;
+			location.next = &velocity;
+
+			frame.hands[hand] = {};
+			if (xrLocateSpace(handSpaces[hand], space, displayTime, &location) == XR_SUCCESS) {
+				frame.hands[hand] = GetTrackedPose(location.locationFlags, location.pose, velocity.velocityFlags, velocity.linearVelocity, velocity.angularVelocity);
+			}
+		}
+	}
+
+	const FrameSnapshot& XRInstance::GetFrameSnapshot() const {
+		return frame;
+	}
+
 	void XRInstance::GetViewData(const XrView& view, r32 nearClip, r32 farClip, glm::mat4& outView, glm::mat4& outProj, glm::vec3& outPos) {
 		const glm::vec3 pos = glm::vec3(view.pose.position.x, view.pose.position.y, view.pose.position.z);
 		const glm::quat rot = glm::quat(view.pose.orientation.w, view.pose.orientation.x, view.pose.orientation.y, view.pose.orientation.z);
@@ -546,16 +650,33 @@ namespace XR {
 		return true;
 	}
 
-	bool XRInstance::GetCameraData(s64 displayTime, r32 nearClip, r32 farClip, Rendering::CameraData& outData) {
+	bool XRInstance::GetCameraData(r32 nearClip, r32 farClip, Rendering::CameraData& outData) {
 		if (session == XR_NULL_HANDLE) {
 			DEBUG_LOG("No session to get camera matrices");
 			return false;
 		}
 
+		if (frame.viewCount < 2) {
+			return false;
+		}
+
+		cameraNearClip = nearClip;
+		cameraFarClip = farClip;
+		GetViewData(frame.views[0], nearClip, farClip, outData.view[0], outData.proj[0], outData.pos[0]);
+		GetViewData(frame.views[1], nearClip, farClip, outData.view[1], outData.proj[1], outData.pos[1]);
+
+		return true;
+	}
+
+	bool XRInstance::LateLatchCameraData(Rendering::CameraData& outData) {
+		if (session == XR_NULL_HANDLE || frame.viewCount < 2) {
+			return false;
+		}
+
 		XrViewLocateInfo viewLocateInfo{};
 		viewLocateInfo.type = XR_TYPE_VIEW_LOCATE_INFO;
 		viewLocateInfo.viewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
-		viewLocateInfo.displayTime = displayTime;
+		viewLocateInfo.displayTime = frame.displayTime;
 		viewLocateInfo.space = space;
 
 		XrViewState viewState{};
@@ -565,78 +686,47 @@ namespace XR {
 		XrView views[2] = {
 			{ XR_TYPE_VIEW }, { XR_TYPE_VIEW }
 		};
-		xrLocateViews(session, &viewLocateInfo, &viewState, viewCount, &viewCount, views);
-
-		GetViewData(views[0], nearClip, farClip, outData.view[0], outData.proj[0], outData.pos[0]);
-		GetViewData(views[1], nearClip, farClip, outData.view[1], outData.proj[1], outData.pos[1]);
+		// Keep the earlier poses if tracking dropped out in between
+		const XrViewStateFlags requiredFlags = XR_VIEW_STATE_POSITION_VALID_BIT | XR_VIEW_STATE_ORIENTATION_VALID_BIT;
+		if (xrLocateViews(session, &viewLocateInfo, &viewState, viewCount, &viewCount, views) != XR_SUCCESS ||
+			viewCount < 2 || (viewState.viewStateFlags & requiredFlags) != requiredFlags) {
+			return false;
+		}
 
-		return true;
+		frame.views[0] = views[0];
+		frame.views[1] = views[1];
+		return GetCameraData(cameraNearClip, cameraFarClip, outData);
 	}
 
-	bool XRInstance::GetHandTransform(s64 displayTime, HandIndex hand, glm::mat4& outTransform) {
+	bool XRInstance::GetHandTransform(HandIndex hand, glm::mat4& outTransform) {
 		if (session == XR_NULL_HANDLE) {
 			DEBUG_LOG("No session to get hand transform");
 			return false;
 		}
 
-		XrPosef pose;
-
-		XrActionStateGetInfo getInfo{};
-		getInfo.type = XR_TYPE_ACTION_STATE_GET_INFO;
-		getInfo.action = hand == VR_HAND_LEFT ? leftHandAction : rightHandAction;
-
-		XrActionStatePose state{};
-		state.type = XR_TYPE_ACTION_STATE_POSE;
-
-		// TODO: Use this for something (It contains velocity maybe?)
-		xrGetActionStatePose(session, &getInfo, &state);
-
-		XrSpaceLocation location{};
-		location.type = XR_TYPE_SPACE_LOCATION;
-
-		XrSpace handSpace = hand == VR_HAND_LEFT ? leftHandSpace : rightHandSpace;
-		xrLocateSpace(handSpace, space, displayTime, &location);
-
-		if (!(location.locationFlags & XR_SPACE_LOCATION_POSITION_VALID_BIT) || !(location.locationFlags & XR_SPACE_LOCATION_ORIENTATION_VALID_BIT)) {
+		const TrackedPose& pose = frame.hands[hand];
+		if (!pose.valid) {
 			return false;
 		}
 
-		const glm::vec3 pos = glm::vec3(location.pose.position.x, location.pose.position.y, location.pose.position.z);
-		const glm::quat rot = glm::quat(location.pose.orientation.w, location.pose.orientation.x, location.pose.orientation.y, location.pose.orientation.z);
-
-		outTransform = glm::translate(glm::mat4x4(1.0f), pos) * glm::mat4_cast(rot);
-
+		outTransform = pose.transform;
 		return true;
-}
+	}
 
-	bool XRInstance::EndFrame(s64 displayTime) {
+	bool XRInstance::EndFrame() {
 		if (session == XR_NULL_HANDLE) {
 			DEBUG_LOG("No session to end frame");
 			return false;
 		}
 
-		XrViewLocateInfo viewLocateInfo{};
-		viewLocateInfo.type = XR_TYPE_VIEW_LOCATE_INFO;
-		viewLocateInfo.viewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
-		viewLocateInfo.displayTime = displayTime;
-		viewLocateInfo.space = space;
-
-		XrViewState viewState{};
-		viewState.type = XR_TYPE_VIEW_STATE;
-
-		u32 viewCount = 2;
-		XrView views[2] = {
-			{ XR_TYPE_VIEW }, { XR_TYPE_VIEW }
-		};
-		xrLocateViews(session, &viewLocateInfo, &viewState, viewCount, &viewCount, views);
-
+		// Same poses the frame was rendered with, locating again would give slightly different ones
 		XrCompositionLayerProjectionView projectedViews[2]{};
 
-		for (int i = 0; i < viewCount; i++)
+		for (int i = 0; i < frame.viewCount; i++)
 		{
 			projectedViews[i].type = XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW;
-			projectedViews[i].pose = views[i].pose;
-			projectedViews[i].fov = views[i].fov;
+			projectedViews[i].pose = frame.views[i].pose;
+			projectedViews[i].fov = frame.views[i].fov;
 			projectedViews[i].subImage.swapchain = swapchain;
 			projectedViews[i].subImage.imageRect.offset = { 0, 0 };
 			projectedViews[i].subImage.imageRect.extent = { (s32)hmdSystem.viewConfigurationView.recommendedImageRectWidth, (s32)hmdSystem.viewConfigurationView.recommendedImageRectHeight };
@@ -646,16 +736,16 @@ namespace XR {
 		XrCompositionLayerProjection layer{};
 		layer.type = XR_TYPE_COMPOSITION_LAYER_PROJECTION;
 		layer.space = space;
-		layer.viewCount = viewCount;
+		layer.viewCount = frame.viewCount;
 		layer.views = projectedViews;
 
 		auto pLayer = (const XrCompositionLayerBaseHeader*)&layer;
 
 		XrFrameEndInfo endFrameInfo{};
 		endFrameInfo.type = XR_TYPE_FRAME_END_INFO;
-		endFrameInfo.displayTime = displayTime;
+		endFrameInfo.displayTime = frame.displayTime;
 		endFrameInfo.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE;
-		endFrameInfo.layerCount = 1;
+		endFrameInfo.layerCount = frame.viewCount > 0 ? 1 : 0;
 		endFrameInfo.layers = &pLayer;
 
 		xrEndFrame(session, &endFrameInfo);
@@ -34,6 +34,23 @@ namespace XR {
 		VR_HAND_RIGHT = 1
 	};
 
+	// Pose of a tracked space relative to the reference space
+	struct TrackedPose {
+		glm::mat4 transform;
+		glm::vec3 linearVelocity; // Meters per second
+		glm::vec3 angularVelocity; // Radians per second around the axis
+		bool valid; // Position and orientation are both tracked
+		bool velocityValid;
+	};
+
+	// Everything located for one frame at its predicted display time, so rendering and the submitted layer agree
+	struct FrameSnapshot {
+		s64 displayTime;
+		u32 viewCount;
+		XrView views[2];
+		TrackedPose hands[2];
+	};
+
 	class XRInstance {
 	public:
 		XRInstance(android_app *app);
@@ -49,11 +66,17 @@ namespace XR {
 
 		bool GetControllerGeometry(HandIndex hand, u8** outBuffer, u32& outSize);
 		void Update(r32 dt);
+		// Waits for the frame and locates the views and hands for its snapshot
 		bool BeginFrame(s64& outPredictedDisplayTime);
-		bool GetCameraData(s64 displayTime, r32 nearClip, r32 farClip, Rendering::CameraData& outData);
-		bool GetHandTransform(s64 displayTime, HandIndex hand, glm::mat4& outTransform);
+		const FrameSnapshot& GetFrameSnapshot() const;
+		bool GetCameraData(r32 nearClip, r32 farClip, Rendering::CameraData& outData);
+		// Locates the views again for the same display time, closer to it the prediction is better
+		// Uses the clip planes of the last GetCameraData. The snapshot is updated so that EndFrame submits these poses
+		bool LateLatchCameraData(Rendering::CameraData& outData);
+		bool GetHandTransform(HandIndex hand, glm::mat4& outTransform);
 		bool GetSpaceDimensions(r32& outWidth, r32& outHeight);
-		bool EndFrame(s64 displayTime);
+		// Submits the views of the snapshot
+		bool EndFrame();
 
 		// Vulkan implementation
 		bool GetVulkanInstanceRequirements(VulkanInstanceRequirements& outRequirements) const;
@@ -78,6 +101,8 @@ namespace XR {
 		void EndSession();
 
 		void GetViewData(const XrView& view, r32 nearClip, r32 farClip, glm::mat4& outView, glm::mat4& outProj, glm::vec3& outPos);
+		// One call for the views and one for all action spaces
+		void LocateFrame(s64 displayTime);
 
 		XrInstance instance;
 		System hmdSystem;
@@ -95,6 +120,14 @@ namespace XR {
 		XrSpace rightHandSpace = XR_NULL_HANDLE;
 		XrAction rightHandAction = XR_NULL_HANDLE;
 
+		FrameSnapshot frame{};
+		r32 cameraNearClip = 0.01f;
+		r32 cameraFarClip = 100.0f;
+#ifdef XR_KHR_locate_spaces
+		// Null if the runtime doesn't have XR_KHR_locate_spaces, spaces are then located one by one
+		PFN_xrLocateSpacesKHR xrLocateSpacesKHR = nullptr;
+#endif
+
 		XrSwapchain swapchain = XR_NULL_HANDLE;
 		std::vector<XrSwapchainImageVulkanKHR> swapchainImages;
 